@@ -0,0 +1,468 @@
+// BSD 3-Clause Licence //////////////////////////////////////////////////////////////////////// //
+// Copyright (c) 2017 Thibault Lescoat, All rights reserved.                                     //
+//                                                                                               //
+// Redistribution and use in source and binary forms, with or without modification, are          //
+// permitted provided that the following conditions are met:                                     //
+//                                                                                               //
+// * Redistributions of source code must retain the above copyright notice, this list of         //
+//   conditions and the following disclaimer.                                                    //
+//                                                                                               //
+// * Redistributions in binary form must reproduce the above copyright notice, this list of      //
+//   conditions and the following disclaimer in the documentation and/or other materials         //
+//   provided with the distribution.                                                             //
+//                                                                                               //
+// * Neither the name of the copyright holder nor the names of its contributors may be used to   //
+//   endorse or promote products derived from this software without specific prior written       //
+//   permission.                                                                                 //
+//                                                                                               //
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS   //
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF               //
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE    //
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,     //
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE //
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED    //
+// AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     //
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
+// Canvas renderer (see flow_graph_renderer::canvas in flow_graph.h): nodes, slots and edges are
+// kept in flat arrays, and drawn on a canvas at the animation frames where something changed.
+// What is in the view is found with box_grid, edges are batched into a few paths, and text is
+// only drawn when it can be read. Collisions are resolved by a web worker made from an inline
+// script (see flow_graph_simulation), that sends the positions back. Returns an object to stop the
+// rendering.
+function flow_graph_canvas(graph)
+{
+	'use strict';
+
+	// Must match flow_graph_metrics in flow_graph.h
+	var node_width = 170;
+	var node_padding = 10;
+	var slot_height = 40;
+	var slot_radius = 10;
+	var title_height = 40;
+	var separator_height = 10;
+	var separator_count = 8;
+	var edge_strength = 60;
+	// Text and slots are drawn above this scale, edges are straight lines below the other one
+	var detail_scale = 0.35, curve_scale = 0.1;
+
+	// Positions (top-left corners, interleaved x and y), heights and slot counts of the nodes
+	var n = graph.nodes.length, connections = graph.connections, edge_count = connections.length / 4;
+	var positions = new Float32Array(2 * n), heights = new Float32Array(n);
+	var input_counts = new Uint32Array(n), output_counts = new Uint32Array(n);
+	var node_height = node => title_height + separator_height + slot_height * Math.max(node.inputs.length, node.outputs.length);
+	var computed = graph.layout ? null : flow_layout(graph, node_height);
+	graph.nodes.forEach(function(node, i)
+	{
+		positions[2 * i] = computed ? 1.6 * node_width * computed[i].x : graph.layout[2 * i];
+		positions[2 * i + 1] = computed ? computed[i].y : graph.layout[2 * i + 1];
+		heights[i] = node_height(node);
+		input_counts[i] = node.inputs.length;
+		output_counts[i] = node.outputs.length;
+	});
+	var slot_y = (i, s) => positions[2 * i + 1] + title_height + separator_height + slot_height * (s + 0.5);
+
+	// Heat overlay (see flow_graph_heat), in a few levels so that elements of the same colour
+	// are drawn together; level 0 is the default colour
+	var levels = 8, node_levels = new Uint8Array(n), edge_levels = new Uint8Array(edge_count);
+	var node_colors = ['#ffffff88'], edge_colors = ['#555'], edge_widths = [3], tips = null;
+	var legend = flow_graph_heat(graph, edge_count, function(m, node_values, edge_values, scale, heat, format)
+	{
+		for(var l = 0; l < levels; l++)
+		{
+			node_colors[l + 1] = heat(l / (levels - 1), 0.6);
+			edge_colors[l + 1] = heat(l / (levels - 1), 1);
+			edge_widths[l + 1] = 2 + 8 * l / (levels - 1);
+		}
+		var level = v => isNaN(v) ? 0 : 1 + Math.round(scale(v) * (levels - 1));
+		tips = graph.nodes.map((node, i) => isNaN(node_values[i]) ? node.name : node.name + ': ' + format(m, node_values[i]));
+		node_values.forEach((v, i) => { node_levels[i] = level(v); });
+		edge_values.forEach((v, i) => { edge_levels[i] = level(v); });
+		redraw();
+	});
+
+	// The canvas replaces the svg of the page until stopped
+	var svg = document.getElementsByTagName('svg')[0];
+	svg.style.display = 'none';
+	var canvas = document.createElement('canvas');
+	canvas.style.cssText = 'position: fixed; left: 0; top: 0; width: 100%; height: 100%;';
+	document.body.appendChild(canvas);
+	var context = canvas.getContext('2d');
+	var width = 0, height = 0, ratio = 1;
+	function resize()
+	{
+		ratio = window.devicePixelRatio || 1;
+		width = document.body.clientWidth;
+		height = document.body.clientHeight;
+		canvas.width = Math.round(width * ratio);
+		canvas.height = Math.round(height * ratio);
+		redraw();
+	}
+	window.addEventListener('resize', resize);
+
+	// Collisions. The worker script is the source (toString()) of bbox_collisions and
+	// flow_graph_simulation: both must use nothing else of the page, and keep their names once
+	// minified, which holds as long as main.js does not set the 'toplevel' option of uglify
+	var script = URL.createObjectURL(new Blob([bbox_collisions + '\n(' + flow_graph_simulation + ')(self);'], { type: 'text/javascript' }));
+	var worker = new Worker(script);
+	var boxes = new Float32Array(4 * n);
+	for(var i = 0; i < n; i++)
+		boxes.set([-node_padding - slot_radius * 2, -node_padding - slot_radius, node_padding + node_width + slot_radius * 2, node_padding + slot_radius + heights[i]], 4 * i);
+	worker.postMessage({ positions: positions.slice(), boxes: boxes }, [boxes.buffer]);
+	worker.onmessage = function(e)
+	{
+		var p = e.data;
+		if(dragged >= 0)
+		{
+			p[2 * dragged] = positions[2 * dragged];
+			p[2 * dragged + 1] = positions[2 * dragged + 1];
+		}
+		positions = p;
+		moved();
+	};
+
+	// Zoom, and drag of the view or of a node
+	var view_x = (document.body.clientWidth - node_width) / 2, view_y = document.body.clientHeight / 2, view_scale = 1;
+	var to_root = (x, y) => [(x - view_x) / view_scale, (y - view_y) / view_scale];
+	var dragged = -1, drag_start = null;
+	canvas.onmousedown = function(e)
+	{
+		var p = to_root(e.clientX, e.clientY);
+		dragged = node_at(p[0], p[1]);
+		drag_start = dragged >= 0 ? [positions[2 * dragged] - p[0], positions[2 * dragged + 1] - p[1]] : [view_x - e.clientX, view_y - e.clientY];
+		window.onmousemove = drag;
+		window.onmouseup = stop_drag;
+		return false;
+	};
+	function drag(e)
+	{
+		if(dragged < 0)
+		{
+			view_x = drag_start[0] + e.clientX;
+			view_y = drag_start[1] + e.clientY;
+		}
+		else
+		{
+			var p = to_root(e.clientX, e.clientY);
+			positions[2 * dragged] = p[0] + drag_start[0];
+			positions[2 * dragged + 1] = p[1] + drag_start[1];
+			worker.postMessage({ drag: dragged, x: positions[2 * dragged], y: positions[2 * dragged + 1] });
+			moved();
+		}
+		redraw();
+		return false;
+	}
+	function stop_drag()
+	{
+		if(dragged >= 0) worker.postMessage({ drag: dragged, release: true });
+		dragged = -1;
+		window.onmousemove = null;
+		window.onmouseup = null;
+		return false;
+	}
+	canvas.onwheel = function(e)
+	{
+		var old_scale = view_scale;
+		view_scale = Math.min(3, Math.max(0.01, view_scale * 2 ** (-e.deltaY * 0.05)));
+		var s = view_scale / old_scale;
+		view_x = (view_x - e.clientX) * s + e.clientX;
+		view_y = (view_y - e.clientY) * s + e.clientY;
+		redraw();
+	};
+	// Name (and measure) of the node under the mouse
+	canvas.onmousemove = function(e)
+	{
+		var p = to_root(e.clientX, e.clientY), i = node_at(p[0], p[1]);
+		canvas.title = i < 0 ? '' : tips ? tips[i] : graph.nodes[i].name;
+	};
+	// Topmost node drawn at a point, -1 if none
+	function node_at(x, y)
+	{
+		for(var k = visible_count - 1; k >= 0; k--)
+		{
+			var i = visible[k], px = positions[2 * i], py = positions[2 * i + 1];
+			if(x >= px && x <= px + node_width && y >= py && y <= py + heights[i]) return i;
+		}
+		return -1;
+	}
+
+	// Boxes of the nodes (with their slots) and of the edge curves, indexed (see box_grid) once
+	// nodes stopped moving for a while. While they move, frames look at all of them.
+	var node_boxes = new Float32Array(4 * n), edge_boxes = new Float32Array(4 * edge_count), grids = null, index_timer = 0;
+	function index_boxes()
+	{
+		var p = positions, b = node_boxes;
+		for(var i = 0; i < n; i++)
+		{
+			b[4 * i] = p[2 * i] - slot_radius;
+			b[4 * i + 1] = p[2 * i + 1];
+			b[4 * i + 2] = p[2 * i] + node_width + slot_radius;
+			b[4 * i + 3] = p[2 * i + 1] + heights[i];
+		}
+		b = edge_boxes;
+		for(var e = 0; e < edge_count; e++)
+		{
+			var out = connections[4 * e], in_ = connections[4 * e + 2];
+			var sx = p[2 * out] + node_width, sy = slot_y(out, connections[4 * e + 1]);
+			var tx = p[2 * in_], ty = slot_y(in_, connections[4 * e + 3]);
+			b[4 * e] = Math.min(sx, tx - edge_strength);
+			b[4 * e + 1] = Math.min(sy, ty);
+			b[4 * e + 2] = Math.max(sx + edge_strength, tx);
+			b[4 * e + 3] = Math.max(sy, ty);
+		}
+		grids = { nodes: box_grid(node_boxes), edges: box_grid(edge_boxes) };
+	}
+	function moved()
+	{
+		grids = null;
+		clearTimeout(index_timer);
+		index_timer = setTimeout(index_boxes, 200);
+		redraw();
+	}
+
+	var frame = 0, visible = new Uint32Array(n), visible_count = 0;
+	function redraw()
+	{
+		if(!frame) frame = requestAnimationFrame(draw);
+	}
+	function draw()
+	{
+		frame = 0;
+		context.setTransform(ratio, 0, 0, ratio, 0, 0);
+		context.clearRect(0, 0, width, height);
+		context.setTransform(ratio * view_scale, 0, 0, ratio * view_scale, ratio * view_x, ratio * view_y);
+		var x0 = -view_x / view_scale, y0 = -view_y / view_scale;
+		var x1 = x0 + width / view_scale, y1 = y0 + height / view_scale;
+
+		// Nodes in the view, with their slots, in the order of the graph (the last ones on top)
+		var p = positions;
+		visible_count = 0;
+		var add_node = function(i)
+		{
+			if(p[2 * i] + node_width + slot_radius >= x0 && p[2 * i] - slot_radius <= x1 && p[2 * i + 1] + heights[i] >= y0 && p[2 * i + 1] <= y1)
+				visible[visible_count++] = i;
+		};
+		if(grids)
+		{
+			grids.nodes(x0, y0, x1, y1, add_node);
+			visible.subarray(0, visible_count).sort();
+		}
+		else for(var i = 0; i < n; i++) add_node(i);
+
+		// Edges whose curve may cross the view, one path per colour
+		var curves = view_scale >= curve_scale, paths = edge_colors.map(() => null);
+		var add_edge = function(e)
+		{
+			var out = connections[4 * e], in_ = connections[4 * e + 2];
+			var sx = p[2 * out] + node_width, sy = slot_y(out, connections[4 * e + 1]);
+			var tx = p[2 * in_], ty = slot_y(in_, connections[4 * e + 3]);
+			if(Math.max(sx + edge_strength, tx) < x0 || Math.min(sx, tx - edge_strength) > x1 || Math.max(sy, ty) < y0 || Math.min(sy, ty) > y1)
+				return;
+			var path = paths[edge_levels[e]] || (paths[edge_levels[e]] = new Path2D());
+			path.moveTo(sx, sy);
+			if(curves) path.bezierCurveTo(sx + edge_strength, sy, tx - edge_strength, ty, tx, ty);
+			else path.lineTo(tx, ty);
+		};
+		if(grids) grids.edges(x0, y0, x1, y1, add_edge);
+		else for(var e = 0; e < edge_count; e++) add_edge(e);
+		paths.forEach(function(path, l)
+		{
+			if(!path) return;
+			context.strokeStyle = edge_colors[l];
+			context.lineWidth = Math.max(edge_widths[l], 1 / view_scale);
+			context.stroke(path);
+		});
+
+		// Boxes, filled by colour then stroked together
+		var boxes = node_colors.map(() => null), outlines = new Path2D();
+		for(var k = 0; k < visible_count; k++)
+		{
+			var i = visible[k], box = boxes[node_levels[i]] || (boxes[node_levels[i]] = new Path2D());
+			box.rect(p[2 * i], p[2 * i + 1], node_width, heights[i]);
+			outlines.rect(p[2 * i], p[2 * i + 1], node_width, heights[i]);
+		}
+		boxes.forEach(function(box, l)
+		{
+			if(!box) return;
+			context.fillStyle = node_colors[l];
+			context.fill(box);
+		});
+		context.strokeStyle = '#555';
+		context.lineWidth = Math.max(3, 1 / view_scale);
+		context.stroke(outlines);
+		if(view_scale < detail_scale) return;
+
+		// Details: separators, slots, then text
+		var separators = new Path2D(), slots = new Path2D();
+		for(var k = 0; k < visible_count; k++)
+		{
+			var i = visible[k], x = p[2 * i], y = p[2 * i + 1];
+			separators.moveTo(x + slot_radius, y + title_height);
+			separators.lineTo(x + node_width - slot_radius, y + title_height);
+			for(var s = 0; s < input_counts[i]; s++)
+			{
+				slots.moveTo(x + slot_radius, slot_y(i, s));
+				slots.arc(x, slot_y(i, s), slot_radius, 0, 2 * Math.PI);
+			}
+			for(var s = 0; s < output_counts[i]; s++)
+			{
+				slots.moveTo(x + node_width + slot_radius, slot_y(i, s));
+				slots.arc(x + node_width, slot_y(i, s), slot_radius, 0, 2 * Math.PI);
+			}
+		}
+		context.lineWidth = 3;
+		context.setLineDash([(node_width - 2 * slot_radius) / (2 * separator_count - 1)]);
+		context.stroke(separators);
+		context.setLineDash([]);
+		context.fillStyle = '#555';
+		context.strokeStyle = '#fff';
+		context.fill(slots);
+		context.stroke(slots);
+
+		context.font = '16px Verdana';
+		context.textBaseline = 'middle';
+		for(var k = 0; k < visible_count; k++)
+		{
+			var i = visible[k], node = graph.nodes[i], x = p[2 * i], y = p[2 * i + 1];
+			context.textAlign = 'center';
+			context.fillText(node.name, x + node_width / 2, y + title_height / 2);
+			context.textAlign = 'start';
+			for(var s = 0; s < input_counts[i]; s++) context.fillText(node.inputs[s], x + 2 * slot_radius, slot_y(i, s));
+			context.textAlign = 'end';
+			for(var s = 0; s < output_counts[i]; s++) context.fillText(node.outputs[s], x + node_width - 2 * slot_radius, slot_y(i, s));
+		}
+	}
+
+	resize();
+	moved();
+	return {
+		stop: function()
+		{
+			cancelAnimationFrame(frame);
+			clearTimeout(index_timer);
+			worker.terminate();
+			URL.revokeObjectURL(script);
+			window.removeEventListener('resize', resize);
+			stop_drag();
+			canvas.remove();
+			svg.style.display = '';
+			if(legend) legend.remove();
+		}
+	};
+}
+
+// Boxes (x0, y0, x1, y1 in a flat array) overlapping a region, without looking at the others:
+// loose grids of growing cells, a box being in the first grid whose cells are as big as it, in the
+// cell of its top-left corner. A region then only looks at the cells it overlaps once grown by a
+// cell. Returns a function(x0, y0, x1, y1, f) calling f(index) for each box in the region.
+function box_grid(boxes)
+{
+	var count = boxes.length / 4, x_min = Infinity, y_min = Infinity, x_max = -Infinity, y_max = -Infinity;
+	for(var i = 0; i < count; i++)
+	{
+		x_min = Math.min(x_min, boxes[4 * i]);
+		y_min = Math.min(y_min, boxes[4 * i + 1]);
+		x_max = Math.max(x_max, boxes[4 * i]);
+		y_max = Math.max(y_max, boxes[4 * i + 1]);
+	}
+	// About one box per cell in the first grid
+	var base = Math.max(64, Math.sqrt((x_max - x_min + 1) * (y_max - y_min + 1) / Math.max(count, 1)));
+	var levels = [], level_of = new Uint8Array(count), cell_of = new Uint32Array(count);
+	for(var i = 0; i < count; i++)
+	{
+		var size = Math.max(boxes[4 * i + 2] - boxes[4 * i], boxes[4 * i + 3] - boxes[4 * i + 1]), l = 0, cell = base;
+		for(; cell < size; cell *= 2) l++;
+		for(; levels.length <= l; )
+		{
+			var c = base * 2 ** levels.length, columns = Math.floor((x_max - x_min) / c) + 1, rows = Math.floor((y_max - y_min) / c) + 1;
+			levels.push({ cell: c, columns: columns, rows: rows, offsets: new Uint32Array(columns * rows + 1), items: null });
+		}
+		var g = levels[l];
+		level_of[i] = l;
+		cell_of[i] = Math.floor((boxes[4 * i + 1] - y_min) / cell) * g.columns + Math.floor((boxes[4 * i] - x_min) / cell);
+		g.offsets[cell_of[i] + 1]++;
+	}
+	levels.forEach(function(g)
+	{
+		for(var c = 0; c < g.columns * g.rows; c++) g.offsets[c + 1] += g.offsets[c];
+		g.items = new Uint32Array(g.offsets[g.columns * g.rows]);
+	});
+	var cursors = levels.map(g => g.offsets.slice(0, g.columns * g.rows));
+	for(var i = 0; i < count; i++) levels[level_of[i]].items[cursors[level_of[i]][cell_of[i]]++] = i;
+
+	return function(x0, y0, x1, y1, f)
+	{
+		levels.forEach(function(g)
+		{
+			var c0 = Math.max(0, Math.floor((x0 - g.cell - x_min) / g.cell)), c1 = Math.min(g.columns - 1, Math.floor((x1 - x_min) / g.cell));
+			var r0 = Math.max(0, Math.floor((y0 - g.cell - y_min) / g.cell)), r1 = Math.min(g.rows - 1, Math.floor((y1 - y_min) / g.cell));
+			for(var r = r0; r <= r1; r++)
+				for(var k = g.offsets[r * g.columns + c0], end = g.offsets[r * g.columns + c1 + 1]; k < end; k++)
+				{
+					var i = g.items[k];
+					if(boxes[4 * i] <= x1 && boxes[4 * i + 2] >= x0 && boxes[4 * i + 1] <= y1 && boxes[4 * i + 3] >= y0) f(i);
+				}
+		});
+	};
+}
+
+// Body of the web worker of flow_graph_canvas, run with bbox_collisions: the same simulation as
+// the svg renderer, over nodes made from the positions and boxes (relative to the positions)
+// first received. Then receives the nodes being dragged ({ drag, x, y }, or { drag, release }),
+// and sends the positions after each step.
+function flow_graph_simulation(scope)
+{
+	'use strict';
+
+	var alpha = 1;
+	var alphaMin = 0.001;
+	var alphaDecay = 1 - Math.pow(alphaMin, 1 / 300);
+	var alphaTarget = 0;
+	var velocityDecay = 0.6;
+	var deltaTime = 20;
+	var timer = 0;
+
+	var nodes = [], bbox = bbox_collisions(d => d.box);
+	scope.onmessage = function(e)
+	{
+		var m = e.data;
+		if(m.positions)
+		{
+			for(var i = 0; i < m.positions.length / 2; i++)
+				nodes.push({ x: m.positions[2 * i], y: m.positions[2 * i + 1], vx: 0, vy: 0, drag: false,
+					box: [[m.boxes[4 * i], m.boxes[4 * i + 1]], [m.boxes[4 * i + 2], m.boxes[4 * i + 3]]] });
+			bbox.initialize(nodes);
+			return start(0);
+		}
+		var n = nodes[m.drag];
+		n.drag = !m.release;
+		if(n.drag)
+		{
+			n.x = m.x;
+			n.y = m.y;
+		}
+		start(n.drag ? 0.3 : 0);
+	};
+
+	function stop() { clearInterval(timer); timer = 0; }
+	function step()
+	{
+		alpha += (alphaTarget - alpha) * alphaDecay;
+		bbox(alpha);
+		var positions = new Float32Array(2 * nodes.length);
+		nodes.forEach(function(n, i)
+		{
+			if(n.drag) n.vx = n.vy = 0;
+			else
+			{
+				n.x += n.vx *= velocityDecay;
+				n.y += n.vy *= velocityDecay;
+			}
+			positions[2 * i] = n.x;
+			positions[2 * i + 1] = n.y;
+		});
+		scope.postMessage(positions, [positions.buffer]);
+		if(alpha < alphaMin) stop();
+	}
+	function start(a) { alphaTarget = a; if(!timer) timer = setInterval(step, deltaTime); }
+}
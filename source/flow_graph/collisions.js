@@ -29,58 +29,78 @@ function bbox_collisions(bbox)
 {
 	'use strict';
 
+	// Candidate pairs come from a uniform grid (same broad-phase as overlap_grid in flow_graph.h),
+	// each pair being tested only in the cell that holds the corner of their intersection
 	var nodes, boxes, strength = 10;
+	var cell_w = 1, cell_h = 1, origin_x = 0, origin_y = 0, cells = new Map();
+	function cell_x(x) { return Math.floor((x - origin_x) / cell_w); }
+	function cell_y(y) { return Math.floor((y - origin_y) / cell_h); }
 	function force()
 	{
-		for(var i = 0; i < boxes.length; i++)
-			for(var j = i + 1; j < boxes.length; j++)
-			{
-				var bA = [
-					[nodes[i].x + boxes[i][0][0], nodes[i].y + boxes[i][0][1]],
-					[nodes[i].x + boxes[i][1][0], nodes[i].y + boxes[i][1][1]]
-				];
-				var bB = [
-					[nodes[j].x + boxes[j][0][0], nodes[j].y + boxes[j][0][1]],
-					[nodes[j].x + boxes[j][1][0], nodes[j].y + boxes[j][1][1]]
-				];
-				var cf = collision_force(bA, bB);
-				nodes[i].vx += strength * cf.fA[0];
-				nodes[i].vy += strength * cf.fA[1];
-				nodes[j].vx += strength * cf.fB[0];
-				nodes[j].vy += strength * cf.fB[1];
-			}
+		var n = nodes.length;
+		if(n < 2) return;
+		origin_x = Infinity;
+		origin_y = Infinity;
+		for(var i = 0; i < n; i++)
+		{
+			origin_x = Math.min(origin_x, nodes[i].x + boxes[i][0][0]);
+			origin_y = Math.min(origin_y, nodes[i].y + boxes[i][0][1]);
+		}
+		cells.clear();
+		for(var i = 0; i < n; i++)
+		{
+			var x0 = cell_x(nodes[i].x + boxes[i][0][0]), x1 = cell_x(nodes[i].x + boxes[i][1][0]);
+			var y0 = cell_y(nodes[i].y + boxes[i][0][1]), y1 = cell_y(nodes[i].y + boxes[i][1][1]);
+			for(var cx = x0; cx <= x1; cx++)
+				for(var cy = y0; cy <= y1; cy++)
+				{
+					var key = cx * 1048576 + cy, cell = cells.get(key);
+					if(cell) cell.push(i);
+					else cells.set(key, [i]);
+				}
+		}
+		for(var [key, cell] of cells)
+			for(var a = 0; a < cell.length; a++)
+				for(var b = a + 1; b < cell.length; b++)
+					collide(cell[a], cell[b], key);
 	}
-	function collision_force(bA, bB)
+	function collide(i, j, key)
 	{
-		var left   = bB[1][0] - bA[0][0];
-		var right  = bA[1][0] - bB[0][0];
-		var top    = bB[1][1] - bA[0][1];
-		var bottom = bA[1][1] - bB[0][1];
-		var intersectX = (left > 0 && right > 0);
-		var intersectY = (top > 0 && bottom > 0);
-		if(intersectX && intersectY)
+		var A = nodes[i], B = nodes[j], bA = boxes[i], bB = boxes[j];
+		var ax0 = A.x + bA[0][0], ay0 = A.y + bA[0][1], ax1 = A.x + bA[1][0], ay1 = A.y + bA[1][1];
+		var bx0 = B.x + bB[0][0], by0 = B.y + bB[0][1], bx1 = B.x + bB[1][0], by1 = B.y + bB[1][1];
+		var left   = bx1 - ax0;
+		var right  = ax1 - bx0;
+		var top    = by1 - ay0;
+		var bottom = ay1 - by0;
+		if(left <= 0 || right <= 0 || top <= 0 || bottom <= 0) return;
+		if(cell_x(Math.max(ax0, bx0)) * 1048576 + cell_y(Math.max(ay0, by0)) !== key) return;
+
+		var dX = left > right ? right : -left;
+		var dY = top > bottom ? bottom : -top;
+		if(Math.abs(dX) <= Math.abs(dY))
 		{
-			var dX = left > right ? right : -left;
-			var dY = top > bottom ? bottom : -top;
-			if(Math.abs(dX) <= Math.abs(dY))
-			{
-				var wA = bA[1][0] - bA[0][0];
-				var wB = bB[1][0] - bB[0][0];
-				return { fA: [-dX / wA, 0], fB: [dX / wB, 0] };
-			}
-			else
-			{
-				var hA = bA[1][1] - bA[0][1];
-				var hB = bB[1][1] - bB[0][1];
-				return { fA: [0, -dY / hA], fB: [0, dY / hB] };
-			}
+			A.vx -= strength * dX / (ax1 - ax0);
+			B.vx += strength * dX / (bx1 - bx0);
+		}
+		else
+		{
+			A.vy -= strength * dY / (ay1 - ay0);
+			B.vy += strength * dY / (by1 - by0);
 		}
-		return { fA: [0, 0], fB: [0, 0] };
 	}
 	force.initialize = function(_)
 	{
 		var i, n = (nodes = _).length; boxes = new Array(n);
 		for(i = 0; i < n; ++i) boxes[i] = bbox(nodes[i], i, nodes);
+		var w = 0, h = 0;
+		for(var b of boxes)
+		{
+			w = Math.max(w, b[1][0] - b[0][0]);
+			h += (b[1][1] - b[0][1]) / n;
+		}
+		cell_w = w || 1;
+		cell_h = h || 1;
 	};
 	return force;
-}
+}
\ No newline at end of file
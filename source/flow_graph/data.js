@@ -0,0 +1,209 @@
+// BSD 3-Clause Licence //////////////////////////////////////////////////////////////////////// //
+// Copyright (c) 2017 Thibault Lescoat, All rights reserved.                                     //
+//                                                                                               //
+// Redistribution and use in source and binary forms, with or without modification, are          //
+// permitted provided that the following conditions are met:                                     //
+//                                                                                               //
+// * Redistributions of source code must retain the above copyright notice, this list of         //
+//   conditions and the following disclaimer.                                                    //
+//                                                                                               //
+// * Redistributions in binary form must reproduce the above copyright notice, this list of      //
+//   conditions and the following disclaimer in the documentation and/or other materials         //
+//   provided with the distribution.                                                             //
+//                                                                                               //
+// * Neither the name of the copyright holder nor the names of its contributors may be used to   //
+//   endorse or promote products derived from this software without specific prior written       //
+//   permission.                                                                                 //
+//                                                                                               //
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS   //
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF               //
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE    //
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,     //
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE //
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED    //
+// AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     //
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
+// Normalizes the graph given as a JavaScript object literal
+function flow_graph_data(data)
+{
+	'use strict';
+
+	if(data.connections instanceof Uint32Array) return data; // Already decoded from a payload
+	if(data.timeline) return data; // Differences between frames, applied by flow_graph_timeline
+
+	// Nodes added after the first connection (interleaved streaming) are stored with connections
+	var nodes = data.nodes, links = [];
+	for(var c of data.connections)
+		if(Array.isArray(c)) links.push(c);
+		else nodes.push(c);
+
+	// Endpoints are either indices or names (resolved once through maps)
+	var node_ids = null, slot_ids = new Map();
+	function node(n)
+	{
+		if(typeof n === 'number') return n < nodes.length ? n : -1;
+		if(!node_ids)
+		{
+			node_ids = new Map();
+			nodes.forEach((m, i) => { if(!node_ids.has(m.name)) node_ids.set(m.name, i); });
+		}
+		var i = node_ids.get(n);
+		return i === undefined ? -1 : i;
+	}
+	function slot(n, s, kind)
+	{
+		var slots = nodes[n][kind];
+		if(typeof s === 'number') return s < slots.length ? s : -1;
+		var ids = slot_ids.get(kind + n);
+		if(!ids)
+		{
+			ids = new Map();
+			slots.forEach((name, i) => { if(!ids.has(name)) ids.set(name, i); });
+			slot_ids.set(kind + n, ids);
+		}
+		var i = ids.get(s);
+		return i === undefined ? -1 : i;
+	}
+
+	// Connections: (out, out_slot, in, in_slot) for each edge, and their measures (time_ns, count,
+	// bytes; NaN when absent) if some have an object of measures as fifth element
+	var connections = new Uint32Array(4 * links.length), count = 0;
+	var edge_measures = links.some(c => c.length > 4) ? new Float64Array(3 * links.length).fill(NaN) : null;
+	for(var c of links)
+	{
+		var out = node(c[0]), in_ = node(c[2]);
+		if(out < 0 || in_ < 0) continue;
+		var out_slot = slot(out, c[1], 'outputs'), in_slot = slot(in_, c[3], 'inputs');
+		if(out_slot < 0 || in_slot < 0) continue;
+		connections[4 * count] = out;
+		connections[4 * count + 1] = out_slot;
+		connections[4 * count + 2] = in_;
+		connections[4 * count + 3] = in_slot;
+		if(edge_measures && c[4])
+			flow_graph_measures.forEach((m, k) => { if(m in c[4]) edge_measures[3 * count + k] = c[4][m]; });
+		count++;
+	}
+	return { nodes: nodes, connections: connections.subarray(0, 4 * count), layout: data.layout,
+		edge_measures: edge_measures && edge_measures.subarray(0, 3 * count),
+		clusters: data.clusters, cluster_parents: data.cluster_parents };
+}
+
+// Performance values of nodes (as fields) and edges (in graph.edge_measures), see flow_graph_measures
+var flow_graph_measures = ['time_ns', 'count', 'bytes'];
+
+// Decodes a base64 payload (maybe deflate-compressed, of json or binary data), returns a
+// promise of the normalized graph
+function flow_graph_unpack(text, payload, compression)
+{
+	'use strict';
+
+	var raw = atob(text.trim()), bytes = new Uint8Array(raw.length);
+	for(var i = 0; i < raw.length; i++) bytes[i] = raw.charCodeAt(i);
+	var decode = b => payload === 'binary' ? flow_graph_decode(b) : flow_graph_data(JSON.parse(new TextDecoder().decode(b)));
+	if(compression !== 'deflate')
+		return Promise.resolve(decode(bytes));
+	var inflated = new Blob([bytes]).stream().pipeThrough(new DecompressionStream('deflate'));
+	return new Response(inflated).arrayBuffer().then(b => decode(new Uint8Array(b)));
+}
+
+// Payload of an inert element of the page
+function flow_graph_load(element)
+{
+	'use strict';
+
+	return flow_graph_unpack(element.textContent, element.getAttribute('data-payload'), element.getAttribute('data-compression'));
+}
+
+// Decodes a binary payload (see detail::binary_payload in flow_graph.h) into the same structure
+// as flow_graph_data, without going through per-edge objects
+function flow_graph_decode(bytes)
+{
+	'use strict';
+
+	var header = new Uint32Array(bytes.buffer, bytes.byteOffset, 7);
+	if(header[0] !== 0x31475644) throw new Error('Invalid flow graph payload');
+	var node_count = header[1], slot_count = header[2], edge_count = header[3];
+	var string_count = header[4], string_bytes = header[5], has_layout = header[6] & 1;
+
+	var offset = 28;
+	function words(count, type)
+	{
+		var a = new (type || Uint32Array)(bytes.buffer, bytes.byteOffset + offset, count);
+		offset += 4 * count;
+		return a;
+	}
+	var names = words(node_count), slot_offsets = words(2 * node_count + 1), slots = words(slot_count);
+	var edges = words(4 * edge_count), string_offsets = words(string_count + 1);
+	var layout = has_layout ? words(2 * node_count, Int32Array) : undefined;
+	var node_measures = null, edge_values = null, groups = null, clusters, cluster_parents;
+	if(header[6] & 2)
+	{
+		node_measures = words(3 * node_count, Float32Array);
+		edge_values = words(3 * edge_count, Float32Array);
+	}
+	if(header[6] & 4) groups = words(node_count);
+	if(header[6] & 8)
+	{
+		var cluster_count = words(1)[0];
+		clusters = words(node_count);
+		cluster_parents = words(cluster_count);
+	}
+	var decoder = new TextDecoder(), strings = new Array(string_count);
+	for(var i = 0; i < string_count; i++)
+		strings[i] = decoder.decode(bytes.subarray(offset + string_offsets[i], offset + string_offsets[i + 1]));
+
+	var nodes = new Array(node_count);
+	for(var i = 0; i < node_count; i++)
+	{
+		var inputs = [], outputs = [];
+		for(var s = slot_offsets[2 * i]; s < slot_offsets[2 * i + 1]; s++) inputs.push(strings[slots[s]]);
+		for(var s = slot_offsets[2 * i + 1]; s < slot_offsets[2 * i + 2]; s++) outputs.push(strings[slots[s]]);
+		nodes[i] = { name: strings[names[i]], inputs: inputs, outputs: outputs };
+		if(groups && groups[i] !== 0xFFFFFFFF) nodes[i].group = strings[groups[i]];
+		if(node_measures)
+			flow_graph_measures.forEach((m, k) => { if(!isNaN(node_measures[3 * i + k])) nodes[i][m] = node_measures[3 * i + k]; });
+	}
+
+	// Endpoints with the high bit set are string ids of names (strings are stored once, so
+	// names are matched by id)
+	var node_ids = null;
+	function node(v)
+	{
+		if(v < 0x80000000) return v < node_count ? v : -1;
+		if(!node_ids)
+		{
+			node_ids = new Map();
+			for(var i = node_count - 1; i >= 0; i--) node_ids.set(names[i], i);
+		}
+		var i = node_ids.get(v - 0x80000000);
+		return i === undefined ? -1 : i;
+	}
+	function slot(v, first, last)
+	{
+		if(v < 0x80000000) return v < last - first ? v : -1;
+		for(var s = first; s < last; s++)
+			if(slots[s] === v - 0x80000000) return s - first;
+		return -1;
+	}
+
+	var connections = new Uint32Array(4 * edge_count), count = 0;
+	var edge_measures = edge_values ? new Float32Array(3 * edge_count) : null;
+	for(var e = 0; e < 4 * edge_count; e += 4)
+	{
+		var out = node(edges[e]), in_ = node(edges[e + 2]);
+		if(out < 0 || in_ < 0) continue;
+		var out_slot = slot(edges[e + 1], slot_offsets[2 * out + 1], slot_offsets[2 * out + 2]);
+		var in_slot = slot(edges[e + 3], slot_offsets[2 * in_], slot_offsets[2 * in_ + 1]);
+		if(out_slot < 0 || in_slot < 0) continue;
+		connections[4 * count] = out;
+		connections[4 * count + 1] = out_slot;
+		connections[4 * count + 2] = in_;
+		connections[4 * count + 3] = in_slot;
+		if(edge_measures) edge_measures.set(edge_values.subarray(3 * e / 4, 3 * e / 4 + 3), 3 * count);
+		count++;
+	}
+	return { nodes: nodes, connections: connections.subarray(0, 4 * count), layout: layout,
+		edge_measures: edge_measures && edge_measures.subarray(0, 3 * count),
+		clusters: clusters, cluster_parents: cluster_parents };
+}
@@ -28,10 +28,207 @@
 #pragma once
 
 #include <iostream>
+#include <limits>
+#include <string>
+
+namespace debugviz
+{
+	/// Encoding of the graph in the html page
+	enum class flow_graph_payload
+	{
+		/// JavaScript object literal, written as nodes and connections are added
+		json,
+		/// Typed arrays (string table, slot offsets, edge endpoints) in an inert base64 block,
+		/// that the viewer decodes without parsing a big literal. Written by finish().
+		binary
+	};
+
+	/// Compression of the graph in the html page
+	enum class flow_graph_compression
+	{
+		none,
+		/// Deflate, then base64 in an inert element; inflated by the viewer with the browser's
+		/// DecompressionStream. Uses zlib when DEBUGVIZ_USE_ZLIB is defined (then link with it),
+		/// a built-in encoder otherwise.
+		deflate
+	};
+
+	/// Output of write_flow_graph and flow_graph_writer
+	enum class flow_graph_document
+	{
+		/// Self-contained html page, with the viewer
+		page,
+		/// Graph only, as a script to be loaded by a viewer page (see write_flow_graph_viewer)
+		script,
+		/// Graph only, as json to be loaded by a viewer page
+		json
+	};
+
+	/// Drawing of the graph by the viewer
+	enum class flow_graph_renderer
+	{
+		/// Svg elements, for the nodes and edges in the view (big graphs are shown as clusters
+		/// when zoomed out)
+		svg,
+		/// Html canvas, redrawn at each frame from flat arrays, with a simulation running in a web
+		/// worker: stays fluid with tens of thousands of nodes. Timelines are drawn with svg.
+		canvas
+	};
+
+	/// Options of write_flow_graph and flow_graph_writer
+	struct flow_graph_options
+	{
+		flow_graph_payload payload = flow_graph_payload::json;
+		flow_graph_compression compression = flow_graph_compression::none;
+		flow_graph_document document = flow_graph_document::page;
+		/// Threads formatting the graph in write_flow_graph, 0 for one per core. Only used with
+		/// random-access ranges (like std::vector), for json payloads without compression, and
+		/// for big enough graphs; the output is the same as with one thread.
+		unsigned threads = 1;
+		/// Graphs with more nodes than this, none of them having a group, are split into clusters
+		/// of connected nodes (see flow_graph_layout::compute_clusters), that the viewer shows
+		/// collapsed when zoomed out.
+		size_t cluster_threshold = 2000;
+		/// Drawing of the graph, for pages and data files
+		flow_graph_renderer renderer = flow_graph_renderer::svg;
+		/// Positions of the nodes computed by write_flow_graph (see flow_graph_layout). When false,
+		/// the viewer lays the graph out when opening it, which is slower for big graphs and shows
+		/// no clusters, but writing is then only formatting, done by all the threads.
+		bool layout = true;
+		/// File keeping the layout between calls of write_flow_graph (see flow_graph_layout_cache),
+		/// so that nodes which did not change keep their position and are not laid out again.
+		/// Nodes are identified by their name. Not used if empty. If the file cannot be written,
+		/// the graph is still written (see flow_graph_write_status).
+		std::string layout_cache = std::string();
+	};
+
+	/// Outcome of write_flow_graph that is not the state of the stream
+	struct flow_graph_write_status
+	{
+		/// False if flow_graph_options::layout_cache was given but could not be written
+		bool layout_cache_saved = true;
+	};
+
+	/// Optional performance values of a node or connection, shown by the viewer as a heat overlay
+	/** NaN values are not written. write_flow_graph takes them from the 'time_ns', 'count' and
+		'bytes' fields of nodes and connections (of any arithmetic type), for those that have them.
+	*/
+	struct flow_graph_measures
+	{
+		double time_ns = std::numeric_limits<double>::quiet_NaN();
+		double count = std::numeric_limits<double>::quiet_NaN();
+		double bytes = std::numeric_limits<double>::quiet_NaN();
+
+		bool empty() const { return time_ns != time_ns && count != count && bytes != bytes; }
+	};
+
+	/// Outcome of a dump queued on a flow_graph_async_writer
+	enum class flow_graph_dump_result
+	{
+		/// The file was written (even if flow_graph_options::layout_cache could not be)
+		written,
+		/// The file could not be opened or written
+		failed,
+		/// Replaced, before it started, by a later dump into the same file
+		coalesced,
+		/// Discarded, before it started, because too many dumps were waiting
+		dropped
+	};
+
+namespace detail
+{
+	// Sizes of the elements of a node in the viewer (keep in sync with render.js)
+	struct flow_graph_metrics
+	{
+		static constexpr float node_width = 170;
+		static constexpr float node_padding = 10;
+		static constexpr float slot_height = 40;
+		static constexpr float slot_radius = 10;
+		static constexpr float title_height = 40;
+		static constexpr float separator_height = 10;
+
+		static float node_height(size_t inputs, size_t outputs)
+		{
+			return title_height + separator_height + slot_height * float(inputs > outputs ? inputs : outputs);
+		}
+	};
+}
+}
 
 #ifndef DEBUGVIZ_NO_FLOW_GRAPH
 
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <iterator>
+#include <sstream>
+#include <streambuf>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#if defined(DEBUGVIZ_USE_ZLIB)
+	#include <zlib.h>
+#endif
+#if !defined(DEBUGVIZ_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define DEBUGVIZ_SSE2 1
+#else
+	#define DEBUGVIZ_SSE2 0
+#endif
+#if !defined(DEBUGVIZ_NO_SIMD) && defined(__AVX2__)
+	#include <immintrin.h>
+	#define DEBUGVIZ_AVX2 1
+#else
+	#define DEBUGVIZ_AVX2 0
+#endif
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <cerrno>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+#if __cplusplus >= 201703L && defined(__has_include)
+	#if __has_include(<charconv>)
+		#include <charconv>
+		#define DEBUGVIZ_TO_CHARS 1
+	#endif
+#endif
+#if !defined(DEBUGVIZ_TO_CHARS)
+	#define DEBUGVIZ_TO_CHARS 0
+#endif
+// With DEBUGVIZ_SEPARATE, write_flow_graph and flow_graph_arena::write only copy the graph and
+// call a writer compiled once, with the html of the viewer: in the source file that defines
+// DEBUGVIZ_IMPLEMENTATION before including this header (which implies DEBUGVIZ_SEPARATE).
+#if defined(DEBUGVIZ_IMPLEMENTATION) && !defined(DEBUGVIZ_SEPARATE)
+	#define DEBUGVIZ_SEPARATE
+#endif
+#if DEBUGVIZ_TO_CHARS && defined(__cpp_lib_to_chars)
+	#define DEBUGVIZ_TO_CHARS_FLOAT 1
+#else
+	#define DEBUGVIZ_TO_CHARS_FLOAT 0
+#endif
 
 namespace debugviz
 {
@@ -47,132 +244,5157 @@ namespace detail
 	struct is_streamable<S, T, void_t<decltype(std::declval<S&>() << std::declval<no_cvref<T>>())>>
 		: std::true_type {};
 
-	template<class S, class T> using streamable_name     = is_streamable<S, decltype(no_cvref<T>::name)>;
-	template<class S, class T> using streamable_out      = is_streamable<S, decltype(no_cvref<T>::out)>;
-	template<class S, class T> using streamable_out_slot = is_streamable<S, decltype(no_cvref<T>::out_slot)>;
-	template<class S, class T> using streamable_in       = is_streamable<S, decltype(no_cvref<T>::in)>;
-	template<class S, class T> using streamable_in_slot  = is_streamable<S, decltype(no_cvref<T>::in_slot)>;
-}
+	// Fields are either formatted by write_text (through a std::ostream) or streamed directly
+	template<typename S, typename T> struct is_writable : std::integral_constant<bool,
+		is_streamable<std::ostream, T>::value || is_streamable<S, T>::value> {};
 
-	/// Outputs a html page to visualize a flow graph
-	/** This function serialize a flow graph into a stream, as an html page that can be viewed on a
-		standard web browser (it does not need Internet connectivity, as all needed scripts/CSS are
-		fully included in the html). Please bear in mind that no html escaping will be done!
+	template<class S, class T> using streamable_name     = is_writable<S, decltype(no_cvref<T>::name)>;
+	template<class S, class T> using streamable_out      = is_writable<S, decltype(no_cvref<T>::out)>;
+	template<class S, class T> using streamable_out_slot = is_writable<S, decltype(no_cvref<T>::out_slot)>;
+	template<class S, class T> using streamable_in       = is_writable<S, decltype(no_cvref<T>::in)>;
+	template<class S, class T> using streamable_in_slot  = is_writable<S, decltype(no_cvref<T>::in_slot)>;
 
-		A flow graph is a graph where nodes possess *input* and *output* ports (or slots), which
-		are used as endpoints for the edges of the graph. Connections can only go from an output
-		slot to an input slot, and can be viewed as "data comes out of a specific node at some port
-		and is fed into the specified input of another node".
+	// Integral connection fields are indices (into the nodes range, or into the slots of a node)
+	template<typename T> struct is_index : std::integral_constant<bool, std::is_integral<no_cvref<T>>::value
+		&& !std::is_same<no_cvref<T>, bool>::value && !std::is_same<no_cvref<T>, char>::value> {};
 
-		In the following by 'range' we mean a type that can be iterated using a
-		range-based for loop, and by 'streamable' we mean a type that can be serialized into the
-		given stream.
+	template<class C> using index_out      = is_index<decltype(no_cvref<C>::out)>;
+	template<class C> using index_out_slot = is_index<decltype(no_cvref<C>::out_slot)>;
+	template<class C> using index_in       = is_index<decltype(no_cvref<C>::in)>;
+	template<class C> using index_in_slot  = is_index<decltype(no_cvref<C>::in_slot)>;
 
-		\note for std::ostream, there exist a wrapper so you can stream a flow graph as usual:
-		`stream << bdgviz::flow_graph(title, nodes, connections);`.
+	// Optional performance fields of nodes and connections
+	template<typename T, typename = void> struct has_time_ns : std::false_type {};
+	template<typename T> struct has_time_ns<T, void_t<decltype(no_cvref<T>::time_ns)>>
+		: std::is_arithmetic<no_cvref<decltype(no_cvref<T>::time_ns)>> {};
+	template<typename T, typename = void> struct has_count : std::false_type {};
+	template<typename T> struct has_count<T, void_t<decltype(no_cvref<T>::count)>>
+		: std::is_arithmetic<no_cvref<decltype(no_cvref<T>::count)>> {};
+	template<typename T, typename = void> struct has_bytes : std::false_type {};
+	template<typename T> struct has_bytes<T, void_t<decltype(no_cvref<T>::bytes)>>
+		: std::is_arithmetic<no_cvref<decltype(no_cvref<T>::bytes)>> {};
 
-		\param stream The stream in which to serialize the flow graph html visualization
-		\param title Title of the html page (must be streamable)
-		\param nodes Nodes of the graph. This structure must be a range, and elements must have:
-			- a 'name' field, streamable
-			- an 'inputs' field, range of streamables
-			- an 'outputs' field, range of streamables
-		\param connections Links between nodes in the graph. This must be a range, and its elements
-			must have four streamable fields: 'out', 'out_slot', 'in', 'in_slot'
-		\return The given stream
-	*/
-	template<typename S, typename T, typename N, typename C>
-	S& write_flow_graph(S& stream, const T& title, const N& nodes, const C& connections)
+	template<typename T> double time_ns_of(const T& v, std::true_type) { return double(v.time_ns); }
+	template<typename T> double count_of(const T& v, std::true_type) { return double(v.count); }
+	template<typename T> double bytes_of(const T& v, std::true_type) { return double(v.bytes); }
+	template<typename T> double time_ns_of(const T&, std::false_type) { return std::numeric_limits<double>::quiet_NaN(); }
+	template<typename T> double count_of(const T&, std::false_type) { return std::numeric_limits<double>::quiet_NaN(); }
+	template<typename T> double bytes_of(const T&, std::false_type) { return std::numeric_limits<double>::quiet_NaN(); }
+
+	template<typename T> using has_measures = std::integral_constant<bool,
+		has_time_ns<T>::value || has_count<T>::value || has_bytes<T>::value>;
+
+	// Optional group of nodes, shown together by the viewer
+	template<typename T, typename = void> struct has_group : std::false_type {};
+	template<typename T> struct has_group<T, void_t<decltype(no_cvref<T>::group)>>
+		: is_streamable<std::ostream, decltype(no_cvref<T>::group)> {};
+
+	template<typename T>
+	flow_graph_measures measures_of(const T& v)
+	{
+		flow_graph_measures m;
+		m.time_ns = time_ns_of(v, has_time_ns<T>());
+		m.count = count_of(v, has_count<T>());
+		m.bytes = bytes_of(v, has_bytes<T>());
+		return m;
+	}
+
+	template<unsigned N> struct rank : rank<N - 1> {};
+	template<> struct rank<0> {};
+
+	// Streams with a 'write(const char*, n)' member (like std::ostream) get whole buffers at once
+	template<typename S, typename = void>
+	struct has_write : std::false_type {};
+	template<typename S>
+	struct has_write<S, void_t<decltype(std::declval<S&>().write(std::declval<const char*>(), std::streamsize()))>>
+		: std::true_type {};
+
+	template<typename S>
+	void put(S& stream, const char* s, size_t n, std::true_type) { stream.write(s, std::streamsize(n)); }
+	template<typename S>
+	void put(S& stream, const char* s, size_t n, std::false_type)
 	{
-		auto structure = [&]()
+		char chunk[1024];
+		while(n)
 		{
-			stream << "nodes: [";
-			for(const auto& n : nodes)
-			{
-				static_assert(detail::streamable_name<S, decltype(n)>::value,
-					"Nodes must have a 'name' field that supports 'stream << node.name'");
+			const size_t k = std::min(n, sizeof(chunk) - 1);
+			std::memcpy(chunk, s, k);
+			chunk[k] = 0;
+			stream << static_cast<const char*>(chunk);
+			s += k;
+			n -= k;
+		}
+	}
+	template<typename S>
+	void put(S& stream, const char* s, size_t n) { put(stream, s, n, has_write<S>()); }
+	template<typename S>
+	void flush_into(void* stream, const char* s, size_t n) { put(*static_cast<S*>(stream), s, n); }
+
+	// Fixed-size output buffer, flushed into a stream through a callback
+	class text_buffer
+	{
+	public:
+		using flush_function = void (*)(void*, const char*, size_t);
 
-				stream << "{ name: \"" << n.name << "\", inputs: [";
-				for(const auto& s : n.inputs)
+		text_buffer(size_t capacity, flush_function flush_to, void* target) :
+			data(new char[capacity]), capacity(capacity), flush_to(flush_to), target(target) {}
+		text_buffer(const text_buffer&) = delete;
+		text_buffer& operator=(const text_buffer&) = delete;
+
+		void write(const char* s, size_t n)
+		{
+			if(n > capacity - size)
+			{
+				flush();
+				if(n >= capacity)
 				{
-					static_assert(detail::is_streamable<S, decltype(s)>::value,
-						"Node inputs slots must support 'stream << slot'");
-					stream << "\"" << s << "\",";
+					flush_to(target, s, n);
+					return;
 				}
-				stream << "], outputs: [";
-				for(const auto& s : n.outputs)
+			}
+			std::memcpy(data.get() + size, s, n);
+			size += n;
+		}
+		void write(char c)
+		{
+			if(size == capacity) flush();
+			data[size++] = c;
+		}
+		template<size_t N>
+		void literal(const char (&s)[N]) { write(s, N - 1); }
+		void flush()
+		{
+			if(size) flush_to(target, data.get(), size);
+			size = 0;
+		}
+
+	private:
+		std::unique_ptr<char[]> data;
+		size_t capacity, size = 0;
+		flush_function flush_to;
+		void* target;
+	};
+}
+
+	/// Growable contiguous output buffer, that can be flushed into a file descriptor
+	/** An alternative to std::ostream for write_flow_graph and flow_graph_writer, which write
+		directly into its storage instead of going through a buffer of their own. This only saves
+		a copy: serializing a big graph without layout is 10 to 20% faster than into a
+		std::ofstream (see test/bench_sink.cpp), and the layout, when computed, hides the difference.
+
+		Without file descriptor, the buffer just grows and data()/size() give its content. With a
+		file descriptor, the content is written with large write() calls each time it reaches the
+		flush threshold (big pieces being passed along with writev(), without copying them), and
+		when the sink is flushed or destroyed.
+	*/
+	class buffer_sink
+	{
+	public:
+		explicit buffer_sink(int fd = -1, size_t flush_threshold = 1 << 20) :
+			fd(fd), threshold(std::max<size_t>(flush_threshold, 4096)) {}
+		buffer_sink(const buffer_sink&) = delete;
+		buffer_sink& operator=(const buffer_sink&) = delete;
+		~buffer_sink() { flush(); }
+
+		void write(const char* s, size_t n)
+		{
+			if(n > capacity - used) return overflow(s, n);
+			std::memcpy(storage.get() + used, s, n);
+			used += n;
+		}
+		void write(char c)
+		{
+			if(used == capacity) return overflow(&c, 1);
+			storage[used++] = c;
+		}
+		template<size_t N>
+		void literal(const char (&s)[N]) { write(s, N - 1); }
+
+		/// Writes the content into the file descriptor, if any
+		void flush()
+		{
+			if(fd >= 0 && used) write_fd(storage.get(), used, nullptr, 0);
+			if(fd >= 0) used = 0;
+		}
+
+		const char* data() const { return storage.get(); }
+		size_t size() const { return used; }
+		void clear() { used = 0; }
+		/// False if writing into the file descriptor failed
+		bool good() const { return !failed; }
+
+	private:
+		void overflow(const char* s, size_t n)
+		{
+			if(fd >= 0)
+			{
+				if(!capacity) reallocate(threshold);
+				if(n > capacity / 2)
 				{
-					static_assert(detail::is_streamable<S, decltype(s)>::value,
-						"Node outputs slots must support 'stream << slot'");
-					stream << "\"" << s << "\",";
+					write_fd(storage.get(), used, s, n);
+					used = 0;
+					return;
 				}
-				stream << "] },";
+				flush();
 			}
-			stream << "], connections: [";
-			for(const auto& c : connections)
+			else
+				reallocate(std::max(2 * capacity, std::max<size_t>(used + n, 4096)));
+			std::memcpy(storage.get() + used, s, n);
+			used += n;
+		}
+		void reallocate(size_t size)
+		{
+			std::unique_ptr<char[]> bigger(new char[size]);
+			if(used) std::memcpy(bigger.get(), storage.get(), used);
+			storage = std::move(bigger);
+			capacity = size;
+		}
+		void write_fd(const char* a, size_t na, const char* b, size_t nb)
+		{
+#if defined(_WIN32)
+			for(auto part : { std::make_pair(a, na), std::make_pair(b, nb) })
+				while(part.second && !failed)
+				{
+					const int w = _write(fd, part.first, unsigned(std::min<size_t>(part.second, 1 << 30)));
+					if(w <= 0) failed = true;
+					else { part.first += w; part.second -= size_t(w); }
+				}
+#else
+			iovec parts[2] = { { const_cast<char*>(a), na }, { const_cast<char*>(b), nb } };
+			iovec* part = parts;
+			int count = 2;
+			while(count && !failed)
 			{
-				static_assert(detail::streamable_out<S, decltype(c)>::value,
-					"Connections must have a 'out' field that supports 'stream << connection.out'");
-				static_assert(detail::streamable_out_slot<S, decltype(c)>::value,
-					"Connections must have a 'out_slot' field that supports 'stream << connection.out_slot'");
-				static_assert(detail::streamable_in<S, decltype(c)>::value,
-					"Connections must have a 'in' field that supports 'stream << connection.in'");
-				static_assert(detail::streamable_in_slot<S, decltype(c)>::value,
-					"Connections must have a 'in_slot' field that supports 'stream << connection.in_slot'");
-
-				stream << "{ out: \"" << c.out << "\", out_slot: \"" << c.out_slot
-					<< "\", in: \"" << c.in << "\", in_slot: \"" << c.in_slot << "\" },";
+				const ssize_t w = ::writev(fd, part, count);
+				if(w <= 0)
+				{
+					// Nothing written while some remains: an error, that would otherwise be retried forever
+					if(w == 0 || errno != EINTR) failed = true;
+					continue;
+				}
+				size_t done = size_t(w);
+				while(count && done >= part->iov_len)
+				{
+					done -= part->iov_len;
+					part++;
+					count--;
+				}
+				if(count)
+				{
+					part->iov_base = static_cast<char*>(part->iov_base) + done;
+					part->iov_len -= done;
+				}
 			}
-			stream << "]";
-		};
-
-%STREAM_PACKED_HTML%
+#endif
+		}
 
-		return stream;
-	}
+		std::unique_ptr<char[]> storage;
+		size_t capacity = 0, used = 0;
+		int fd;
+		size_t threshold;
+		bool failed = false;
+	};
 
 namespace detail
 {
-	template<typename T, typename N, typename C>
-	struct flow_graph_data
+	// Buffer of flow_graph_writer: a fixed-size buffer flushed into the stream, except for
+	// buffer_sink which is written directly
+	template<typename S>
+	class stream_buffer : public text_buffer
 	{
-		const T& title;
-		const N& nodes;
-		const C& connections;
+	public:
+		stream_buffer(S& stream, size_t capacity) : text_buffer(capacity, &flush_into<S>, &stream) {}
 	};
+	class sink_buffer
+	{
+	public:
+		sink_buffer(buffer_sink& sink, size_t) : sink(sink) {}
 
-	template<typename T, typename N, typename C>
-	std::ostream& operator<<(std::ostream& os, const flow_graph_data<T, N, C>& g)
+		void write(const char* s, size_t n) { sink.write(s, n); }
+		void write(char c) { sink.write(c); }
+		template<size_t N>
+		void literal(const char (&s)[N]) { sink.literal(s); }
+		void flush() { sink.flush(); }
+
+	private:
+		buffer_sink& sink;
+	};
+	template<typename S> struct buffer_of { using type = stream_buffer<S>; };
+	template<> struct buffer_of<buffer_sink> { using type = sink_buffer; };
+
+	// Finds the first character of a set in a string, 16 or 32 bytes at a time when possible
+	template<char... Chars> struct any_of_chars;
+	template<> struct any_of_chars<>
+	{
+		static bool match(unsigned char) { return false; }
+#if DEBUGVIZ_SSE2
+		static __m128i match(__m128i) { return _mm_setzero_si128(); }
+#endif
+#if DEBUGVIZ_AVX2
+		static __m256i match(__m256i) { return _mm256_setzero_si256(); }
+#endif
+	};
+	template<char C, char... Chars> struct any_of_chars<C, Chars...>
 	{
-		return write_flow_graph<std::ostream, T, N, C>(os, g.title, g.nodes, g.connections);
+		static bool match(unsigned char c) { return c == static_cast<unsigned char>(C) || any_of_chars<Chars...>::match(c); }
+#if DEBUGVIZ_SSE2
+		static __m128i match(__m128i v)
+		{
+			return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(C)), any_of_chars<Chars...>::match(v));
+		}
+#endif
+#if DEBUGVIZ_AVX2
+		static __m256i match(__m256i v)
+		{
+			return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(C)), any_of_chars<Chars...>::match(v));
+		}
+#endif
+	};
+	// Same, with control characters (< 0x20) included
+	template<char... Chars> struct control_or_chars
+	{
+		static bool match(unsigned char c) { return c < 0x20 || any_of_chars<Chars...>::match(c); }
+#if DEBUGVIZ_SSE2
+		static __m128i match(__m128i v)
+		{
+			const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+			return _mm_or_si128(control, any_of_chars<Chars...>::match(v));
+		}
+#endif
+#if DEBUGVIZ_AVX2
+		static __m256i match(__m256i v)
+		{
+			const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+			return _mm256_or_si256(control, any_of_chars<Chars...>::match(v));
+		}
+#endif
+	};
+
+	inline unsigned first_bit(unsigned mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long i;
+		_BitScanForward(&i, mask);
+		return unsigned(i);
+#else
+		return unsigned(__builtin_ctz(mask));
+#endif
 	}
-}
 
-	/// Convenience function for use with standard output streams
-	/** A wrapper on write_flow_graph for std::ostream allowing constructs like:
-		`std::cout << debugviz::flow_graph("Some title", nodes, connections);`.
-		\see write_flow_graph for a more complete explanation of the parameters. */
-	template<typename T, typename N, typename C>
-	detail::flow_graph_data<T, N, C> flow_graph(const T& title, const N& nodes, const C& connections)
+	template<typename Set>
+	size_t find_scalar(const char* s, size_t n)
 	{
-		return { title, nodes, connections };
+		for(size_t i = 0; i < n; i++)
+			if(Set::match(static_cast<unsigned char>(s[i]))) return i;
+		return n;
 	}
-}
+	template<typename Set>
+	size_t find(const char* s, size_t n)
+	{
+		size_t i = 0;
+#if DEBUGVIZ_AVX2
+		for(; i + 32 <= n; i += 32)
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+			const unsigned mask = unsigned(_mm256_movemask_epi8(Set::match(v)));
+			if(mask) return i + first_bit(mask);
+		}
+#endif
+#if DEBUGVIZ_SSE2
+		for(; i + 16 <= n; i += 16)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			const unsigned mask = unsigned(_mm_movemask_epi8(Set::match(v)));
+			if(mask) return i + first_bit(mask);
+		}
+#endif
+		return i + find_scalar<Set>(s + i, n - i);
+	}
+
+	// Escaping policies: clean runs are copied at once, only special characters are rewritten
+	struct no_escape
+	{
+		template<typename B>
+		static void write(B& b, const char* s, size_t n) { b.write(s, n); }
+	};
+	// For double-quoted strings in a script: JSON escapes, plus '<' so that names cannot close
+	// the script element (or open a comment)
+	struct json_escape
+	{
+		using special = control_or_chars<'"', '\\', '<'>;
+
+		template<typename B>
+		static void write(B& b, const char* s, size_t n)
+		{
+			for(size_t i = 0;;)
+			{
+				const size_t j = i + find<special>(s + i, n - i);
+				b.write(s + i, j - i);
+				if(j == n) return;
+				escape(b, static_cast<unsigned char>(s[j]));
+				i = j + 1;
+			}
+		}
+		template<typename B>
+		static void escape(B& b, unsigned char c)
+		{
+			switch(c)
+			{
+			case '"': b.literal("\\\""); break;
+			case '\\': b.literal("\\\\"); break;
+			case '\n': b.literal("\\n"); break;
+			case '\r': b.literal("\\r"); break;
+			case '\t': b.literal("\\t"); break;
+			default:
+				{
+					const char hex[] = "0123456789abcdef";
+					const char code[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+					b.write(code, sizeof(code));
+				}
+			}
+		}
+	};
+	// For html text (the title)
+	struct html_escape
+	{
+		using special = any_of_chars<'&', '<', '>', '"', '\''>;
+
+		template<typename B>
+		static void write(B& b, const char* s, size_t n)
+		{
+			for(size_t i = 0;;)
+			{
+				const size_t j = i + find<special>(s + i, n - i);
+				b.write(s + i, j - i);
+				if(j == n) return;
+				switch(s[j])
+				{
+				case '&': b.literal("&amp;"); break;
+				case '<': b.literal("&lt;"); break;
+				case '>': b.literal("&gt;"); break;
+				case '"': b.literal("&quot;"); break;
+				default: b.literal("&#39;"); break;
+				}
+				i = j + 1;
+			}
+		}
+	};
+
+	// Output stream buffer backed by a small local array, spilling into a string when needed
+	class local_streambuf : public std::streambuf
+	{
+	public:
+		local_streambuf() { setp(local, local + sizeof(local)); }
+
+		const char* data() { spill(); return spilled.empty() ? local : spilled.data(); }
+		size_t size() { spill(); return spilled.empty() ? size_t(pptr() - pbase()) : spilled.size(); }
+
+	protected:
+		int_type overflow(int_type c) override
+		{
+			spilled.append(pbase(), pptr());
+			setp(local, local + sizeof(local));
+			if(!traits_type::eq_int_type(c, traits_type::eof())) spilled += traits_type::to_char_type(c);
+			return traits_type::not_eof(c);
+		}
+
+	private:
+		void spill()
+		{
+			if(spilled.empty()) return;
+			spilled.append(pbase(), pptr());
+			setp(local, local + sizeof(local));
+		}
+
+		char local[256];
+		std::string spilled;
+	};
+
+	// Piece of a contiguous block of text (see flow_graph_arena)
+	struct text_view
+	{
+		const char* data;
+		size_t size;
+	};
+	inline std::ostream& operator<<(std::ostream& os, const text_view& s) { return os.write(s.data, std::streamsize(s.size)); }
 
+	// Textual form of fields: strings are escaped, numbers are formatted in place, other types
+	// are formatted with a std::ostream into a local buffer and escaped from there, or as a last
+	// resort streamed directly into the output (without escaping)
+	template<typename E, typename B, typename S>
+	void write_text(B& b, S&, const std::string& s, rank<3>) { E::write(b, s.data(), s.size()); }
+	template<typename E, typename B, typename S>
+	void write_text(B& b, S&, const char* s, rank<3>) { E::write(b, s, std::strlen(s)); }
+	template<typename E, typename B, typename S>
+	void write_text(B& b, S&, const text_view& s, rank<3>) { E::write(b, s.data, s.size); }
+	template<typename E, typename B, typename S, typename T>
+	std::enable_if_t<is_index<T>::value> write_text(B& b, S&, const T& v, rank<2>)
+	{
+#if DEBUGVIZ_TO_CHARS
+		char digits[24];
+		const auto r = std::to_chars(digits, digits + sizeof(digits), v);
+		b.write(digits, size_t(r.ptr - digits));
 #else
+		char digits[24];
+		char* p = digits + sizeof(digits);
+		auto u = static_cast<std::make_unsigned_t<T>>(v);
+		if(std::is_signed<T>::value && v < T(0)) u = 0 - u;
+		do { *--p = char('0' + u % 10); u /= 10; } while(u);
+		if(std::is_signed<T>::value && v < T(0)) *--p = '-';
+		b.write(p, size_t(digits + sizeof(digits) - p));
+#endif
+	}
+#if DEBUGVIZ_TO_CHARS_FLOAT
+	template<typename E, typename B, typename S, typename T>
+	std::enable_if_t<std::is_floating_point<T>::value> write_text(B& b, S&, const T& v, rank<2>)
+	{
+		char text[64];
+		const auto r = std::to_chars(text, text + sizeof(text), v);
+		b.write(text, size_t(r.ptr - text));
+	}
+#endif
+	template<typename E, typename B, typename S, typename T>
+	std::enable_if_t<is_streamable<std::ostream, T>::value> write_text(B& b, S&, const T& v, rank<1>)
+	{
+		local_streambuf text;
+		std::ostream os(&text);
+		os << v;
+		E::write(b, text.data(), text.size());
+	}
+	template<typename E, typename B, typename S, typename T>
+	void write_text(B& b, S& stream, const T& v, rank<0>)
+	{
+		b.flush();
+		stream << v;
+	}
+	template<typename E = no_escape, typename B, typename S, typename T>
+	void write_text(B& b, S& stream, const T& v) { write_text<E>(b, stream, v, rank<3>()); }
 
-namespace debugviz
-{
-namespace detail
-{
-	struct empty {};
-	std::ostream& operator<<(std::ostream& os, empty) { return os; }
-}
-	template<typename T, typename N, typename C>
-	detail::empty flow_graph(const T&, const N&, const C&) { return {}; }
+	// Textual form of a name, used to match connection endpoints against nodes and slots
+	inline std::string key_of(const std::string& s) { return s; }
+	inline std::string key_of(const char* s) { return s; }
+	inline std::string key_of(const text_view& s) { return std::string(s.data, s.size); }
+	template<typename T>
+	std::string key_of(const T& v)
+	{
+		std::ostringstream os;
+		os << v;
+		return os.str();
+	}
 
-	template<typename S, typename T, typename N, typename C>
-	S& write_flow_graph(S& s, const T&, const N&, const C&) { return s; }
+	template<typename R>
+	size_t range_size(const R& r)
+	{
+		size_t n = 0;
+		for(auto it = std::begin(r), end = std::end(r); it != end; ++it) n++;
+		return n;
+	}
+
+	// Maps node and slot names to their indices, so that connections can be written as indices
+	class flow_graph_index
+	{
+	public:
+		static constexpr size_t npos = size_t(-1);
+
+		size_t node_count() const { return count; }
+
+		template<typename Node>
+		void add_node(const Node& n, std::true_type /*names*/, std::true_type /*slots*/)
+		{
+			add_slots(n.inputs, 'i');
+			add_slots(n.outputs, 'o');
+			add_node(n, std::true_type(), std::false_type());
+		}
+		template<typename Node>
+		void add_node(const Node& n, std::true_type /*names*/, std::false_type /*slots*/)
+		{
+			add_slot_counts(n);
+			nodes.emplace(key_of(n.name), count++);
+		}
+		template<typename Node>
+		void add_node(const Node& n, std::false_type /*names*/, std::true_type /*slots*/)
+		{
+			add_slots(n.inputs, 'i');
+			add_slots(n.outputs, 'o');
+			add_slot_counts(n);
+			count++;
+		}
+		template<typename Node>
+		void add_node(const Node& n, std::false_type, std::false_type)
+		{
+			add_slot_counts(n);
+			count++;
+		}
+
+		template<typename T>
+		size_t node(const T& name) const { return node(name, is_index<T>()); }
+		template<typename T>
+		size_t slot(size_t node, char kind, const T& name) const { return slot(node, kind, name, is_index<T>()); }
+
+	private:
+		// Slots given by index are checked against these
+		template<typename Node>
+		void add_slot_counts(const Node& n)
+		{
+			slot_counts.push_back(range_size(n.inputs));
+			slot_counts.push_back(range_size(n.outputs));
+		}
+		template<typename R>
+		void add_slots(const R& slots, char kind)
+		{
+			size_t i = 0;
+			for(const auto& s : slots)
+				this->slots.emplace(slot_key(count, kind, key_of(s)), i++);
+		}
+		static std::string slot_key(size_t node, char kind, const std::string& name)
+		{
+			std::string key(reinterpret_cast<const char*>(&node), sizeof(node));
+			key += kind;
+			key += name;
+			return key;
+		}
+
+		template<typename T>
+		size_t node(const T& name, std::false_type) const
+		{
+			auto it = nodes.find(key_of(name));
+			return it != nodes.end() ? it->second : npos;
+		}
+		template<typename T>
+		size_t node(const T& index, std::true_type) const
+		{
+			return !negative(index) && size_t(index) < count ? size_t(index) : npos;
+		}
+		template<typename T>
+		size_t slot(size_t node, char kind, const T& name, std::false_type) const
+		{
+			auto it = slots.find(slot_key(node, kind, key_of(name)));
+			return it != slots.end() ? it->second : npos;
+		}
+		template<typename T>
+		size_t slot(size_t node, char kind, const T& index, std::true_type) const
+		{
+			return !negative(index) && size_t(index) < slot_counts[2 * node + (kind == 'o')] ? size_t(index) : npos;
+		}
+		template<typename T>
+		static bool negative(T index) { return std::is_signed<T>::value && index < T(0); }
+
+		size_t count = 0;
+		std::unordered_map<std::string, size_t> nodes;
+		std::unordered_map<std::string, size_t> slots;
+		std::vector<size_t> slot_counts;	// Inputs and outputs of each node
+	};
+
+	// Stands for the output stream when text is written into a string_table: values that can
+	// only be streamed into the output stream are dropped (they have no textual form here)
+	struct discard_stream {};
+	template<typename T>
+	discard_stream& operator<<(discard_stream& s, const T&) { return s; }
+
+	// Strings of the binary payload, stored once: a string is written in place as into an
+	// output buffer, then intern() gives its id (the bytes are dropped if it already existed)
+	class string_table
+	{
+	public:
+		string_table() : offsets(1, 0) {}
+
+		void write(const char* s, size_t n) { bytes.insert(bytes.end(), s, s + n); }
+		void write(char c) { bytes.push_back(c); }
+		template<size_t N>
+		void literal(const char (&s)[N]) { write(s, N - 1); }
+		void flush() {}
+
+		uint32_t intern()
+		{
+			const size_t begin = offsets.back();
+			uint32_t h = 2166136261u; // FNV-1a
+			for(size_t i = begin; i < bytes.size(); i++) h = (h ^ uint8_t(bytes[i])) * 16777619u;
+			if(2 * offsets.size() > buckets.size()) rehash(std::max<size_t>(64, 2 * buckets.size()));
+
+			const size_t mask = buckets.size() - 1;
+			for(size_t b = h & mask;; b = (b + 1) & mask)
+			{
+				const uint32_t id = buckets[b];
+				if(id == empty)
+				{
+					buckets[b] = uint32_t(hashes.size());
+					hashes.push_back(h);
+					offsets.push_back(uint32_t(bytes.size()));
+					return buckets[b];
+				}
+				const size_t length = offsets[id + 1] - offsets[id];
+				if(hashes[id] == h && length == bytes.size() - begin
+					&& std::equal(bytes.begin() + offsets[id], bytes.begin() + offsets[id + 1], bytes.begin() + begin))
+				{
+					bytes.resize(begin);
+					return id;
+				}
+			}
+		}
+
+		size_t size() const { return hashes.size(); }
+		const std::vector<char>& data() const { return bytes; }
+		/// Offsets of the strings in data(), plus the end
+		const std::vector<uint32_t>& bounds() const { return offsets; }
+
+	private:
+		static constexpr uint32_t empty = uint32_t(-1);
+
+		void rehash(size_t size)
+		{
+			buckets.assign(size, uint32_t(empty));
+			for(uint32_t id = 0; id < hashes.size(); id++)
+			{
+				size_t b = hashes[id] & (size - 1);
+				while(buckets[b] != empty) b = (b + 1) & (size - 1);
+				buckets[b] = id;
+			}
+		}
+
+		std::vector<char> bytes;
+		std::vector<uint32_t> offsets, hashes, buckets;
+	};
+
+	// 32-bit words as little-endian bytes, into an output with a 'bytes(const unsigned char*, n)' member
+	template<typename Out>
+	void write_words(Out& out, const uint32_t* w, size_t n)
+	{
+		unsigned char le[4 * 768];
+		while(n)
+		{
+			const size_t count = std::min<size_t>(n, sizeof(le) / 4);
+			for(size_t i = 0; i < count; i++)
+			{
+				le[4 * i] = uint8_t(w[i]);
+				le[4 * i + 1] = uint8_t(w[i] >> 8);
+				le[4 * i + 2] = uint8_t(w[i] >> 16);
+				le[4 * i + 3] = uint8_t(w[i] >> 24);
+			}
+			out.bytes(le, 4 * count);
+			w += count;
+			n -= count;
+		}
+	}
+	template<typename Out>
+	void write_words(Out& out, const std::vector<uint32_t>& w) { write_words(out, w.data(), w.size()); }
+
+	// Base64 encoding into an output buffer
+	template<typename B>
+	class base64_writer
+	{
+	public:
+		explicit base64_writer(B& buffer) : buffer(buffer) {}
+
+		void bytes(const unsigned char* s, size_t n)
+		{
+			while(pending_size && pending_size < 3 && n)
+			{
+				pending[pending_size++] = *s++;
+				n--;
+			}
+			if(pending_size == 3)
+			{
+				char out[4];
+				encode(pending, out);
+				buffer.write(out, 4);
+				pending_size = 0;
+			}
+			char out[4 * 1024];
+			while(n >= 3)
+			{
+				const size_t groups = std::min<size_t>(n / 3, sizeof(out) / 4);
+				for(size_t g = 0; g < groups; g++) encode(s + 3 * g, out + 4 * g);
+				buffer.write(out, 4 * groups);
+				s += 3 * groups;
+				n -= 3 * groups;
+			}
+			for(; n; n--) pending[pending_size++] = *s++;
+		}
+		/// Writes the last incomplete group, with padding
+		void finish()
+		{
+			if(!pending_size) return;
+			std::fill(pending + pending_size, pending + 3, 0);
+			char out[4];
+			encode(pending, out);
+			std::fill(out + pending_size + 1, out + 4, '=');
+			buffer.write(out, 4);
+			pending_size = 0;
+		}
+
+	private:
+		static void encode(const unsigned char* in, char* out)
+		{
+			static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			const uint32_t v = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+			out[0] = alphabet[v >> 18];
+			out[1] = alphabet[(v >> 12) & 63];
+			out[2] = alphabet[(v >> 6) & 63];
+			out[3] = alphabet[v & 63];
+		}
+
+		B& buffer;
+		unsigned char pending[3];
+		size_t pending_size = 0;
+	};
+
+#if defined(DEBUGVIZ_USE_ZLIB)
+	// zlib stream (RFC 1950) of the bytes given, written into an output with a
+	// 'bytes(const unsigned char*, n)' member
+	template<typename Out>
+	class deflate_encoder
+	{
+	public:
+		explicit deflate_encoder(Out& out) : out(out)
+		{
+			stream.zalloc = Z_NULL;
+			stream.zfree = Z_NULL;
+			stream.opaque = Z_NULL;
+			deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+		}
+		deflate_encoder(const deflate_encoder&) = delete;
+		deflate_encoder& operator=(const deflate_encoder&) = delete;
+		~deflate_encoder() { deflateEnd(&stream); }
+
+		void bytes(const unsigned char* s, size_t n) { run(s, n, Z_NO_FLUSH); }
+		void finish() { run(nullptr, 0, Z_FINISH); }
+
+	private:
+		void run(const unsigned char* s, size_t n, int mode)
+		{
+			unsigned char chunk[16 * 1024];
+			do
+			{
+				const uInt k = uInt(std::min<size_t>(n, 1 << 30));
+				stream.next_in = const_cast<Bytef*>(s);
+				stream.avail_in = k;
+				s += k;
+				n -= k;
+				do
+				{
+					stream.next_out = chunk;
+					stream.avail_out = sizeof(chunk);
+					deflate(&stream, n ? Z_NO_FLUSH : mode);
+					out.bytes(chunk, sizeof(chunk) - stream.avail_out);
+				} while(!stream.avail_out);
+			} while(n);
+		}
+
+		Out& out;
+		z_stream stream;
+	};
+#else
+	// zlib stream (RFC 1950) of the bytes given, written into an output with a
+	// 'bytes(const unsigned char*, n)' member. Matches are found in a sliding window with hash
+	// chains, and blocks are written with their own (dynamic) Huffman codes. Memory usage does not
+	// depend on the size of the input (about 400 KB).
+	template<typename Out>
+	class deflate_encoder
+	{
+	public:
+		explicit deflate_encoder(Out& out) : out(out), data(new unsigned char[2 * window]),
+			head(new int32_t[hash_size]), prev(new int32_t[window]), tokens(new token[max_tokens])
+		{
+			std::fill(head.get(), head.get() + hash_size, -1);
+			put_bits(0x9c78, 16); // Deflate, 32 KB window, default compression
+		}
+		deflate_encoder(const deflate_encoder&) = delete;
+		deflate_encoder& operator=(const deflate_encoder&) = delete;
+
+		void bytes(const unsigned char* s, size_t n)
+		{
+			update_adler(s, n);
+			while(n)
+			{
+				const size_t k = std::min(n, 2 * window - end);
+				std::memcpy(data.get() + end, s, k);
+				end += k;
+				s += k;
+				n -= k;
+				if(end == 2 * window)
+				{
+					compress(end - max_match);
+					slide();
+				}
+			}
+		}
+		/// Ends the stream: last block and checksum
+		void finish()
+		{
+			compress(end);
+			write_block(true);
+			if(bit_count % 8) put_bits(0, 8 - bit_count % 8);
+			for(int shift = 24; shift >= 0; shift -= 8) put_bits((((adler_b << 16) | adler_a) >> shift) & 255, 8);
+			flush_output();
+		}
+
+	private:
+		static constexpr size_t window = 32 * 1024, hash_size = 32 * 1024, max_tokens = 16 * 1024;
+		static constexpr size_t min_match = 3, max_match = 258, nice_match = 128, max_chain = 32;
+		static constexpr size_t literals = 286, distances = 30;
+
+		// A literal (distance 0) or a match
+		struct token
+		{
+			uint16_t value;
+			uint16_t distance;
+		};
+
+		uint32_t hash(size_t p) const
+		{
+			const uint32_t v = uint32_t(data[p]) | (uint32_t(data[p + 1]) << 8) | (uint32_t(data[p + 2]) << 16);
+			return (v * 2654435761u) >> 17;
+		}
+		void insert(size_t p)
+		{
+			const uint32_t h = hash(p);
+			prev[p & (window - 1)] = head[h];
+			head[h] = int32_t(p);
+		}
+
+		// Encodes the input up to 'limit' (matches may go beyond, up to the end of the input)
+		void compress(size_t limit)
+		{
+			while(pos < limit)
+			{
+				size_t length = 0, distance = 0;
+				if(end - pos >= min_match)
+				{
+					const size_t longest = std::min(size_t(max_match), end - pos);
+					size_t chain = max_chain;
+					for(int32_t c = head[hash(pos)]; c >= 0 && pos - size_t(c) < window && chain--; c = prev[c & (window - 1)])
+					{
+						const unsigned char* a = data.get() + c;
+						const unsigned char* b = data.get() + pos;
+						if(a[length] != b[length] || a[0] != b[0]) continue;
+						size_t l = 0;
+						while(l < longest && a[l] == b[l]) l++;
+						if(l > length)
+						{
+							length = l;
+							distance = pos - size_t(c);
+							if(l >= nice_match || l == longest) break;
+						}
+					}
+					insert(pos);
+				}
+				if(length >= min_match)
+				{
+					tokens[token_count++] = { uint16_t(length), uint16_t(distance) };
+					for(size_t i = 1; i < length; i++)
+						if(pos + i + min_match <= end) insert(pos + i);
+					pos += length;
+				}
+				else
+					tokens[token_count++] = { data[pos++], 0 };
+				if(token_count == max_tokens) write_block(false);
+			}
+		}
+		void slide()
+		{
+			std::memmove(data.get(), data.get() + window, end - window);
+			pos -= window;
+			end -= window;
+			for(size_t i = 0; i < hash_size; i++) head[i] = head[i] >= int32_t(window) ? head[i] - int32_t(window) : -1;
+			for(size_t i = 0; i < window; i++) prev[i] = prev[i] >= int32_t(window) ? prev[i] - int32_t(window) : -1;
+		}
+
+		// Length and distance codes, with their extra bits
+		static unsigned length_code(size_t length, unsigned& extra_bits, unsigned& extra)
+		{
+			const unsigned x = unsigned(length - min_match);
+			extra_bits = extra = 0;
+			if(length == max_match) return 285;
+			if(x < 8) return 257 + x;
+			unsigned bits = 0;
+			while(x >> (bits + 1)) bits++;
+			extra_bits = bits - 2;
+			extra = x & ((1u << extra_bits) - 1);
+			return 257 + 4 * (bits - 1) + ((x >> extra_bits) & 3);
+		}
+		static unsigned distance_code(size_t distance, unsigned& extra_bits, unsigned& extra)
+		{
+			const unsigned x = unsigned(distance - 1);
+			extra_bits = extra = 0;
+			if(x < 4) return x;
+			unsigned bits = 0;
+			while(x >> (bits + 1)) bits++;
+			extra_bits = bits - 1;
+			extra = x & ((1u << extra_bits) - 1);
+			return 2 * bits + ((x >> extra_bits) & 1);
+		}
+
+		// Huffman code lengths, limited to 'limit' bits (frequencies are flattened until they fit).
+		// At least two symbols get a code, as some decoders require it.
+		static void huffman_lengths(const uint32_t* frequencies, size_t n, unsigned limit, uint8_t* lengths)
+		{
+			uint32_t f[literals];
+			std::copy(frequencies, frequencies + n, f);
+			size_t used = size_t(std::count_if(f, f + n, [](uint32_t v) { return v != 0; }));
+			for(size_t i = 0; used < 2; i++)
+				if(!f[i]) { f[i] = 1; used++; }
+
+			uint16_t symbols[literals], parent[2 * literals];
+			uint32_t weight[2 * literals];
+			uint8_t depth[2 * literals];
+			for(;;)
+			{
+				size_t leaves = 0;
+				for(size_t i = 0; i < n; i++)
+					if(f[i]) symbols[leaves++] = uint16_t(i);
+				std::sort(symbols, symbols + leaves, [&](uint16_t a, uint16_t b) { return f[a] != f[b] ? f[a] < f[b] : a < b; });
+				for(size_t i = 0; i < leaves; i++) weight[i] = f[symbols[i]];
+
+				// Leaves and internal nodes are both taken in increasing weight order
+				size_t next_leaf = 0, next_node = leaves, nodes = leaves;
+				auto lightest = [&]
+				{
+					if(next_leaf < leaves && (next_node == nodes || weight[next_leaf] <= weight[next_node])) return next_leaf++;
+					return next_node++;
+				};
+				while(nodes < 2 * leaves - 1)
+				{
+					const size_t a = lightest(), b = lightest();
+					weight[nodes] = weight[a] + weight[b];
+					parent[a] = parent[b] = uint16_t(nodes);
+					nodes++;
+				}
+				depth[nodes - 1] = 0;
+				unsigned deepest = 0;
+				for(size_t i = nodes - 1; i-- > 0;)
+				{
+					depth[i] = uint8_t(depth[parent[i]] + 1);
+					deepest = std::max<unsigned>(deepest, depth[i]);
+				}
+				if(deepest <= limit)
+				{
+					std::fill(lengths, lengths + n, uint8_t(0));
+					for(size_t i = 0; i < leaves; i++) lengths[symbols[i]] = depth[i];
+					return;
+				}
+				for(size_t i = 0; i < n; i++)
+					if(f[i]) f[i] = (f[i] + 1) / 2;
+			}
+		}
+		// Canonical codes, bit-reversed since they are written starting from their first bit
+		static void canonical_codes(const uint8_t* lengths, size_t n, uint16_t* codes)
+		{
+			unsigned count[16] = {}, next[16] = {};
+			for(size_t i = 0; i < n; i++) count[lengths[i]]++;
+			count[0] = 0;
+			for(unsigned bits = 1, code = 0; bits < 16; bits++)
+				next[bits] = code = (code + count[bits - 1]) << 1;
+			for(size_t i = 0; i < n; i++)
+			{
+				if(!lengths[i]) continue;
+				unsigned code = next[lengths[i]]++, reversed = 0;
+				for(unsigned b = 0; b < lengths[i]; b++) reversed |= ((code >> b) & 1) << (lengths[i] - 1 - b);
+				codes[i] = uint16_t(reversed);
+			}
+		}
+
+		void write_block(bool last)
+		{
+			uint32_t literal_frequencies[literals] = {}, distance_frequencies[distances] = {};
+			unsigned extra_bits, extra;
+			for(size_t i = 0; i < token_count; i++)
+				if(!tokens[i].distance) literal_frequencies[tokens[i].value]++;
+				else
+				{
+					literal_frequencies[length_code(tokens[i].value, extra_bits, extra)]++;
+					distance_frequencies[distance_code(tokens[i].distance, extra_bits, extra)]++;
+				}
+			literal_frequencies[256] = 1;
+
+			uint8_t lengths[literals + distances];
+			huffman_lengths(literal_frequencies, literals, 15, lengths);
+			size_t literal_count = literals;
+			while(literal_count > 257 && !lengths[literal_count - 1]) literal_count--;
+			uint8_t* distance_lengths = lengths + literal_count;
+			huffman_lengths(distance_frequencies, distances, 15, distance_lengths);
+			size_t distance_count = distances;
+			while(distance_count > 1 && !distance_lengths[distance_count - 1]) distance_count--;
+
+			// Code lengths of both trees, run-length encoded
+			const size_t total = literal_count + distance_count;
+			uint8_t runs[literals + distances], run_extras[literals + distances];
+			size_t run_count = 0;
+			uint32_t length_frequencies[19] = {};
+			for(size_t i = 0; i < total;)
+			{
+				const uint8_t l = lengths[i];
+				size_t repeat = 1;
+				while(i + repeat < total && lengths[i + repeat] == l) repeat++;
+				if(!l && repeat >= 3)
+				{
+					repeat = std::min<size_t>(repeat, 138);
+					runs[run_count] = repeat >= 11 ? 18 : 17;
+					run_extras[run_count++] = uint8_t(repeat - (repeat >= 11 ? 11 : 3));
+				}
+				else if(l && repeat >= 4)
+				{
+					repeat = std::min<size_t>(repeat, 7);
+					runs[run_count] = l;
+					run_extras[run_count++] = 0;
+					runs[run_count] = 16;
+					run_extras[run_count++] = uint8_t(repeat - 1 - 3);
+				}
+				else
+				{
+					repeat = 1;
+					runs[run_count] = l;
+					run_extras[run_count++] = 0;
+				}
+				i += repeat;
+			}
+			for(size_t i = 0; i < run_count; i++) length_frequencies[runs[i]]++;
+			uint8_t length_lengths[19];
+			uint16_t length_codes[19];
+			huffman_lengths(length_frequencies, 19, 7, length_lengths);
+			canonical_codes(length_lengths, 19, length_codes);
+			static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			size_t order_count = 19;
+			while(order_count > 4 && !length_lengths[order[order_count - 1]]) order_count--;
+
+			put_bits(last ? 1 : 0, 1);
+			put_bits(2, 2);
+			put_bits(unsigned(literal_count - 257), 5);
+			put_bits(unsigned(distance_count - 1), 5);
+			put_bits(unsigned(order_count - 4), 4);
+			for(size_t i = 0; i < order_count; i++) put_bits(length_lengths[order[i]], 3);
+			static const uint8_t run_bits[3] = { 2, 3, 7 };
+			for(size_t i = 0; i < run_count; i++)
+			{
+				put_bits(length_codes[runs[i]], length_lengths[runs[i]]);
+				if(runs[i] >= 16) put_bits(run_extras[i], run_bits[runs[i] - 16]);
+			}
+
+			uint16_t literal_codes[literals], distance_codes[distances];
+			canonical_codes(lengths, literal_count, literal_codes);
+			canonical_codes(distance_lengths, distance_count, distance_codes);
+			for(size_t i = 0; i < token_count; i++)
+			{
+				const token t = tokens[i];
+				if(!t.distance)
+				{
+					put_bits(literal_codes[t.value], lengths[t.value]);
+					continue;
+				}
+				const unsigned l = length_code(t.value, extra_bits, extra);
+				put_bits(literal_codes[l], lengths[l]);
+				put_bits(extra, extra_bits);
+				const unsigned d = distance_code(t.distance, extra_bits, extra);
+				put_bits(distance_codes[d], distance_lengths[d]);
+				put_bits(extra, extra_bits);
+			}
+			put_bits(literal_codes[256], lengths[256]);
+			token_count = 0;
+		}
+
+		void put_bits(uint32_t value, unsigned count)
+		{
+			bits |= uint64_t(value) << bit_count;
+			bit_count += count;
+			while(bit_count >= 8)
+			{
+				output[output_size++] = uint8_t(bits);
+				bits >>= 8;
+				bit_count -= 8;
+				if(output_size == sizeof(output)) flush_output();
+			}
+		}
+		void flush_output()
+		{
+			out.bytes(output, output_size);
+			output_size = 0;
+		}
+		void update_adler(const unsigned char* s, size_t n)
+		{
+			while(n)
+			{
+				const size_t k = std::min<size_t>(n, 5552); // No overflow before the modulo
+				for(size_t i = 0; i < k; i++)
+				{
+					adler_a += s[i];
+					adler_b += adler_a;
+				}
+				adler_a %= 65521;
+				adler_b %= 65521;
+				s += k;
+				n -= k;
+			}
+		}
+
+		Out& out;
+		std::unique_ptr<unsigned char[]> data;
+		std::unique_ptr<int32_t[]> head, prev;
+		std::unique_ptr<token[]> tokens;
+		size_t pos = 0, end = 0, token_count = 0;
+		uint64_t bits = 0;
+		unsigned bit_count = 0;
+		unsigned char output[4096];
+		size_t output_size = 0;
+		uint32_t adler_a = 1, adler_b = 0;
+	};
+#endif
+
+	// Payload compressed with deflate and encoded in base64 into an output buffer; bytes are
+	// compressed as they come, text goes through a buffer first
+	template<typename B>
+	class compressed_output
+	{
+	public:
+		explicit compressed_output(B& buffer) : base64(buffer), deflate(base64), buffer(64 * 1024, &compress, this) {}
+
+		void bytes(const unsigned char* s, size_t n) { deflate.bytes(s, n); }
+		text_buffer& text() { return buffer; }
+		void finish()
+		{
+			buffer.flush();
+			deflate.finish();
+			base64.finish();
+		}
+
+	private:
+		static void compress(void* self, const char* s, size_t n)
+		{
+			static_cast<compressed_output*>(self)->deflate.bytes(reinterpret_cast<const unsigned char*>(s), n);
+		}
+
+		base64_writer<B> base64;
+		deflate_encoder<base64_writer<B>> deflate;
+		text_buffer buffer;
+	};
+
+	// Graph of a flow_graph_payload::binary page, kept until it is encoded by the writer. The
+	// encoding (base64 of little-endian 32-bit words, decoded by flow_graph_decode in data.js):
+	//  - header: magic, node count N, slot count S, edge count E, string count T, string bytes,
+	//    flags (1: layout present, 2: measures, 4: groups, 8: clusters)
+	//  - N string ids: node names
+	//  - 2N + 1 offsets into the slots: inputs of node i in [o[2i], o[2i+1]), outputs in
+	//    [o[2i+1], o[2i+2])
+	//  - S string ids: slot names
+	//  - 4E endpoints (out, out_slot, in, in_slot): indices, or string ids with the high bit set
+	//    for names resolved by the viewer
+	//  - T + 1 offsets of the strings in the string bytes
+	//  - 2N signed positions (x, y), if there is a layout
+	//  - 3N then 3E floats (time_ns, count, bytes of nodes, then of edges; NaN when absent), if
+	//    there are measures (flag 2)
+	//  - N string ids of the groups of the nodes (~0 for none), if some have one (flag 4)
+	//  - cluster count C, N clusters of the nodes and C clusters of the second level of the
+	//    clusters, if the layout has some (flag 8)
+	//  - the string bytes (UTF-8)
+	class binary_payload
+	{
+	public:
+		static constexpr uint32_t magic = 0x31475644; // "DVG1"
+		static constexpr uint32_t name_flag = 0x80000000u;
+
+		binary_payload() : slot_offsets(1, 0) {}
+
+		template<typename N, typename I, typename O>
+		void add_node(const N& name, const I& inputs, const O& outputs, const flow_graph_measures& m,
+			const std::string& group = std::string())
+		{
+			add_measures(node_measures, names.size(), m);
+			if(!group.empty())
+			{
+				groups.resize(names.size(), ~0u);
+				groups.push_back(string(group));
+			}
+			names.push_back(string(name));
+			for(const auto& s : inputs) slots.push_back(string(s));
+			slot_offsets.push_back(uint32_t(slots.size()));
+			for(const auto& s : outputs) slots.push_back(string(s));
+			slot_offsets.push_back(uint32_t(slots.size()));
+		}
+		template<typename O, typename OS, typename I, typename IS>
+		void add_connection(const O& out, const OS& out_slot, const I& in, const IS& in_slot, const flow_graph_measures& m)
+		{
+			add_measures(edge_measures, edges.size() / 4, m);
+			edges.push_back(endpoint(out, is_index<O>()));
+			edges.push_back(endpoint(out_slot, is_index<OS>()));
+			edges.push_back(endpoint(in, is_index<I>()));
+			edges.push_back(endpoint(in_slot, is_index<IS>()));
+		}
+
+		/// Encodes everything into an output with a 'bytes(const unsigned char*, n)' member; the
+		/// layout (if any) is a flow_graph_layout
+		template<typename Out, typename L>
+		void encode(Out& out, const L* layout) const
+		{
+			const bool clustered = layout && layout->cluster_count();
+			const uint32_t header[] = { magic, uint32_t(names.size()), uint32_t(slots.size()),
+				uint32_t(edges.size() / 4), uint32_t(strings.size()), uint32_t(strings.data().size()),
+				(layout ? 1u : 0u) | (node_measures.empty() && edge_measures.empty() ? 0u : 2u)
+					| (groups.empty() ? 0u : 4u) | (clustered ? 8u : 0u) };
+			write_words(out, header, sizeof(header) / sizeof(header[0]));
+			write_words(out, names);
+			write_words(out, slot_offsets);
+			write_words(out, slots);
+			write_words(out, edges);
+			write_words(out, strings.bounds());
+			if(layout)
+			{
+				uint32_t chunk[512];
+				for(size_t i = 0; i < names.size();)
+				{
+					const size_t count = std::min<size_t>(names.size() - i, sizeof(chunk) / 8);
+					for(size_t k = 0; k < count; k++, i++)
+					{
+						chunk[2 * k] = uint32_t(int32_t(std::lround(layout->x(i))));
+						chunk[2 * k + 1] = uint32_t(int32_t(std::lround(layout->y(i))));
+					}
+					write_words(out, chunk, 2 * count);
+				}
+			}
+			if(!node_measures.empty() || !edge_measures.empty())
+			{
+				write_measures(out, node_measures, 3 * names.size());
+				write_measures(out, edge_measures, 3 * (edges.size() / 4));
+			}
+			if(!groups.empty())
+			{
+				write_words(out, groups);
+				const uint32_t none = ~0u;
+				for(size_t i = groups.size(); i < names.size(); i++) write_words(out, &none, 1);
+			}
+			if(clustered)
+			{
+				const uint32_t count = uint32_t(layout->cluster_count());
+				write_words(out, &count, 1);
+				write_indices(out, names.size(), [&](size_t i) { return layout->cluster(i); });
+				write_indices(out, count, [&](size_t i) { return layout->parent_cluster(i); });
+			}
+			out.bytes(reinterpret_cast<const unsigned char*>(strings.data().data()), strings.data().size());
+		}
+
+	private:
+		template<typename T>
+		uint32_t string(const T& s)
+		{
+			discard_stream none;
+			write_text(strings, none, s);
+			return strings.intern();
+		}
+		template<typename T>
+		uint32_t endpoint(const T& index, std::true_type) { return uint32_t(index); }
+		template<typename T>
+		uint32_t endpoint(const T& name, std::false_type) { return string(name) | name_flag; }
+
+		// Measures are only stored from the first element that has some, NaN before
+		static void add_measures(std::vector<float>& values, size_t index, const flow_graph_measures& m)
+		{
+			if(m.empty() && values.empty()) return;
+			values.resize(3 * index, std::numeric_limits<float>::quiet_NaN());
+			values.push_back(float(m.time_ns));
+			values.push_back(float(m.count));
+			values.push_back(float(m.bytes));
+		}
+		template<typename Out, typename F>
+		static void write_indices(Out& out, size_t size, const F& index)
+		{
+			uint32_t chunk[512];
+			for(size_t i = 0; i < size;)
+			{
+				const size_t count = std::min<size_t>(size - i, sizeof(chunk) / 4);
+				for(size_t k = 0; k < count; k++, i++) chunk[k] = uint32_t(index(i));
+				write_words(out, chunk, count);
+			}
+		}
+		template<typename Out>
+		static void write_measures(Out& out, const std::vector<float>& values, size_t size)
+		{
+			uint32_t chunk[512];
+			const float nan = std::numeric_limits<float>::quiet_NaN();
+			for(size_t i = 0; i < size;)
+			{
+				const size_t count = std::min<size_t>(size - i, sizeof(chunk) / 4);
+				for(size_t k = 0; k < count; k++, i++)
+					std::memcpy(chunk + k, i < values.size() ? &values[i] : &nan, 4);
+				write_words(out, chunk, count);
+			}
+		}
+
+		string_table strings;
+		std::vector<uint32_t> names, slot_offsets, slots, edges;
+		std::vector<uint32_t> groups;	// Up to the last node that has one
+		std::vector<float> node_measures, edge_measures;
+	};
+
+	// Overlap removal between node boxes. Boxes are those of the collision force of the viewer
+	// (node with its slots, plus some padding); candidate pairs come from a uniform grid sorted
+	// by cell, and each pair is only tested in the cell holding the corner of its intersection.
+	class overlap_grid
+	{
+	public:
+		// One step: overlapping nodes are pushed apart along the axis of least penetration,
+		// positions are interleaved (x, y) top-left corners. Returns the number of overlaps found.
+		size_t step(std::vector<float>& positions, const std::vector<float>& heights, bool apply = true)
+		{
+			using m = flow_graph_metrics;
+			const size_t n = heights.size();
+			const float margin_x = m::node_padding + 2 * m::slot_radius, margin_y = m::node_padding + m::slot_radius;
+			boxes.resize(4 * n);
+			float min_x = std::numeric_limits<float>::infinity(), min_y = min_x, height_sum = 0;
+			for(size_t i = 0; i < n; i++)
+			{
+				float* b = &boxes[4 * i];
+				b[0] = positions[2 * i] - margin_x;
+				b[1] = positions[2 * i + 1] - margin_y;
+				b[2] = positions[2 * i] + m::node_width + margin_x;
+				b[3] = positions[2 * i + 1] + heights[i] + margin_y;
+				min_x = std::min(min_x, b[0]);
+				min_y = std::min(min_y, b[1]);
+				height_sum += b[3] - b[1];
+			}
+			if(n < 2) return 0;
+			cell_w = m::node_width + 2 * margin_x;
+			cell_h = height_sum / float(n);
+			origin_x = min_x;
+			origin_y = min_y;
+
+			cells.clear();
+			for(uint32_t i = 0; i < n; i++)
+			{
+				const float* b = &boxes[4 * i];
+				const uint32_t x0 = cell_x(b[0]), x1 = cell_x(b[2]), y0 = cell_y(b[1]), y1 = cell_y(b[3]);
+				for(uint32_t cx = x0; cx <= x1; cx++)
+					for(uint32_t cy = y0; cy <= y1; cy++)
+						cells.push_back({ (uint64_t(cx) << 32) | cy, i });
+			}
+			std::sort(cells.begin(), cells.end(), [](const entry& a, const entry& b)
+			{
+				return a.cell != b.cell ? a.cell < b.cell : a.node < b.node;
+			});
+
+			push.assign(2 * n, 0.f);
+			size_t overlaps = 0;
+			for(size_t first = 0, last; first < cells.size(); first = last)
+			{
+				for(last = first + 1; last < cells.size() && cells[last].cell == cells[first].cell; last++) {}
+				for(size_t i = first; i < last; i++)
+					for(size_t j = i + 1; j < last; j++)
+						overlaps += collide(cells[i].node, cells[j].node, cells[first].cell);
+			}
+			if(apply)
+				for(size_t i = 0; i < 2 * n; i++) positions[i] += push[i];
+			return overlaps;
+		}
+
+	private:
+		struct entry
+		{
+			uint64_t cell;
+			uint32_t node;
+		};
+
+		uint32_t cell_x(float x) const { return uint32_t((x - origin_x) / cell_w); }
+		uint32_t cell_y(float y) const { return uint32_t((y - origin_y) / cell_h); }
+
+		bool collide(uint32_t a, uint32_t b, uint64_t cell)
+		{
+			const float* bA = &boxes[4 * a];
+			const float* bB = &boxes[4 * b];
+			const float left = bB[2] - bA[0], right = bA[2] - bB[0];
+			const float top = bB[3] - bA[1], bottom = bA[3] - bB[1];
+			const float tolerance = 0.5f; // Sub-pixel overlaps are left as is
+			if(left <= tolerance || right <= tolerance || top <= tolerance || bottom <= tolerance) return false;
+			const uint64_t corner = (uint64_t(cell_x(std::max(bA[0], bB[0]))) << 32) | cell_y(std::max(bA[1], bB[1]));
+			if(corner != cell) return false;
+
+			const float dx = left > right ? right : -left;
+			const float dy = top > bottom ? bottom : -top;
+			if(std::abs(dx) <= std::abs(dy))
+			{
+				push[2 * a] -= dx / 2;
+				push[2 * b] += dx / 2;
+			}
+			else
+			{
+				push[2 * a + 1] -= dy / 2;
+				push[2 * b + 1] += dy / 2;
+			}
+			return true;
+		}
+
+		std::vector<float> boxes, push;
+		std::vector<entry> cells;
+		float origin_x = 0, origin_y = 0, cell_w = 1, cell_h = 1;
+	};
+
+	// Label propagation: each element (in the given order) takes the label most common among its
+	// neighbours, given by neighbours(v, f) calling f(w) for each of them, as long as no more
+	// than max_size elements share a label. Returns labels numbered in the order of the elements.
+	template<typename F>
+	std::vector<uint32_t> propagate_labels(const std::vector<uint32_t>& order, uint32_t max_size, const F& neighbours)
+	{
+		const size_t n = order.size();
+		std::vector<uint32_t> label(n), size(n, 1), around;
+		for(uint32_t v = 0; v < n; v++) label[v] = v;
+		for(int round = 0; round < 10; round++)
+		{
+			size_t moved = 0;
+			for(uint32_t v : order)
+			{
+				around.clear();
+				neighbours(v, [&](uint32_t w) { if(w != v) around.push_back(label[w]); });
+				std::sort(around.begin(), around.end());
+
+				// Ties go to the biggest cluster, so that isolated elements join one
+				const uint32_t current = label[v];
+				uint32_t best = current, best_count = uint32_t(std::count(around.begin(), around.end(), current));
+				for(size_t i = 0, j; i < around.size(); i = j)
+				{
+					for(j = i + 1; j < around.size() && around[j] == around[i]; j++) {}
+					const uint32_t l = around[i], count = uint32_t(j - i);
+					if(l == current || size[l] >= max_size) continue;
+					if(count > best_count || (count == best_count && best != current && size[l] > size[best]))
+					{
+						best = l;
+						best_count = count;
+					}
+				}
+				if(best == current) continue;
+				size[current]--;
+				size[best]++;
+				label[v] = best;
+				moved++;
+			}
+			if(!moved) break;
+		}
+
+		std::vector<uint32_t> number(n, ~0u);
+		uint32_t count = 0;
+		for(uint32_t v : order)
+			if(number[label[v]] == ~0u) number[label[v]] = count++;
+		for(uint32_t& l : label) l = number[l];
+		return label;
+	}
+
+	// FNV-1a of the text of names and slots, through write_text
+	struct text_hash
+	{
+		uint64_t value = 14695981039346656037ull;
+
+		void write(const char* s, size_t n)
+		{
+			for(size_t i = 0; i < n; i++) write(s[i]);
+		}
+		void write(char c) { value = (value ^ uint8_t(c)) * 1099511628211ull; }
+		template<size_t N>
+		void literal(const char (&s)[N]) { write(s, N - 1); }
+		void flush() {}
+
+		template<typename T>
+		text_hash& operator()(const T& v)
+		{
+			discard_stream none;
+			write_text(*this, none, v);
+			write('\0');
+			return *this;
+		}
+	};
+
+	// Output buffer appending to a string
+	struct string_appender
+	{
+		std::string& text;
+
+		void write(const char* s, size_t n) { text.append(s, n); }
+		void write(char c) { text.push_back(c); }
+		template<size_t N>
+		void literal(const char (&s)[N]) { write(s, N - 1); }
+		void flush() {}
+	};
+
+	// Value formatted as text (without escaping)
+	template<typename T>
+	std::string text_of(const T& v)
+	{
+		std::string text;
+		string_appender out{ text };
+		discard_stream none;
+		write_text(out, none, v);
+		return text;
+	}
+
+	// Group of a node as text, empty when it has none
+	template<typename T>
+	std::string group_of(const T& v, std::true_type) { return text_of(v.group); }
+	template<typename T>
+	std::string group_of(const T&, std::false_type) { return std::string(); }
+	template<typename T>
+	std::string group_of(const T& v) { return group_of(v, has_group<T>()); }
+}
+
+	/// Positions of a previous layout, reused by flow_graph_layout::compute(cache)
+	/** Nodes are found by a 64-bit key (see flow_graph_layout::set_key, write_flow_graph uses a
+		hash of their name) and a hash of their height and of the keys of their neighbours, so
+		that nodes which changed or were connected differently are placed again. load() and save()
+		use a compact binary file: 20 bytes per node, as little-endian 32-bit words.
+	*/
+	class flow_graph_layout_cache
+	{
+	public:
+		/// Reads a file written by save(), returns false (the cache is then empty) if it cannot
+		bool load(const std::string& path)
+		{
+			entries.clear();
+			std::ifstream file(path, std::ios::binary);
+			const std::vector<unsigned char> bytes{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+			const auto word = [&](size_t i)
+			{
+				const unsigned char* b = &bytes[4 * i];
+				return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+			};
+			if(bytes.size() < 12 || word(0) != magic || word(1) != version || bytes.size() != 12 + 20 * size_t(word(2)))
+				return false;
+			entries.resize(word(2));
+			for(size_t i = 0; i < entries.size(); i++)
+			{
+				entry& e = entries[i];
+				const size_t w = 3 + 5 * i;
+				e.key = uint64_t(word(w)) | uint64_t(word(w + 1)) << 32;
+				e.signature = word(w + 2);
+				const uint32_t x = word(w + 3), y = word(w + 4);
+				std::memcpy(&e.x, &x, 4);
+				std::memcpy(&e.y, &y, 4);
+			}
+			return true;
+		}
+
+		/// Writes the cache into a file, returns false if it cannot
+		bool save(const std::string& path) const
+		{
+			std::vector<uint32_t> words = { magic, version, uint32_t(entries.size()) };
+			words.reserve(3 + 5 * entries.size());
+			for(const entry& e : entries)
+			{
+				uint32_t x, y;
+				std::memcpy(&x, &e.x, 4);
+				std::memcpy(&y, &e.y, 4);
+				words.insert(words.end(), { uint32_t(e.key), uint32_t(e.key >> 32), e.signature, x, y });
+			}
+			std::ofstream file(path, std::ios::binary);
+			file_output out{ file };
+			detail::write_words(out, words);
+			file.close();
+			return bool(file);
+		}
+
+		/// Number of nodes in the cache
+		size_t size() const { return entries.size(); }
+		void clear() { entries.clear(); }
+
+	private:
+		friend class flow_graph_layout;
+
+		static constexpr uint32_t magic = 0x434C5644;	// "DVLC"
+		static constexpr uint32_t version = 1;
+
+		struct entry
+		{
+			uint64_t key;
+			uint32_t signature;
+			float x, y;
+		};
+		struct file_output
+		{
+			std::ofstream& file;
+			void bytes(const unsigned char* b, size_t n) { file.write(reinterpret_cast<const char*>(b), std::streamsize(n)); }
+		};
+
+		const entry* find(uint64_t key) const
+		{
+			auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const entry& e, uint64_t k) { return e.key < k; });
+			return it != entries.end() && it->key == key ? &*it : nullptr;
+		}
+
+		std::vector<entry> entries;	// Sorted by key
+	};
+
+	/// Layered layout of a flow graph
+	/** Computes node positions so that connections go from left to right: cycles are broken by
+		ignoring the edges found going back during a depth-first search, nodes are ranked in
+		layers by longest path from the sources, nodes of each layer are ordered by the barycenter
+		of their neighbours to reduce crossings, and they are finally stacked vertically close to
+		the nodes they are connected to. This runs in O((N + E) log N).
+
+		Nodes are identified by their index, sizes and positions are in pixels (positions are
+		those of the top-left corner of the nodes). */
+	class flow_graph_layout
+	{
+	public:
+		explicit flow_graph_layout(size_t node_count = 0) : heights(node_count, 0.f) {}
+
+		/// Appends a node, and returns its index
+		size_t add_node(float height)
+		{
+			heights.push_back(height);
+			return heights.size() - 1;
+		}
+		/// Adds an edge between two nodes (self loops are ignored)
+		void add_edge(size_t out, size_t in)
+		{
+			if(out == in) return;
+			edges_out.push_back(uint32_t(out));
+			edges_in.push_back(uint32_t(in));
+		}
+		void set_height(size_t node, float height) { heights[node] = height; }
+
+		/// Identifies a node in a flow_graph_layout_cache (nodes without a key are always laid out)
+		void set_key(size_t node, uint64_t key)
+		{
+			keys.resize(heights.size(), 0);
+			keys[node] = key;
+		}
+
+		/// Computes the positions of the nodes
+		void compute()
+		{
+			clear_clusters();
+			build_adjacency();
+			layout_all();
+			remove_overlaps();
+		}
+
+		/// Computes the positions of the nodes, reusing those of a previous layout
+		/** Nodes found in the cache with the same height and neighbours keep their position. The
+			others are placed next to their neighbours, breadth first, in the closest free space of
+			their column; or laid out apart (below the others) when none of their neighbours was
+			placed. The layout is computed from scratch if no node is found. The cache is then
+			replaced by the new positions. Nodes with the same key are told apart by their order.
+		*/
+		void compute(flow_graph_layout_cache& cache)
+		{
+			const size_t n = heights.size();
+			clear_clusters();
+			build_adjacency();
+			const std::vector<uint64_t> unique = unique_keys();
+
+			// Height, and order-independent hash of the keys of the neighbours (each way)
+			std::vector<uint32_t> signature(n);
+			for(size_t v = 0; v < n; v++)
+			{
+				std::memcpy(&signature[v], &heights[v], 4);
+				for(uint32_t e = successors.offset[v]; e < successors.offset[v + 1]; e++)
+					signature[v] += uint32_t((unique[successors.nodes[e]] * 0x9E3779B97F4A7C15ull) >> 32);
+				for(uint32_t e = predecessors.offset[v]; e < predecessors.offset[v + 1]; e++)
+					signature[v] += uint32_t((unique[predecessors.nodes[e]] * 0xC2B2AE3D27D4EB4Full) >> 32);
+			}
+
+			std::vector<uint8_t> placed(n, 0);
+			positions.resize(2 * n);
+			size_t reused = 0;
+			for(size_t v = 0; v < n; v++)
+			{
+				const flow_graph_layout_cache::entry* e = unique[v] ? cache.find(unique[v]) : nullptr;
+				if(!e || e->signature != signature[v]) continue;
+				positions[2 * v] = e->x;
+				positions[2 * v + 1] = e->y;
+				placed[v] = 1;
+				reused++;
+			}
+			if(reused) layout_around(placed);
+			else
+			{
+				layout_all();
+				remove_overlaps();
+			}
+
+			cache.entries.clear();
+			for(size_t v = 0; v < n; v++)
+				if(unique[v]) cache.entries.push_back({ unique[v], signature[v], positions[2 * v], positions[2 * v + 1] });
+			std::sort(cache.entries.begin(), cache.entries.end(),
+				[](const flow_graph_layout_cache::entry& a, const flow_graph_layout_cache::entry& b) { return a.key < b.key; });
+		}
+
+		/// Pushes apart overlapping nodes, returns the number of overlaps that remain
+		/** Boxes are those used by the collision force of the viewer. Each iteration costs
+			O(N log N) (candidate pairs are found with a uniform grid). */
+		size_t remove_overlaps(size_t max_iterations = 100)
+		{
+			for(size_t i = 0; i < max_iterations; i++)
+				if(!grid.step(positions, heights)) return 0;
+			return grid.step(positions, heights, false);
+		}
+
+		/// Groups connected nodes into clusters, and clusters into clusters of a second level
+		/** Clusters are found by label propagation over the edges, in the order of the positions
+			(so that they are made of nodes close to each other), with at most max_size nodes per
+			cluster, and max_size clusters per cluster of the second level. Must be called after
+			compute(), which clears them. This runs in O(E log E).
+		*/
+		void compute_clusters(uint32_t max_size = 32)
+		{
+			const size_t n = heights.size();
+			std::vector<uint32_t> by_position(n);
+			for(uint32_t v = 0; v < n; v++) by_position[v] = v;
+			std::sort(by_position.begin(), by_position.end(), [&](uint32_t a, uint32_t b)
+			{
+				return positions[2 * a] != positions[2 * b] ? positions[2 * a] < positions[2 * b]
+					: positions[2 * a + 1] != positions[2 * b + 1] ? positions[2 * a + 1] < positions[2 * b + 1] : a < b;
+			});
+			node_clusters = detail::propagate_labels(by_position, max_size, [&](uint32_t v, const auto& f)
+			{
+				for(uint32_t e = successors.offset[v]; e < successors.offset[v + 1]; e++) f(successors.nodes[e]);
+				for(uint32_t e = predecessors.offset[v]; e < predecessors.offset[v + 1]; e++) f(predecessors.nodes[e]);
+			});
+
+			// Clusters are numbered in the order of the positions, as are their edges
+			const uint32_t count = n ? *std::max_element(node_clusters.begin(), node_clusters.end()) + 1 : 0;
+			std::vector<uint32_t> from, to;
+			for(size_t e = 0; e < edges_out.size(); e++)
+			{
+				const uint32_t a = node_clusters[edges_out[e]], b = node_clusters[edges_in[e]];
+				if(a == b) continue;
+				from.insert(from.end(), { a, b });
+				to.insert(to.end(), { b, a });
+			}
+			adjacency between;
+			between.build(count, from, to);
+			std::vector<uint32_t> clusters(count);
+			for(uint32_t c = 0; c < count; c++) clusters[c] = c;
+			cluster_parents = detail::propagate_labels(clusters, max_size, [&](uint32_t c, const auto& f)
+			{
+				for(uint32_t e = between.offset[c]; e < between.offset[c + 1]; e++) f(between.nodes[e]);
+			});
+		}
+		/// Cluster of a node, if compute_clusters() was called
+		size_t cluster(size_t node) const { return node_clusters[node]; }
+		/// Cluster of the second level of a cluster
+		size_t parent_cluster(size_t cluster) const { return cluster_parents[cluster]; }
+		/// Number of clusters, 0 if there are none
+		size_t cluster_count() const { return cluster_parents.size(); }
+
+		size_t size() const { return heights.size(); }
+		float x(size_t node) const { return positions[2 * node]; }
+		float y(size_t node) const { return positions[2 * node + 1]; }
+		uint32_t layer(size_t node) const { return layers[node]; }
+		float height(size_t node) const { return heights[node]; }
+		void set_position(size_t node, float x, float y)
+		{
+			positions.resize(2 * heights.size());
+			positions[2 * node] = x;
+			positions[2 * node + 1] = y;
+		}
+
+		/// Distance between two consecutive layers
+		float horizontal_spacing = 1.6f * detail::flow_graph_metrics::node_width;
+		/// Minimum vertical space between two nodes of the same layer
+		float vertical_spacing = 2 * detail::flow_graph_metrics::slot_height;
+
+	private:
+		// Compressed sparse rows: neighbours of v are in [offset[v], offset[v + 1])
+		struct adjacency
+		{
+			std::vector<uint32_t> offset, nodes;
+			std::vector<uint8_t> back;
+
+			void build(size_t n, const std::vector<uint32_t>& from, const std::vector<uint32_t>& to)
+			{
+				offset.assign(n + 1, 0);
+				for(uint32_t v : from) offset[v + 1]++;
+				for(size_t v = 0; v < n; v++) offset[v + 1] += offset[v];
+				nodes.resize(from.size());
+				back.assign(from.size(), 0);
+				std::vector<uint32_t> cursor(offset.begin(), offset.end() - 1);
+				for(size_t e = 0; e < from.size(); e++) nodes[cursor[from[e]]++] = to[e];
+			}
+		};
+
+		void clear_clusters()
+		{
+			node_clusters.clear();
+			cluster_parents.clear();
+		}
+		void build_adjacency()
+		{
+			successors.build(heights.size(), edges_out, edges_in);
+			predecessors.build(heights.size(), edges_in, edges_out);
+		}
+
+		// Ranks layers, orders and stacks them
+		void layout_all()
+		{
+			const size_t n = heights.size();
+			rank_nodes();
+			order_layers();
+			place_nodes();
+
+			positions.resize(2 * n);
+			const float x_center = float(layer_count - 1) / 2.f;
+			for(size_t v = 0; v < n; v++)
+			{
+				positions[2 * v] = (float(layers[v]) - x_center) * horizontal_spacing;
+				positions[2 * v + 1] = tops[v];
+			}
+		}
+
+		// Keys of the nodes, those that are repeated being mixed with their rank (0 for no key)
+		std::vector<uint64_t> unique_keys() const
+		{
+			const size_t n = heights.size();
+			std::vector<uint64_t> key(n, 0);
+			std::copy(keys.begin(), keys.begin() + std::min(keys.size(), n), key.begin());
+			std::vector<uint32_t> by_key(n);
+			for(uint32_t v = 0; v < n; v++) by_key[v] = v;
+			std::stable_sort(by_key.begin(), by_key.end(), [&](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+			std::vector<uint64_t> unique = key;
+			for(size_t i = 1, rank = 0; i < n; i++)
+			{
+				const uint64_t k = key[by_key[i]];
+				rank = k == key[by_key[i - 1]] ? rank + 1 : 0;
+				if(rank && k) unique[by_key[i]] = (k ^ (rank * 0x9E3779B97F4A7C15ull)) | 1;
+			}
+			return unique;
+		}
+
+		// Places the nodes that are not, next to those that are
+		void layout_around(std::vector<uint8_t>& placed)
+		{
+			const size_t n = heights.size();
+
+			// Columns of placed nodes, as wide as the boxes of the overlap removal: nodes can only
+			// overlap those of the same or next columns
+			using m = detail::flow_graph_metrics;
+			const float margin_x = m::node_padding + 2 * m::slot_radius, margin_y = m::node_padding + m::slot_radius;
+			const float column_width = m::node_width + 2 * margin_x;
+			std::unordered_map<int64_t, std::vector<uint32_t>> columns;
+			const auto column = [&](float x) { return int64_t(std::floor(x / column_width)); };
+			for(uint32_t v = 0; v < n; v++)
+				if(placed[v] == 1) columns[column(positions[2 * v])].push_back(v);
+
+			// Free position closest to y: outside of the ranges where v would overlap a node
+			std::vector<std::pair<float, float>> taken;
+			const auto place = [&](uint32_t v, float x, float y)
+			{
+				taken.clear();
+				for(int64_t c = column(x) - 1; c <= column(x) + 1; c++)
+				{
+					const auto it = columns.find(c);
+					if(it == columns.end()) continue;
+					for(uint32_t w : it->second)
+						if(std::abs(positions[2 * w] - x) < column_width)
+							taken.emplace_back(positions[2 * w + 1] - heights[v] - 2 * margin_y, positions[2 * w + 1] + heights[w] + 2 * margin_y);
+				}
+				std::sort(taken.begin(), taken.end());
+				for(size_t i = 0; i < taken.size(); i++)
+				{
+					float first = taken[i].first, last = taken[i].second;
+					for(; i + 1 < taken.size() && taken[i + 1].first < last; i++) last = std::max(last, taken[i + 1].second);
+					if(y > first && y < last) y = y - first < last - y ? first : last;
+				}
+				positions[2 * v] = x;
+				positions[2 * v + 1] = y;
+				columns[column(x)].push_back(v);
+			};
+
+			// Breadth first from the placed nodes: right of the predecessors, else left of the
+			// successors, at the height of the neighbours (0: free, 1: placed, 2: queued)
+			std::vector<uint32_t> queue;
+			const auto enqueue_neighbours = [&](uint32_t v)
+			{
+				for(const adjacency* a : { &successors, &predecessors })
+					for(uint32_t e = a->offset[v]; e < a->offset[v + 1]; e++)
+						if(!placed[a->nodes[e]])
+						{
+							placed[a->nodes[e]] = 2;
+							queue.push_back(a->nodes[e]);
+						}
+			};
+			for(uint32_t v = 0; v < n; v++)
+				if(placed[v] == 1) enqueue_neighbours(v);
+			for(size_t i = 0; i < queue.size(); i++)
+			{
+				const uint32_t v = queue[i];
+				float before = -std::numeric_limits<float>::infinity(), after = std::numeric_limits<float>::infinity(), center = 0;
+				uint32_t count = 0;
+				for(uint32_t e = predecessors.offset[v]; e < predecessors.offset[v + 1]; e++)
+				{
+					const uint32_t w = predecessors.nodes[e];
+					if(placed[w] != 1) continue;
+					before = std::max(before, positions[2 * w]);
+					center += positions[2 * w + 1] + heights[w] / 2.f;
+					count++;
+				}
+				for(uint32_t e = successors.offset[v]; e < successors.offset[v + 1]; e++)
+				{
+					const uint32_t w = successors.nodes[e];
+					if(placed[w] != 1) continue;
+					after = std::min(after, positions[2 * w]);
+					center += positions[2 * w + 1] + heights[w] / 2.f;
+					count++;
+				}
+				place(v, before > -std::numeric_limits<float>::infinity() ? before + horizontal_spacing : after - horizontal_spacing,
+					center / float(count) - heights[v] / 2.f);
+				placed[v] = 1;
+				enqueue_neighbours(v);
+			}
+
+			// Nodes not connected to any placed node: laid out on their own, below the others
+			std::vector<uint32_t> rest, index(n, uint32_t(-1));
+			float bottom = -std::numeric_limits<float>::infinity();
+			for(uint32_t v = 0; v < n; v++)
+			{
+				if(placed[v]) bottom = std::max(bottom, positions[2 * v + 1] + heights[v]);
+				else
+				{
+					index[v] = uint32_t(rest.size());
+					rest.push_back(v);
+				}
+			}
+			if(!rest.empty())
+			{
+				flow_graph_layout apart;
+				apart.horizontal_spacing = horizontal_spacing;
+				apart.vertical_spacing = vertical_spacing;
+				for(uint32_t v : rest) apart.add_node(heights[v]);
+				for(size_t e = 0; e < edges_out.size(); e++)
+					if(!placed[edges_out[e]]) apart.add_edge(index[edges_out[e]], index[edges_in[e]]);
+				apart.compute();
+				float top = std::numeric_limits<float>::infinity();
+				for(size_t i = 0; i < rest.size(); i++) top = std::min(top, apart.y(i));
+				for(size_t i = 0; i < rest.size(); i++)
+				{
+					positions[2 * rest[i]] = apart.x(i);
+					positions[2 * rest[i] + 1] = apart.y(i) - top + bottom + 4 * vertical_spacing;
+				}
+			}
+
+			// Layers, from the columns
+			float left = std::numeric_limits<float>::infinity();
+			for(size_t v = 0; v < n; v++) left = std::min(left, positions[2 * v]);
+			layers.resize(n);
+			layer_count = 0;
+			for(size_t v = 0; v < n; v++)
+			{
+				layers[v] = uint32_t(std::lround((positions[2 * v] - left) / horizontal_spacing));
+				layer_count = std::max(layer_count, size_t(layers[v]) + 1);
+			}
+		}
+
+		void rank_nodes()
+		{
+			const uint32_t n = uint32_t(heights.size());
+
+			// Break cycles: edges going back to a node on the current DFS path are ignored
+			std::vector<uint8_t> state(n, 0);
+			std::vector<std::pair<uint32_t, uint32_t>> stack;
+			std::vector<uint32_t> in_degree(n, 0);
+			for(uint32_t root = 0; root < n; root++)
+			{
+				if(state[root]) continue;
+				state[root] = 1;
+				stack.emplace_back(root, successors.offset[root]);
+				while(!stack.empty())
+				{
+					auto& top = stack.back();
+					if(top.second == successors.offset[top.first + 1])
+					{
+						state[top.first] = 2;
+						stack.pop_back();
+						continue;
+					}
+					const uint32_t e = top.second++, w = successors.nodes[e];
+					if(state[w] == 1)
+						successors.back[e] = 1;
+					else
+					{
+						in_degree[w]++;
+						if(state[w] == 0)
+						{
+							state[w] = 1;
+							stack.emplace_back(w, successors.offset[w]);
+						}
+					}
+				}
+			}
+
+			// Longest path from the sources, in topological order
+			order.clear();
+			order.reserve(n);
+			for(uint32_t v = 0; v < n; v++)
+				if(!in_degree[v]) order.push_back(v);
+			layers.assign(n, 0);
+			for(size_t i = 0; i < order.size(); i++)
+			{
+				const uint32_t v = order[i];
+				for(uint32_t e = successors.offset[v]; e < successors.offset[v + 1]; e++)
+				{
+					if(successors.back[e]) continue;
+					const uint32_t w = successors.nodes[e];
+					layers[w] = std::max(layers[w], layers[v] + 1);
+					if(!--in_degree[w]) order.push_back(w);
+				}
+			}
+
+			// Sources are moved next to their closest successor
+			for(size_t i = order.size(); i-- > 0;)
+			{
+				const uint32_t v = order[i];
+				if(predecessors.offset[v] != predecessors.offset[v + 1]) continue;
+				uint32_t closest = uint32_t(-1);
+				for(uint32_t e = successors.offset[v]; e < successors.offset[v + 1]; e++)
+					if(!successors.back[e]) closest = std::min(closest, layers[successors.nodes[e]]);
+				if(closest != uint32_t(-1)) layers[v] = closest - 1;
+			}
+
+			layer_count = 0;
+			for(uint32_t v = 0; v < n; v++) layer_count = std::max(layer_count, size_t(layers[v]) + 1);
+		}
+
+		void order_layers()
+		{
+			const uint32_t n = uint32_t(heights.size());
+
+			// Nodes bucketed by layer, initially in topological order
+			layer_offset.assign(layer_count + 1, 0);
+			for(uint32_t v = 0; v < n; v++) layer_offset[layers[v] + 1]++;
+			for(size_t l = 0; l < layer_count; l++) layer_offset[l + 1] += layer_offset[l];
+			layer_nodes.resize(n);
+			std::vector<uint32_t> cursor(layer_offset.begin(), layer_offset.end() - 1);
+			for(uint32_t v : order) layer_nodes[cursor[layers[v]]++] = v;
+			position.resize(n);
+			update_positions(0, layer_count);
+
+			// Barycenter heuristic, alternating sweeps towards the right and towards the left. Nodes
+			// are sorted by (barycenter, rank in the layer), which keeps ties in order like a stable
+			// sort, in a buffer sized once for the biggest layer
+			struct sort_key
+			{
+				float barycenter;
+				uint32_t rank, node;
+				bool operator<(const sort_key& k) const { return barycenter != k.barycenter ? barycenter < k.barycenter : rank < k.rank; }
+			};
+			uint32_t widest = 0;
+			for(size_t l = 0; l < layer_count; l++) widest = std::max(widest, layer_offset[l + 1] - layer_offset[l]);
+			std::vector<sort_key> keys(widest);
+			for(int sweep = 0; sweep < 8; sweep++)
+			{
+				const bool right = sweep % 2 == 0;
+				const adjacency& neighbours = right ? predecessors : successors;
+				for(size_t i = 1; i < layer_count; i++)
+				{
+					const size_t l = right ? i : layer_count - 1 - i;
+					uint32_t* begin = layer_nodes.data() + layer_offset[l];
+					const uint32_t count = layer_offset[l + 1] - layer_offset[l];
+					if(count < 2) continue;
+					for(uint32_t k = 0; k < count; k++)
+					{
+						const uint32_t v = begin[k];
+						float sum = 0;
+						uint32_t used = 0;
+						for(uint32_t e = neighbours.offset[v]; e < neighbours.offset[v + 1]; e++)
+						{
+							const uint32_t w = neighbours.nodes[e];
+							if(right ? layers[w] < l : layers[w] > l)
+							{
+								sum += position[w];
+								used++;
+							}
+						}
+						keys[k] = { used ? sum / float(used) : position[v], k, v };
+					}
+					std::sort(keys.begin(), keys.begin() + count);
+					for(uint32_t k = 0; k < count; k++) begin[k] = keys[k].node;
+					update_positions(l, l + 1);
+				}
+			}
+		}
+
+		// Relative position of each node in its layer, in [0, 1]
+		void update_positions(size_t first, size_t last)
+		{
+			for(size_t l = first; l < last; l++)
+			{
+				const uint32_t count = layer_offset[l + 1] - layer_offset[l];
+				for(uint32_t i = 0; i < count; i++)
+					position[layer_nodes[layer_offset[l] + i]] = (float(i) + 0.5f) / float(count);
+			}
+		}
+
+		void place_nodes()
+		{
+			const uint32_t n = uint32_t(heights.size());
+			tops.assign(n, 0.f);
+
+			// Stack each layer, centered on 0
+			for(size_t l = 0; l < layer_count; l++)
+			{
+				float top = 0;
+				for(uint32_t i = layer_offset[l]; i < layer_offset[l + 1]; i++)
+				{
+					tops[layer_nodes[i]] = top;
+					top += heights[layer_nodes[i]] + vertical_spacing;
+				}
+				const float shift = (top - vertical_spacing) / 2.f;
+				for(uint32_t i = layer_offset[l]; i < layer_offset[l + 1]; i++)
+					tops[layer_nodes[i]] -= shift;
+			}
+
+			// Move nodes towards the center of their predecessors (then successors), keeping order
+			std::vector<float> wanted(n);
+			for(int pass = 0; pass < 2; pass++)
+			{
+				const adjacency& neighbours = pass == 0 ? predecessors : successors;
+				for(size_t i = 0; i < layer_count; i++)
+				{
+					const size_t l = pass == 0 ? i : layer_count - 1 - i;
+					const uint32_t first = layer_offset[l], last = layer_offset[l + 1];
+					float offset = 0;
+					for(uint32_t k = first; k < last; k++)
+					{
+						const uint32_t v = layer_nodes[k];
+						float sum = 0;
+						uint32_t count = 0;
+						for(uint32_t e = neighbours.offset[v]; e < neighbours.offset[v + 1]; e++)
+						{
+							const uint32_t w = neighbours.nodes[e];
+							if(layers[w] != l)
+							{
+								sum += tops[w] + heights[w] / 2.f;
+								count++;
+							}
+						}
+						wanted[v] = count ? sum / float(count) - heights[v] / 2.f : tops[v];
+						const float min_y = k == first ? -std::numeric_limits<float>::infinity()
+							: tops[layer_nodes[k - 1]] + heights[layer_nodes[k - 1]] + vertical_spacing;
+						tops[v] = std::max(wanted[v], min_y);
+						offset += wanted[v] - tops[v];
+					}
+					// Nodes are only pushed downwards, so the whole layer is moved back up
+					if(last > first)
+					{
+						offset /= float(last - first);
+						for(uint32_t k = first; k < last; k++) tops[layer_nodes[k]] += offset;
+					}
+				}
+			}
+		}
+
+		std::vector<float> heights;
+		std::vector<uint64_t> keys;	// Only up to the last node given one
+		std::vector<uint32_t> edges_out, edges_in;
+		adjacency successors, predecessors;
+		std::vector<uint32_t> order, layers, layer_offset, layer_nodes;
+		std::vector<float> position, tops, positions;
+		std::vector<uint32_t> node_clusters, cluster_parents;
+		size_t layer_count = 0;
+		detail::overlap_grid grid;
+	};
+
+namespace detail
+{
+	// Layout of write_flow_graph, through the cache file of the options if any, and clusters of
+	// big graphs without groups
+	// Returns false if options.layout_cache could not be written
+	inline bool compute_layout(flow_graph_layout& layout, const flow_graph_options& options, bool grouped)
+	{
+		bool saved = true;
+		if(options.layout_cache.empty()) layout.compute();
+		else
+		{
+			flow_graph_layout_cache cache;
+			cache.load(options.layout_cache);	// Missing or invalid: everything is laid out
+			layout.compute(cache);
+			saved = cache.save(options.layout_cache);
+		}
+		if(!grouped && layout.size() > options.cluster_threshold) layout.compute_clusters();
+		return saved;
+	}
+	template<typename T>
+	void add_layout_node(flow_graph_layout& layout, const T& name, float height, const flow_graph_options& options)
+	{
+		if(!options.layout) return;
+		const size_t v = layout.add_node(height);
+		if(!options.layout_cache.empty()) layout.set_key(v, text_hash()(name).value);
+	}
+
+#if defined(DEBUGVIZ_SEPARATE)
+	// Defined once, where DEBUGVIZ_IMPLEMENTATION is
+%FLOW_GRAPH_HTML_DECLARATIONS%
+#endif
+#if !defined(DEBUGVIZ_SEPARATE) || defined(DEBUGVIZ_IMPLEMENTATION)
+%FLOW_GRAPH_HTML%
+#endif
+
+	// Json values of the writers
+	template<typename B, typename S, typename T>
+	void write_json_string(B& b, S& s, const T& v)
+	{
+		b.write('"');
+		write_text<json_escape>(b, s, v);
+		b.write('"');
+	}
+	template<typename B, typename S, typename R>
+	void write_json_strings(B& b, S& s, const R& r)
+	{
+		bool first = true;
+		for(const auto& v : r)
+		{
+			if(!first) b.write(',');
+			write_json_string(b, s, v);
+			first = false;
+		}
+	}
+	// Present measures as json fields, integral values without decimals
+	template<typename B, typename S>
+	void write_json_measures(B& b, S& s, const flow_graph_measures& m, bool first)
+	{
+		const std::pair<const char*, double> fields[] = { { "\"time_ns\":", m.time_ns }, { "\"count\":", m.count }, { "\"bytes\":", m.bytes } };
+		for(const auto& f : fields)
+		{
+			if(!std::isfinite(f.second)) continue;
+			if(!first) b.write(',');
+			first = false;
+			b.write(f.first, std::strlen(f.first));
+			if(f.second == std::floor(f.second) && std::fabs(f.second) < 9007199254740992.0)
+				write_text(b, s, static_cast<long long>(f.second));
+			else
+				write_text(b, s, f.second);
+		}
+	}
+	template<typename B, typename S, typename N, typename I, typename O>
+	void write_json_node(B& b, S& s, const N& name, const I& inputs, const O& outputs, const flow_graph_measures& measures,
+		const std::string& group)
+	{
+		b.literal("{\"name\":");
+		write_json_string(b, s, name);
+		b.literal(",\"inputs\":[");
+		write_json_strings(b, s, inputs);
+		b.literal("],\"outputs\":[");
+		write_json_strings(b, s, outputs);
+		b.write(']');
+		if(!group.empty())
+		{
+			b.literal(",\"group\":");
+			write_json_string(b, s, group);
+		}
+		write_json_measures(b, s, measures, false);
+		b.write('}');
+	}
+	// Connection endpoints are indices, or names resolved by the viewer
+	template<typename B, typename S, typename T>
+	void write_json_endpoint(B& b, S& s, const T& index, std::true_type) { write_text(b, s, index); }
+	template<typename B, typename S, typename T>
+	void write_json_endpoint(B& b, S& s, const T& name, std::false_type) { write_json_string(b, s, name); }
+	template<typename B, typename S, typename O, typename OS, typename I, typename IS>
+	void write_json_connection(B& b, S& s, const O& out, const OS& out_slot, const I& in, const IS& in_slot,
+		const flow_graph_measures& measures)
+	{
+		b.write('[');
+		write_json_endpoint(b, s, out, is_index<O>());
+		b.write(',');
+		write_json_endpoint(b, s, out_slot, is_index<OS>());
+		b.write(',');
+		write_json_endpoint(b, s, in, is_index<I>());
+		b.write(',');
+		write_json_endpoint(b, s, in_slot, is_index<IS>());
+		if(!measures.empty())
+		{
+			b.literal(",{");
+			write_json_measures(b, s, measures, true);
+			b.write('}');
+		}
+		b.write(']');
+	}
+	// Positions, rounded, as a flat array of x and y; then clusters of the nodes and of the clusters
+	template<typename B, typename S>
+	void write_json_layout(B& b, S& s, const flow_graph_layout& layout)
+	{
+		b.literal(",\"layout\":[");
+		for(size_t i = 0; i < layout.size(); i++)
+		{
+			if(i) b.write(',');
+			write_text(b, s, std::lround(layout.x(i)));
+			b.write(',');
+			write_text(b, s, std::lround(layout.y(i)));
+		}
+		b.write(']');
+		if(!layout.cluster_count()) return;
+		b.literal(",\"clusters\":[");
+		for(size_t i = 0; i < layout.size(); i++)
+		{
+			if(i) b.write(',');
+			write_text(b, s, layout.cluster(i));
+		}
+		b.literal("],\"cluster_parents\":[");
+		for(size_t i = 0; i < layout.cluster_count(); i++)
+		{
+			if(i) b.write(',');
+			write_text(b, s, layout.parent_cluster(i));
+		}
+		b.write(']');
+	}
+
+	// Document around a graph (see flow_graph_document) for the writers: the graph itself is
+	// either json text, written directly or through the compressor, or an encoded payload.
+	//  - page: the viewer, then setup_graph_rendering({..}), or the id of an inert element
+	//    holding the encoded or compressed payload, and 'canvas' as second argument for the
+	//    canvas renderer
+	//  - data files hold one json object: {"title":..,"payload":..,"graph":{..}} or, for encoded
+	//    payloads, {"title":..,"payload":..,"compression":..,"data":"base64"}, with a
+	//    "renderer":"canvas" field for the canvas renderer; scripts pass it to flow_graph_data_file()
+	template<typename S>
+	class flow_graph_output
+	{
+	public:
+		using buffer_type = typename buffer_of<S>::type;
+
+		flow_graph_output(S& stream, const flow_graph_options& options, size_t buffer_size) :
+			stream(stream), document(options.document), encoded(options.payload == flow_graph_payload::binary),
+			canvas(options.renderer == flow_graph_renderer::canvas), buffer(stream, buffer_size),
+			compressed(options.compression == flow_graph_compression::deflate ? new compressed_output<buffer_type>(buffer) : nullptr) {}
+
+		// Everything before the graph
+		template<typename T>
+		void begin(const T& title)
+		{
+			if(document != flow_graph_document::page)
+			{
+				if(document == flow_graph_document::script) buffer.literal("flow_graph_data_file(");
+				buffer.literal("{\"title\":\"");
+				write_text<json_escape>(buffer, stream, title);
+				if(encoded) buffer.literal("\",\"payload\":\"binary\"");
+				else buffer.literal("\",\"payload\":\"json\"");
+				if(compressed) buffer.literal(",\"compression\":\"deflate\"");
+				if(canvas) buffer.literal(",\"renderer\":\"canvas\"");
+				if(encoded || compressed) buffer.literal(",\"data\":\"");
+				else buffer.literal(",\"graph\":");
+				return;
+			}
+			buffer.literal(flow_graph_html_head);
+			write_text<html_escape>(buffer, stream, title);
+			buffer.literal(flow_graph_html_body);
+			if(encoded || compressed)
+			{
+				// The viewer is given the id of an inert element holding the payload
+				buffer.literal("'flow-graph-data'");
+				renderer();
+				buffer.literal(flow_graph_html_tail);
+				buffer.literal("<script type='application/octet-stream' id='flow-graph-data'");
+				if(encoded) buffer.literal(" data-payload='binary'");
+				else buffer.literal(" data-payload='json'");
+				if(compressed) buffer.literal(" data-compression='deflate'");
+				buffer.write('>');
+			}
+		}
+
+		// Json text goes either directly into the output, or into the compressor (then values
+		// that can only be streamed into the output stream are dropped)
+		template<typename F>
+		void json(F f)
+		{
+			discard_stream none;
+			if(compressed) f(compressed->text(), none);
+			else f(buffer, stream);
+		}
+
+		// Encoded payload, from an object with an 'encode(out, layout)' member (see binary_payload)
+		template<typename P, typename L>
+		void encode(const P& payload, const L* layout)
+		{
+			if(compressed) return payload.encode(*compressed, layout);
+			base64_writer<buffer_type> out(buffer);
+			payload.encode(out, layout);
+			out.finish();
+		}
+
+		// Everything after the graph, then flushes the output
+		void end()
+		{
+			if(compressed) compressed->finish();
+			if(document != flow_graph_document::page)
+			{
+				if(encoded || compressed) buffer.write('"');
+				buffer.write('}');
+				if(document == flow_graph_document::script) buffer.literal(");\n");
+			}
+			else if(encoded || compressed) buffer.literal("</script>");
+			else
+			{
+				renderer();
+				buffer.literal(flow_graph_html_tail);
+			}
+			buffer.flush();
+		}
+
+	private:
+		// Second argument of setup_graph_rendering
+		void renderer()
+		{
+			if(canvas) buffer.literal(",'canvas'");
+		}
+
+		S& stream;
+		const flow_graph_document document;
+		const bool encoded, canvas;
+		buffer_type buffer;
+		const std::unique_ptr<compressed_output<buffer_type>> compressed;
+	};
+}
+
+	/// Incremental flow graph serializer
+	/** Produces the same html page as write_flow_graph, but nodes and connections are given one at
+		a time instead of as ranges, so that a graph can be serialized while it is being traversed,
+		without materializing it. The output goes through a fixed-size buffer: memory usage does
+		not depend on the size of the graph.
+
+		Nodes and connections can be interleaved. Nodes are numbered in the order in which they are
+		added, and connection endpoints are either such indices (integers) or names, which are
+		then resolved by the viewer (so they can also refer to nodes that are added later).
+
+		The title is kept by reference until begin() is called. If the writer is destroyed after
+		begin() but before finish(), the page is finished by the destructor, which ignores any
+		exception thrown by the stream: call finish() explicitly to get errors.
+
+		With a buffer_sink, the writer has no buffer of its own (buffer_size is ignored).
+
+		With flow_graph_payload::binary, nodes and connections are kept as compact arrays (names
+		stored once) until finish(), which encodes them. With flow_graph_compression::deflate, the
+		payload is compressed as it is written, with a fixed amount of memory.
+
+		\see write_flow_graph for the requirements on titles, names and slots.
+	*/
+	template<typename S>
+	class flow_graph_writer
+	{
+	public:
+		static constexpr size_t default_buffer_size = 64 * 1024;
+
+		template<typename T>
+		flow_graph_writer(S& stream, const T& title, size_t buffer_size = default_buffer_size) :
+			flow_graph_writer(stream, title, flow_graph_options(), buffer_size) {}
+		template<typename T>
+		flow_graph_writer(S& stream, const T& title, const flow_graph_options& options, size_t buffer_size = default_buffer_size) :
+			title(&title), begin_output(&begin_with_title<T>), output(stream, options, buffer_size),
+			binary(options.payload == flow_graph_payload::binary ? new detail::binary_payload : nullptr) {}
+		flow_graph_writer(const flow_graph_writer&) = delete;
+		flow_graph_writer& operator=(const flow_graph_writer&) = delete;
+		~flow_graph_writer()
+		{
+			if(state != idle && state != finished)
+				try { finish(); } catch(...) {}
+		}
+
+		/// Starts the page, must be called before adding nodes and connections
+		void begin()
+		{
+			begin_output(output, title);
+			if(!binary) output.json([](auto& b, auto&) { b.literal("{\"nodes\":["); });
+			state = in_nodes;
+			first = true;
+		}
+
+		/// Adds a node, with a streamable name and ranges of streamable input and output slots
+		/** The group, if streamable into a std::ostream and not empty, is shown by the viewer as a
+			box holding the nodes of the group, collapsed when zoomed out.
+		*/
+		template<typename N, typename I, typename O, typename G = std::string>
+		void add_node(const N& name, const I& inputs, const O& outputs, const flow_graph_measures& measures = flow_graph_measures(),
+			const G& group = G())
+		{
+			add_grouped_node(name, inputs, outputs, measures, detail::text_of(group));
+		}
+
+		/// Adds a connection; endpoints are either indices (integers) or streamable names
+		template<typename O, typename OS, typename I, typename IS>
+		void add_connection(const O& out, const OS& out_slot, const I& in, const IS& in_slot,
+			const flow_graph_measures& measures = flow_graph_measures())
+		{
+			if(binary) return binary->add_connection(out, out_slot, in, in_slot, measures);
+			output.json([&](auto& b, auto& s)
+			{
+				if(state == in_nodes)
+				{
+					b.literal("],\"connections\":[");
+					state = in_connections;
+					first = true;
+				}
+				separator(b);
+				detail::write_json_connection(b, s, out, out_slot, in, in_slot, measures);
+			});
+		}
+
+		/// Ends the page and flushes everything into the stream
+		void finish()
+		{
+			if(binary) output.encode(*binary, static_cast<const flow_graph_layout*>(nullptr));
+			else output.json([&](auto& b, auto&)
+			{
+				end_connections(b);
+				b.write('}');
+			});
+			end_page();
+		}
+
+		/// Same as finish, but also writes precomputed positions so that the viewer does not layout
+		void finish(const flow_graph_layout& layout)
+		{
+			if(binary) output.encode(*binary, &layout);
+			else output.json([&](auto& b, auto& s)
+			{
+				end_connections(b);
+				detail::write_json_layout(b, s, layout);
+				b.write('}');
+			});
+			end_page();
+		}
+
+	private:
+		template<typename T>
+		static void begin_with_title(detail::flow_graph_output<S>& output, const void* title)
+		{
+			output.begin(*static_cast<const T*>(title));
+		}
+
+		template<typename N, typename I, typename O>
+		void add_grouped_node(const N& name, const I& inputs, const O& outputs, const flow_graph_measures& measures,
+			const std::string& group)
+		{
+			if(binary) return binary->add_node(name, inputs, outputs, measures, group);
+			output.json([&](auto& b, auto& s)
+			{
+				separator(b);
+				detail::write_json_node(b, s, name, inputs, outputs, measures, group);
+			});
+		}
+		template<typename B>
+		void end_connections(B& b)
+		{
+			if(state == in_nodes) b.literal("],\"connections\":[");
+			b.write(']');
+		}
+		void end_page()
+		{
+			output.end();
+			state = finished;
+		}
+		template<typename B>
+		void separator(B& b)
+		{
+			if(!first) b.write(',');
+			first = false;
+		}
+
+		enum { idle, in_nodes, in_connections, finished } state = idle;
+		bool first = true;
+		const void* title;
+		void (*begin_output)(detail::flow_graph_output<S>&, const void*);
+		detail::flow_graph_output<S> output;
+		std::unique_ptr<detail::binary_payload> binary;
+	};
+
+namespace detail
+{
+	// Calls f(i) for i in [0, count), from 'threads' threads (the caller being one of them)
+	template<typename F>
+	void parallel_for(unsigned threads, size_t count, const F& f)
+	{
+		std::atomic<size_t> next(0);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		const auto work = [&]
+		{
+			try
+			{
+				for(size_t i; (i = next.fetch_add(1)) < count;) f(i);
+			}
+			catch(...)
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if(!error) error = std::current_exception();
+				next = count;
+			}
+		};
+		std::vector<std::thread> pool;
+		for(size_t t = 1; t < threads && t < count; t++) pool.emplace_back(work);
+		work();
+		for(std::thread& t : pool) t.join();
+		if(error) std::rethrow_exception(error);
+	}
+
+	template<typename R, typename = void> struct is_random_access : std::false_type {};
+	template<typename R> struct is_random_access<R, std::enable_if_t<std::is_base_of<std::random_access_iterator_tag,
+		typename std::iterator_traits<decltype(std::begin(std::declval<const R&>()))>::iterator_category>::value>>
+		: std::true_type {};
+
+	// Chunks of nodes can be formatted apart if everything in them goes through a std::ostream
+	template<typename N, typename C, typename Node = decltype(*std::begin(std::declval<const N&>()))>
+	using parallel_writable = std::integral_constant<bool, is_random_access<N>::value && is_random_access<C>::value
+		&& is_streamable<std::ostream, decltype(no_cvref<Node>::name)>::value
+		&& is_streamable<std::ostream, decltype(*std::begin(std::declval<Node>().inputs))>::value
+		&& is_streamable<std::ostream, decltype(*std::begin(std::declval<Node>().outputs))>::value>;
+
+	constexpr size_t parallel_chunk = 4096;
+
+	// write_flow_graph for random-access ranges: chunks of nodes, then of connections, are
+	// formatted into buffers by a pool of threads and written in order, wave after wave, while
+	// the layout is computed on another thread. Connections given by name are resolved first,
+	// in parallel too. Returns false (having written nothing) when the graph is too small.
+	template<typename S, typename T, typename N, typename C, typename NodeNames, typename SlotNames>
+	bool write_flow_graph_parallel(S& stream, const T& title, const N& nodes, const C& connections,
+		const flow_graph_options& options, flow_graph_write_status& status, NodeNames node_names, SlotNames slot_names,
+		std::true_type)
+	{
+		const auto node_begin = std::begin(nodes);
+		const auto connection_begin = std::begin(connections);
+		const size_t node_count = size_t(std::end(nodes) - node_begin);
+		const size_t connection_count = size_t(std::end(connections) - connection_begin);
+		const unsigned threads = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+		if(threads < 2 || node_count + connection_count < 4 * parallel_chunk) return false;
+		const auto chunks = [](size_t count) { return (count + parallel_chunk - 1) / parallel_chunk; };
+
+		flow_graph_index index;
+		flow_graph_layout layout;
+		bool grouped = false;
+		for(size_t i = 0; i < node_count; i++)
+		{
+			const auto& n = node_begin[i];
+			index.add_node(n, node_names, slot_names);
+			add_layout_node(layout, n.name, flow_graph_metrics::node_height(range_size(n.inputs), range_size(n.outputs)), options);
+			grouped = grouped || !group_of(n).empty();
+		}
+
+		// Endpoints as indices, the first one being npos for connections that are skipped
+		using endpoints_type = std::array<size_t, 4>;
+		const auto resolve = [&](size_t i)
+		{
+			const auto& c = connection_begin[i];
+			endpoints_type e = { { index.node(c.out), 0, index.node(c.in), 0 } };
+			if(e[0] == index.npos || e[2] == index.npos) return endpoints_type{ { index.npos } };
+			e[1] = index.slot(e[0], 'o', c.out_slot);
+			e[3] = index.slot(e[2], 'i', c.in_slot);
+			if(e[1] == index.npos || e[3] == index.npos) e[0] = index.npos;
+			return e;
+		};
+		std::vector<endpoints_type> resolved;
+		if(node_names || slot_names)
+		{
+			resolved.resize(connection_count);
+			parallel_for(threads, chunks(connection_count), [&](size_t chunk)
+			{
+				for(size_t i = chunk * parallel_chunk; i < std::min(connection_count, (chunk + 1) * parallel_chunk); i++)
+					resolved[i] = resolve(i);
+			});
+		}
+		const auto endpoints = [&](size_t i) { return resolved.empty() ? resolve(i) : resolved[i]; };
+
+		std::exception_ptr layout_error;
+		std::thread layout_thread;
+		if(options.layout) layout_thread = std::thread([&]
+		{
+			try
+			{
+				for(size_t i = 0; i < connection_count; i++)
+				{
+					const endpoints_type e = endpoints(i);
+					if(e[0] != index.npos) layout.add_edge(e[0], e[2]);
+				}
+				status.layout_cache_saved = compute_layout(layout, options, grouped);
+			}
+			catch(...)
+			{
+				layout_error = std::current_exception();
+			}
+		});
+		const auto join_layout = [&] { if(layout_thread.joinable()) layout_thread.join(); };
+
+		flow_graph_output<S> output(stream, options, 64 * 1024);
+		std::vector<buffer_sink> buffers(4 * threads);
+		// Elements are written with a leading comma, dropped from the first one
+		const auto write_chunks = [&](size_t count, const auto& write_element)
+		{
+			bool first = true;
+			for(size_t wave = 0; wave < chunks(count); wave += buffers.size())
+			{
+				const size_t size = std::min(buffers.size(), chunks(count) - wave);
+				parallel_for(threads - 1, size, [&](size_t k)
+				{
+					buffer_sink& b = buffers[k];
+					discard_stream none;
+					b.clear();
+					for(size_t i = (wave + k) * parallel_chunk; i < std::min(count, (wave + k + 1) * parallel_chunk); i++)
+						write_element(b, none, i);
+				});
+				output.json([&](auto& b, auto&)
+				{
+					for(size_t k = 0; k < size; k++)
+					{
+						const size_t skip = first && buffers[k].size() ? 1 : 0;
+						b.write(buffers[k].data() + skip, buffers[k].size() - skip);
+						first = first && !skip;
+					}
+				});
+			}
+		};
+
+		try
+		{
+			output.begin(title);
+			output.json([](auto& b, auto&) { b.literal("{\"nodes\":["); });
+			write_chunks(node_count, [&](buffer_sink& b, discard_stream& s, size_t i)
+			{
+				const auto& n = node_begin[i];
+				b.write(',');
+				write_json_node(b, s, n.name, n.inputs, n.outputs, measures_of(n), group_of(n));
+			});
+			output.json([](auto& b, auto&) { b.literal("],\"connections\":["); });
+			write_chunks(connection_count, [&](buffer_sink& b, discard_stream& s, size_t i)
+			{
+				const endpoints_type e = endpoints(i);
+				if(e[0] == index.npos) return;
+				b.write(',');
+				write_json_connection(b, s, e[0], e[1], e[2], e[3], measures_of(connection_begin[i]));
+			});
+		}
+		catch(...)
+		{
+			join_layout();
+			throw;
+		}
+		join_layout();
+		if(layout_error) std::rethrow_exception(layout_error);
+
+		output.json([&](auto& b, auto& s)
+		{
+			b.write(']');
+			if(options.layout) write_json_layout(b, s, layout);
+			b.write('}');
+		});
+		output.end();
+		return true;
+	}
+	template<typename S, typename T, typename N, typename C, typename NodeNames, typename SlotNames>
+	bool write_flow_graph_parallel(S&, const T&, const N&, const C&, const flow_graph_options&, flow_graph_write_status&,
+		NodeNames, SlotNames, std::false_type)
+	{
+		return false;
+	}
+}
+
+namespace detail
+{
+	// Range of the values get(i) of an object, for i in [first, last)
+	template<typename O, typename V, V (O::*get)(size_t) const>
+	class indexed_range
+	{
+	public:
+		class iterator
+		{
+		public:
+			iterator(const O* owner, size_t i) : owner(owner), i(i) {}
+			V operator*() const { return (owner->*get)(i); }
+			bool operator!=(const iterator& it) const { return i != it.i; }
+			iterator& operator++() { i++; return *this; }
+
+		private:
+			const O* owner;
+			size_t i;
+		};
+
+		indexed_range(const O& owner, size_t first, size_t last) : owner(&owner), first(first), last(last) {}
+		iterator begin() const { return iterator(owner, first); }
+		iterator end() const { return iterator(owner, last); }
+		size_t size() const { return last - first; }
+
+	private:
+		const O* owner;
+		size_t first, last;
+	};
+}
+
+	class flow_graph_arena;
+
+namespace detail
+{
+	// Graph given in batches of nodes and connections (all nodes coming before any connection),
+	// the title being that of the first batch. Implemented over the ranges given to
+	// write_flow_graph, and read by the writer compiled apart (see DEBUGVIZ_SEPARATE).
+	class graph_source
+	{
+	public:
+		// Next batch, or null at the end (the first call always returns a batch)
+		virtual const flow_graph_arena* next() = 0;
+
+		// Whether connections refer to nodes or slots by name
+		const bool node_names, slot_names;
+
+	protected:
+		graph_source(bool node_names, bool slot_names) : node_names(node_names), slot_names(slot_names) {}
+		~graph_source() = default;
+	};
+
+	template<typename S>
+	bool write_batches(S& stream, graph_source& source, const flow_graph_options& options);
+	template<typename S>
+	void write_arena(S& stream, const flow_graph_arena& graph, const flow_graph_options& options,
+		flow_graph_write_status& status);
+}
+
+	/// Copy of a graph in a few flat arrays, to be written later or from another thread
+	/** capture() copies the title, names and slots one after the other into a single block of
+		text, that nodes and connections refer to by offsets: there is no allocation per node, and
+		taking the copy costs little more than copying the text. Connections given by name are
+		resolved, and the layout computed, only by write(), which produces the same document as
+		write_flow_graph on the original ranges.
+
+		The ranges have the requirements of write_flow_graph, except that title, names and slots
+		must be streamable into a std::ostream (they are formatted when captured). Measures and
+		group fields are copied too. capture() keeps the memory of the previous graph, so an arena
+		can be reused without allocating; a graph can also be built one element at a time, after
+		clear(). The text is limited to 4 GiB.
+	*/
+	class flow_graph_arena
+	{
+	public:
+		flow_graph_arena() : bounds(2, 0) {}
+		template<typename T, typename N, typename C>
+		flow_graph_arena(const T& title, const N& nodes, const C& connections) { capture(title, nodes, connections); }
+
+		/// Replaces the content of the arena by a copy of a graph
+		template<typename T, typename N, typename C>
+		void capture(const T& title, const N& nodes, const C& connections)
+		{
+			clear(title);
+			for(const auto& n : nodes) add_node(n);
+			for(const auto& c : connections) add_connection(c);
+		}
+
+		/// Empties the arena (keeping its memory) and sets the title
+		template<typename T>
+		void clear(const T& title)
+		{
+			text.clear();
+			bounds.assign(1, 0);
+			node_texts.clear();
+			endpoints.clear();
+			node_measures.clear();
+			connection_measures.clear();
+			node_groups.clear();
+			node_names = slot_names = false;
+			add_text(title);
+		}
+
+		/// Appends a copy of a node, with the fields required by write_flow_graph
+		template<typename Node>
+		void add_node(const Node& n)
+		{
+			static_assert(detail::streamable_name<std::ostream, Node>::value,
+				"Nodes must have a 'name' field that supports 'std::ostream << node.name'");
+			static_assert(detail::is_streamable<std::ostream, decltype(*std::begin(n.inputs))>::value,
+				"Node inputs slots must support 'std::ostream << slot'");
+			static_assert(detail::is_streamable<std::ostream, decltype(*std::begin(n.outputs))>::value,
+				"Node outputs slots must support 'std::ostream << slot'");
+
+			const uint32_t name = add_text(n.name);
+			for(const auto& s : n.inputs) add_text(s);
+			const uint32_t outputs = uint32_t(bounds.size() - 1);
+			for(const auto& s : n.outputs) add_text(s);
+			node_texts.push_back({ name, outputs, uint32_t(bounds.size() - 1) });
+			if(detail::has_measures<Node>::value)
+			{
+				node_measures.resize(node_texts.size() - 1);
+				node_measures.push_back(detail::measures_of(n));
+			}
+			if(detail::has_group<Node>::value)
+			{
+				node_groups.resize(node_texts.size() - 1, no_group);
+				node_groups.push_back(add_group(n, detail::has_group<Node>()));
+			}
+		}
+
+		/// Appends a copy of a connection, with the fields required by write_flow_graph
+		template<typename Connection>
+		void add_connection(const Connection& c)
+		{
+			static_assert(detail::index_out<Connection>::value || detail::is_streamable<std::ostream, decltype(c.out)>::value,
+				"Connections must have a 'out' field that supports 'std::ostream << connection.out'");
+			static_assert(detail::index_out_slot<Connection>::value || detail::is_streamable<std::ostream, decltype(c.out_slot)>::value,
+				"Connections must have a 'out_slot' field that supports 'std::ostream << connection.out_slot'");
+			static_assert(detail::index_in<Connection>::value || detail::is_streamable<std::ostream, decltype(c.in)>::value,
+				"Connections must have a 'in' field that supports 'std::ostream << connection.in'");
+			static_assert(detail::index_in_slot<Connection>::value || detail::is_streamable<std::ostream, decltype(c.in_slot)>::value,
+				"Connections must have a 'in_slot' field that supports 'std::ostream << connection.in_slot'");
+
+			node_names = node_names || !detail::index_out<Connection>::value || !detail::index_in<Connection>::value;
+			slot_names = slot_names || !detail::index_out_slot<Connection>::value || !detail::index_in_slot<Connection>::value;
+			endpoints.push_back(endpoint(c.out, detail::index_out<Connection>()));
+			endpoints.push_back(endpoint(c.out_slot, detail::index_out_slot<Connection>()));
+			endpoints.push_back(endpoint(c.in, detail::index_in<Connection>()));
+			endpoints.push_back(endpoint(c.in_slot, detail::index_in_slot<Connection>()));
+			if(detail::has_measures<Connection>::value)
+			{
+				connection_measures.resize(endpoints.size() / 4 - 1);
+				connection_measures.push_back(detail::measures_of(c));
+			}
+		}
+
+		/// Writes the graph as write_flow_graph would have written the captured ranges
+		template<typename S>
+		S& write(S& stream, const flow_graph_options& options = flow_graph_options()) const
+		{
+			flow_graph_write_status status;
+			return write(stream, options, status);
+		}
+		/// Same as write, also giving what the stream does not tell (see flow_graph_write_status)
+		template<typename S>
+		S& write(S& stream, const flow_graph_options& options, flow_graph_write_status& status) const
+		{
+			detail::write_arena(stream, *this, options, status);
+			return stream;
+		}
+
+		/// Text of the arena: the title, then the name, slots and group of each node, then endpoint names
+		detail::text_view text_at(size_t i) const { return { text.data() + bounds[i], bounds[i + 1] - bounds[i] }; }
+		using text_range = detail::indexed_range<flow_graph_arena, detail::text_view, &flow_graph_arena::text_at>;
+
+		/// Node, with the fields expected by write_flow_graph (measures are NaN, and the group
+		/// empty, if not captured)
+		struct node_view
+		{
+			detail::text_view name;
+			text_range inputs, outputs;
+			double time_ns, count, bytes;
+			detail::text_view group;
+		};
+		node_view node(size_t i) const
+		{
+			const node_texts_type& n = node_texts[i];
+			const flow_graph_measures m = i < node_measures.size() ? node_measures[i] : flow_graph_measures();
+			const detail::text_view group = i < node_groups.size() && node_groups[i] != no_group
+				? text_at(node_groups[i]) : detail::text_view{ text.data(), 0 };
+			return { text_at(n.name), text_range(*this, n.name + 1, n.outputs), text_range(*this, n.outputs, n.end),
+				m.time_ns, m.count, m.bytes, group };
+		}
+		using node_range = detail::indexed_range<flow_graph_arena, node_view, &flow_graph_arena::node>;
+
+		detail::text_view title() const { return text_at(0); }
+		node_range nodes() const { return node_range(*this, 0, node_texts.size()); }
+		size_t node_count() const { return node_texts.size(); }
+		size_t connection_count() const { return endpoints.size() / 4; }
+
+	private:
+		template<typename S>
+		friend bool detail::write_batches(S&, detail::graph_source&, const flow_graph_options&);
+		template<typename S>
+		friend void detail::write_arena(S&, const flow_graph_arena&, const flow_graph_options&, flow_graph_write_status&);
+
+		// Texts of a node: its name, then inputs up to 'outputs', then outputs up to 'end'
+		struct node_texts_type
+		{
+			uint32_t name, outputs, end;
+		};
+
+		// Endpoints are indices, or texts with name_flag; indices that do not fit are invalid
+		static constexpr uint32_t name_flag = 0x80000000u;
+		static constexpr uint32_t invalid = name_flag - 1;
+		static constexpr uint32_t no_group = ~0u;
+
+		template<typename T>
+		uint32_t add_text(const T& v)
+		{
+			detail::string_appender out{ text };
+			detail::discard_stream none;
+			detail::write_text(out, none, v);
+			bounds.push_back(uint32_t(text.size()));
+			return uint32_t(bounds.size() - 2);
+		}
+		// Groups are texts too, streamed into a std::ostream
+		template<typename Node>
+		uint32_t add_group(const Node& n, std::true_type) { return add_text(n.group); }
+		template<typename Node>
+		uint32_t add_group(const Node&, std::false_type) { return no_group; }
+		template<typename T>
+		uint32_t endpoint(const T& index, std::true_type)
+		{
+			return std::is_signed<T>::value && index < T(0) ? invalid
+				: uint64_t(index) < uint64_t(invalid) ? uint32_t(index) : invalid;
+		}
+		template<typename T>
+		uint32_t endpoint(const T& name, std::false_type) { return add_text(name) | name_flag; }
+
+		// Endpoints of a connection as indices, false if it is to be skipped; 'index' holds the
+		// nodes of all the batches of the graph, with their names if connections use them
+		bool resolve(size_t connection, const detail::flow_graph_index& index, size_t (&e)[4]) const
+		{
+			const uint32_t* c = &endpoints[4 * connection];
+			for(int k = 0; k < 4; k += 2)
+			{
+				if(c[k] & name_flag) e[k] = index.node(text_at(c[k] & ~name_flag));
+				else e[k] = c[k] < index.node_count() ? c[k] : index.npos;
+				if(e[k] == index.npos) return false;
+			}
+			for(int k = 1; k < 4; k += 2)
+			{
+				if(c[k] & name_flag) e[k] = index.slot(e[k - 1], k == 1 ? 'o' : 'i', text_at(c[k] & ~name_flag));
+				else e[k] = c[k] != invalid ? c[k] : index.npos;
+				if(e[k] == index.npos) return false;
+			}
+			return true;
+		}
+		flow_graph_measures measures(size_t connection) const
+		{
+			return connection < connection_measures.size() ? connection_measures[connection] : flow_graph_measures();
+		}
+
+		std::string text;
+		std::vector<uint32_t> bounds;	// Text i is [bounds[i], bounds[i + 1])
+		std::vector<node_texts_type> node_texts;
+		std::vector<uint32_t> endpoints;	// Four per connection
+		std::vector<flow_graph_measures> node_measures, connection_measures;	// Up to the last one captured
+		std::vector<uint32_t> node_groups;	// Texts, up to the last one captured
+		bool node_names = false, slot_names = false;
+	};
+
+namespace detail
+{
+	// Ranges given to write_flow_graph, copied a batch at a time
+	template<typename T, typename N, typename C>
+	class range_source final : public graph_source
+	{
+	public:
+		static constexpr size_t batch_size = 4096;
+
+		range_source(const T& title, const N& nodes, const C& connections) :
+			graph_source(!index_out<connection_type>::value || !index_in<connection_type>::value,
+				!index_out_slot<connection_type>::value || !index_in_slot<connection_type>::value),
+			title(title), node(std::begin(nodes)), node_end(std::end(nodes)),
+			connection(std::begin(connections)), connection_end(std::end(connections)) {}
+
+		const flow_graph_arena* next() override
+		{
+			batch.clear(title);
+			for(size_t i = 0; i < batch_size && node != node_end; i++, ++node) batch.add_node(*node);
+			if(!(node != node_end))
+				for(size_t i = batch.node_count(); i < batch_size && connection != connection_end; i++, ++connection)
+					batch.add_connection(*connection);
+			if(started && !batch.node_count() && !batch.connection_count()) return nullptr;
+			started = true;
+			return &batch;
+		}
+
+	private:
+		using connection_type = decltype(*std::begin(std::declval<const C&>()));
+
+		const T& title;
+		decltype(std::begin(std::declval<const N&>())) node;
+		const decltype(std::end(std::declval<const N&>())) node_end;
+		decltype(std::begin(std::declval<const C&>())) connection;
+		const decltype(std::end(std::declval<const C&>())) connection_end;
+		flow_graph_arena batch;
+		bool started = false;
+	};
+
+	// A whole arena as a single batch
+	class arena_source final : public graph_source
+	{
+	public:
+		arena_source(const flow_graph_arena& graph, bool node_names, bool slot_names) :
+			graph_source(node_names, slot_names), graph(&graph) {}
+
+		const flow_graph_arena* next() override
+		{
+			const flow_graph_arena* batch = graph;
+			graph = nullptr;
+			return batch;
+		}
+
+	private:
+		const flow_graph_arena* graph;
+	};
+
+	// Same as write_flow_graph, from batches. Returns false if options.layout_cache could not be written.
+	template<typename S>
+	bool write_batches(S& stream, graph_source& source, const flow_graph_options& options)
+	{
+		const flow_graph_arena* batch = source.next();
+		const text_view title = batch->title();
+		flow_graph_writer<S> writer(stream, title, options);
+		flow_graph_index index;
+		flow_graph_layout layout;
+		bool grouped = false;
+
+		writer.begin();
+		for(; batch; batch = source.next())
+		{
+			for(size_t i = 0; i < batch->node_count(); i++)
+			{
+				const flow_graph_arena::node_view n = batch->node(i);
+				writer.add_node(n.name, n.inputs, n.outputs, measures_of(n), n.group);
+				grouped = grouped || n.group.size;
+				if(source.node_names && source.slot_names) index.add_node(n, std::true_type(), std::true_type());
+				else if(source.node_names) index.add_node(n, std::true_type(), std::false_type());
+				else if(source.slot_names) index.add_node(n, std::false_type(), std::true_type());
+				else index.add_node(n, std::false_type(), std::false_type());
+				add_layout_node(layout, n.name, flow_graph_metrics::node_height(n.inputs.size(), n.outputs.size()), options);
+			}
+			for(size_t i = 0; i < batch->connection_count(); i++)
+			{
+				size_t e[4];
+				if(!batch->resolve(i, index, e)) continue;
+				writer.add_connection(e[0], e[1], e[2], e[3], batch->measures(i));
+				if(options.layout) layout.add_edge(e[0], e[2]);
+			}
+		}
+		if(!options.layout)
+		{
+			writer.finish();
+			return true;
+		}
+		const bool saved = compute_layout(layout, options, grouped);
+		writer.finish(layout);
+		return saved;
+	}
+
+#if defined(DEBUGVIZ_SEPARATE)
+	// Output stream of the writer compiled apart
+	class erased_stream
+	{
+	public:
+		template<typename S>
+		explicit erased_stream(S& stream) : stream(&stream), put(&flush_into<S>) {}
+
+		void write(const char* s, std::streamsize n) { put(stream, s, size_t(n)); }
+
+	private:
+		void* stream;
+		void (*put)(void*, const char*, size_t);
+	};
+
+	// Defined where DEBUGVIZ_IMPLEMENTATION is
+	bool write_flow_graph_erased(erased_stream& stream, graph_source& source, const flow_graph_options& options);
+#endif
+
+	template<typename S>
+	void write_arena(S& stream, const flow_graph_arena& graph, const flow_graph_options& options,
+		flow_graph_write_status& status)
+	{
+		arena_source source(graph, graph.node_names, graph.slot_names);
+#if defined(DEBUGVIZ_SEPARATE)
+		erased_stream erased(stream);
+		status.layout_cache_saved = write_flow_graph_erased(erased, source, options);
+#else
+		status.layout_cache_saved = write_batches(stream, source, options);
+#endif
+	}
+}
+
+	/// Outputs a html page to visualize a flow graph
+	/** This function serialize a flow graph into a stream, as an html page that can be viewed on a
+		standard web browser (it does not need Internet connectivity, as all needed scripts/CSS are
+		fully included in the html). Names, slots and title are escaped, unless they can only be
+		streamed into the given stream (they must be strings, integers, or streamable into a
+		std::ostream for that).
+
+		A flow graph is a graph where nodes possess *input* and *output* ports (or slots), which
+		are used as endpoints for the edges of the graph. Connections can only go from an output
+		slot to an input slot, and can be viewed as "data comes out of a specific node at some port
+		and is fed into the specified input of another node".
+
+		In the following by 'range' we mean a type that can be iterated using a
+		range-based for loop, and by 'streamable' we mean a type that can be serialized into the
+		given stream.
+
+		The layout is computed here (see flow_graph_layout) and written with the graph, so that
+		the viewer only has to render it.
+
+		Names are written only once, with the nodes: connections are serialized as indices into
+		the nodes and their slots. Connection fields that are integers are directly taken as such
+		indices (the position of the node in 'nodes', and of the slot in its 'inputs'/'outputs'),
+		otherwise they are matched against the names of the nodes and slots, which must then also
+		be streamable into a std::ostream. Connections whose endpoints cannot be found are skipped.
+
+		\note for std::ostream, there exist a wrapper so you can stream a flow graph as usual:
+		`stream << bdgviz::flow_graph(title, nodes, connections);`.
+
+		\note to serialize a graph without storing it in ranges first, see flow_graph_writer.
+
+		\note buffer_sink is an alternative to std::ostream, slightly faster for large graphs when
+		the layout is left to the viewer (see there).
+
+		\note with options.threads, big graphs given as random-access ranges are formatted by
+		several threads, while another one computes the layout. The layout, which is not split
+		between threads, then takes most of the time: see options.layout to leave it to the viewer.
+
+		\note with DEBUGVIZ_SEPARATE, the graph is copied in batches (names and slots must then be
+		streamable into a std::ostream) and written by the code compiled with
+		DEBUGVIZ_IMPLEMENTATION, on one thread.
+
+		\note for graphs too big to stay fluid with svg, set options.renderer to
+		flow_graph_renderer::canvas (groups and clusters are then not shown).
+
+		\param stream The stream in which to serialize the flow graph html visualization
+		\param title Title of the html page (must be streamable)
+		\param nodes Nodes of the graph. This structure must be a range, and elements must have:
+			- a 'name' field, streamable
+			- an 'inputs' field, range of streamables
+			- an 'outputs' field, range of streamables
+			- optionally a 'group' field, streamable into a std::ostream: nodes of a group are
+			  shown collapsed into one box when zoomed out (or clicked). Without groups, big
+			  graphs are split into clusters of connected nodes (see flow_graph_options).
+		\param connections Links between nodes in the graph. This must be a range, and its elements
+			must have four fields: 'out', 'out_slot', 'in', 'in_slot', either streamables (names)
+			or integers (indices)
+		\param options Encoding of the graph in the page (see flow_graph_options)
+		\return The given stream
+	*/
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph(S& stream, const T& title, const N& nodes, const C& connections,
+		const flow_graph_options& options = flow_graph_options())
+	{
+		flow_graph_write_status status;
+		return write_flow_graph(stream, title, nodes, connections, options, status);
+	}
+
+	/// Same as write_flow_graph, also giving what the stream does not tell (see flow_graph_write_status)
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph(S& stream, const T& title, const N& nodes, const C& connections,
+		const flow_graph_options& options, flow_graph_write_status& status)
+	{
+		status = flow_graph_write_status();
+#if defined(DEBUGVIZ_SEPARATE)
+		detail::range_source<T, N, C> source(title, nodes, connections);
+		detail::erased_stream erased(stream);
+		status.layout_cache_saved = detail::write_flow_graph_erased(erased, source, options);
+		return stream;
+#else
+		using connection_type = decltype(*std::begin(connections));
+		using node_names = std::integral_constant<bool, !detail::index_out<connection_type>::value
+			|| !detail::index_in<connection_type>::value>;
+		using slot_names = std::integral_constant<bool, !detail::index_out_slot<connection_type>::value
+			|| !detail::index_in_slot<connection_type>::value>;
+
+		if(options.threads != 1 && options.payload == flow_graph_payload::json && options.compression == flow_graph_compression::none
+			&& detail::write_flow_graph_parallel(stream, title, nodes, connections, options, status, node_names(), slot_names(),
+				detail::parallel_writable<N, C>()))
+			return stream;
+
+		flow_graph_writer<S> writer(stream, title, options);
+		detail::flow_graph_index index;
+		flow_graph_layout layout;
+		bool grouped = false;
+
+		writer.begin();
+		for(const auto& n : nodes)
+		{
+			static_assert(detail::streamable_name<S, decltype(n)>::value,
+				"Nodes must have a 'name' field that supports 'stream << node.name'");
+			static_assert(detail::is_writable<S, decltype(*std::begin(n.inputs))>::value,
+				"Node inputs slots must support 'stream << slot'");
+			static_assert(detail::is_writable<S, decltype(*std::begin(n.outputs))>::value,
+				"Node outputs slots must support 'stream << slot'");
+
+			const std::string group = detail::group_of(n);
+			writer.add_node(n.name, n.inputs, n.outputs, detail::measures_of(n), group);
+			grouped = grouped || !group.empty();
+			index.add_node(n, node_names(), slot_names());
+			detail::add_layout_node(layout, n.name,
+				detail::flow_graph_metrics::node_height(detail::range_size(n.inputs), detail::range_size(n.outputs)), options);
+		}
+		for(const auto& c : connections)
+		{
+			static_assert(detail::index_out<decltype(c)>::value || detail::streamable_out<S, decltype(c)>::value,
+				"Connections must have a 'out' field that supports 'stream << connection.out'");
+			static_assert(detail::index_out_slot<decltype(c)>::value || detail::streamable_out_slot<S, decltype(c)>::value,
+				"Connections must have a 'out_slot' field that supports 'stream << connection.out_slot'");
+			static_assert(detail::index_in<decltype(c)>::value || detail::streamable_in<S, decltype(c)>::value,
+				"Connections must have a 'in' field that supports 'stream << connection.in'");
+			static_assert(detail::index_in_slot<decltype(c)>::value || detail::streamable_in_slot<S, decltype(c)>::value,
+				"Connections must have a 'in_slot' field that supports 'stream << connection.in_slot'");
+
+			const size_t out = index.node(c.out), in = index.node(c.in);
+			if(out == index.npos || in == index.npos) continue;
+			const size_t out_slot = index.slot(out, 'o', c.out_slot), in_slot = index.slot(in, 'i', c.in_slot);
+			if(out_slot == index.npos || in_slot == index.npos) continue;
+
+			writer.add_connection(out, out_slot, in, in_slot, detail::measures_of(c));
+			if(options.layout) layout.add_edge(out, in);
+		}
+		if(!options.layout) writer.finish();
+		else
+		{
+			status.layout_cache_saved = detail::compute_layout(layout, options, grouped);
+			writer.finish(layout);
+		}
+
+		return stream;
+#endif
+	}
+
+	/// Outputs only the graph, to be shown by a page written by write_flow_graph_viewer
+	/** Same as write_flow_graph, but the document is a script (a .js file, that the viewer loads
+		with a script element) unless options.document is flow_graph_document::json (a .json file,
+		that the viewer fetches: the page must then be served over http, or the file picked).
+		\see write_flow_graph for the parameters
+	*/
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph_data(S& stream, const T& title, const N& nodes, const C& connections,
+		flow_graph_options options = flow_graph_options())
+	{
+		if(options.document == flow_graph_document::page) options.document = flow_graph_document::script;
+		return write_flow_graph(stream, title, nodes, connections, options);
+	}
+
+	/// Outputs a viewer page without graph, for data files written by write_flow_graph_data
+	/** The page is the same for all graphs, so it can be written once. Data files are given in
+		the query string (`viewer.html?data=a.js&data=b.js`) or picked from the page (files, or a
+		whole directory), and the viewer switches between them without reloading.
+	*/
+	template<typename S, typename T>
+	S& write_flow_graph_viewer(S& stream, const T& title)
+	{
+		typename detail::buffer_of<S>::type buffer(stream, 4096);
+		buffer.literal(detail::flow_graph_html_head);
+		detail::write_text<detail::html_escape>(buffer, stream, title);
+		buffer.literal(detail::flow_graph_html_body);
+		buffer.literal("null");
+		buffer.literal(detail::flow_graph_html_tail);
+		buffer.flush();
+		return stream;
+	}
+
+namespace detail
+{
+	// Name of a node or slot of a flow_graph_subgraph: the original one, or the label of a stub
+	template<typename T>
+	struct subgraph_text
+	{
+		const T* original;
+		const std::string* label;
+	};
+	template<typename T>
+	std::enable_if_t<is_streamable<std::ostream, T>::value, std::ostream&> operator<<(std::ostream& os, const subgraph_text<T>& t)
+	{
+		return t.original ? os << *t.original : os << *t.label;
+	}
+	template<typename E, typename B, typename S, typename T>
+	void write_text(B& b, S& s, const subgraph_text<T>& t, rank<3>)
+	{
+		if(t.original) write_text<E>(b, s, *t.original);
+		else write_text<E>(b, s, *t.label);
+	}
+
+	// Slots of a node of a flow_graph_subgraph: the original range, or the labels of a stub
+	template<typename R>
+	class subgraph_slots
+	{
+		using original_iterator = decltype(std::begin(std::declval<const R&>()));
+		static_assert(std::is_lvalue_reference<decltype(*std::declval<original_iterator>())>::value,
+			"Node slots must be lvalues (elements of a container)");
+		using slot_type = no_cvref<decltype(*std::declval<original_iterator>())>;
+
+	public:
+		class iterator
+		{
+		public:
+			iterator(original_iterator it, const std::string* label) : it(it), label(label) {}
+			subgraph_text<slot_type> operator*() const
+			{
+				return label ? subgraph_text<slot_type>{ nullptr, label } : subgraph_text<slot_type>{ &*it, nullptr };
+			}
+			bool operator!=(const iterator& i) const { return label ? label != i.label : it != i.it; }
+			iterator& operator++()
+			{
+				if(label) ++label;
+				else ++it;
+				return *this;
+			}
+
+		private:
+			original_iterator it;
+			const std::string* label;
+		};
+
+		subgraph_slots(const R* original, const std::vector<std::string>* labels) : original(original), labels(labels) {}
+		iterator begin() const
+		{
+			return original ? iterator(std::begin(*original), nullptr) : iterator(original_iterator(), labels->data());
+		}
+		iterator end() const
+		{
+			return original ? iterator(std::end(*original), nullptr) : iterator(original_iterator(), labels->data() + labels->size());
+		}
+
+	private:
+		const R* original;
+		const std::vector<std::string>* labels;
+	};
+}
+
+	template<typename Node>
+	class flow_graph_query;
+
+	/// Part of a graph, extracted by a flow_graph_query, to be given to write_flow_graph
+	/** Nodes refer to the original ones, which must outlive the subgraph. Connections that
+		crossed the cut are collapsed into stubs: each node that had some gets a node upstream of
+		it and/or one downstream, named by the number of connections collapsed, with one slot per
+		slot of the node that had them (labelled by the name of the node outside, and how many more
+		there were). Measures of collapsed connections are summed.
+
+		\code
+		debugviz::flow_graph_query<node> query(nodes, connections);
+		const auto around = query.neighbourhood({ 42 }, 2);
+		debugviz::write_flow_graph(stream, "Around 42", around.nodes(), around.connections());
+		\endcode
+	*/
+	template<typename Node>
+	class flow_graph_subgraph
+	{
+		using name_type = detail::no_cvref<decltype(std::declval<const Node&>().name)>;
+		using inputs_type = detail::no_cvref<decltype(std::declval<const Node&>().inputs)>;
+		using outputs_type = detail::no_cvref<decltype(std::declval<const Node&>().outputs)>;
+
+	public:
+		static constexpr size_t npos = size_t(-1);
+
+		/// Node, with the fields expected by write_flow_graph (measures are NaN for stubs)
+		struct node_view
+		{
+			detail::subgraph_text<name_type> name;
+			detail::subgraph_slots<inputs_type> inputs;
+			detail::subgraph_slots<outputs_type> outputs;
+			double time_ns, count, bytes;
+		};
+		/// Connection between nodes of the subgraph, by index
+		struct connection_view
+		{
+			size_t out, out_slot, in, in_slot;
+			double time_ns, count, bytes;
+		};
+
+		node_view node(size_t i) const
+		{
+			if(i < selected.size())
+			{
+				const Node& n = *selected[i];
+				const flow_graph_measures m = detail::measures_of(n);
+				return { { &n.name, nullptr }, { &n.inputs, nullptr }, { &n.outputs, nullptr }, m.time_ns, m.count, m.bytes };
+			}
+			const stub& s = stubs[i - selected.size()];
+			const double nan = std::numeric_limits<double>::quiet_NaN();
+			return { { nullptr, &s.name }, { nullptr, s.upstream ? &no_slots : &s.slots },
+				{ nullptr, s.upstream ? &s.slots : &no_slots }, nan, nan, nan };
+		}
+		using node_range = detail::indexed_range<flow_graph_subgraph, node_view, &flow_graph_subgraph::node>;
+
+		/// Nodes of the subgraph (in their original order), then the stubs
+		node_range nodes() const { return node_range(*this, 0, selected.size() + stubs.size()); }
+		const std::vector<connection_view>& connections() const { return links; }
+
+		/// Number of nodes of the original graph in the subgraph (they are first)
+		size_t size() const { return selected.size(); }
+		/// Index in the original graph of a node of the subgraph, npos for stubs
+		size_t original(size_t i) const { return i < indices.size() ? indices[i] : npos; }
+
+	private:
+		friend class flow_graph_query<Node>;
+
+		struct stub
+		{
+			std::string name;
+			std::vector<std::string> slots;
+			bool upstream;
+		};
+
+		std::vector<const Node*> selected;
+		std::vector<size_t> indices;
+		std::vector<stub> stubs;
+		std::vector<connection_view> links;
+		std::vector<std::string> no_slots;
+	};
+
+	/// Index of a graph, to extract focused subgraphs from it
+	/** Built once over the ranges that would be given to write_flow_graph, with the same
+		requirements (nodes must also be lvalues: elements of a container, that must outlive the
+		query and its subgraphs). Connections are resolved and stored as compressed sparse rows,
+		each way, so that queries only cost in proportion to the part of the graph they visit
+		(plus an array of one byte per node). Queries do not modify the index: they can be run
+		concurrently.
+	*/
+	template<typename Node>
+	class flow_graph_query
+	{
+	public:
+		template<typename N, typename C>
+		flow_graph_query(const N& nodes, const C& connections)
+		{
+			static_assert(std::is_lvalue_reference<decltype(*std::begin(nodes))>::value,
+				"Nodes must be lvalues (elements of a container)");
+			using connection_type = decltype(*std::begin(connections));
+			using node_names = std::integral_constant<bool, !detail::index_out<connection_type>::value
+				|| !detail::index_in<connection_type>::value>;
+			using slot_names = std::integral_constant<bool, !detail::index_out_slot<connection_type>::value
+				|| !detail::index_in_slot<connection_type>::value>;
+
+			detail::flow_graph_index index;
+			for(const Node& n : nodes)
+			{
+				this->nodes.push_back(&n);
+				index.add_node(n, node_names(), slot_names());
+			}
+
+			// Edges by source then by target: offsets of each node, then the edges
+			std::vector<edge> resolved;
+			out_offset.assign(this->nodes.size() + 1, 0);
+			in_offset.assign(this->nodes.size() + 1, 0);
+			for(const auto& c : connections)
+			{
+				const size_t out = index.node(c.out), in = index.node(c.in);
+				if(out == index.npos || in == index.npos) continue;
+				const size_t out_slot = index.slot(out, 'o', c.out_slot), in_slot = index.slot(in, 'i', c.in_slot);
+				if(out_slot == index.npos || in_slot == index.npos) continue;
+
+				resolved.push_back({ uint32_t(out), uint32_t(in), uint32_t(out_slot), uint32_t(in_slot) });
+				if(detail::has_measures<connection_type>::value) measures.push_back(detail::measures_of(c));
+				out_offset[out + 1]++;
+				in_offset[in + 1]++;
+			}
+			for(size_t v = 0; v < this->nodes.size(); v++)
+			{
+				out_offset[v + 1] += out_offset[v];
+				in_offset[v + 1] += in_offset[v];
+			}
+			out_edges.resize(resolved.size());
+			in_edges.resize(resolved.size());
+			std::vector<uint32_t> out_cursor(out_offset.begin(), out_offset.end() - 1), in_cursor(in_offset.begin(), in_offset.end() - 1);
+			for(uint32_t e = 0; e < resolved.size(); e++)
+			{
+				out_edges[out_cursor[resolved[e].out]++] = e;
+				in_edges[in_cursor[resolved[e].in]++] = e;
+			}
+			edges = std::move(resolved);
+		}
+
+		size_t node_count() const { return nodes.size(); }
+		size_t connection_count() const { return edges.size(); }
+
+		/// Given nodes (indices in the original range), and those at most 'hops' connections downstream of them
+		flow_graph_subgraph<Node> downstream(const std::vector<size_t>& from, size_t hops) const { return around(from, hops, true, false); }
+		/// Given nodes, and those at most 'hops' connections upstream of them
+		flow_graph_subgraph<Node> upstream(const std::vector<size_t>& from, size_t hops) const { return around(from, hops, false, true); }
+		/// Given nodes, and those at most 'hops' connections away from them, either way
+		flow_graph_subgraph<Node> neighbourhood(const std::vector<size_t>& from, size_t hops) const { return around(from, hops, true, true); }
+
+		/// Nodes on the paths from a node to another one (empty if there is none)
+		flow_graph_subgraph<Node> paths(size_t from, size_t to) const
+		{
+			std::vector<uint8_t> mark(nodes.size(), 0);
+			std::vector<uint32_t> reached;
+			if(from < nodes.size() && to < nodes.size())
+			{
+				visit(mark, reached, { from }, size_t(-1), true, false, 1);
+				visit(mark, reached, { to }, size_t(-1), false, true, 2);
+			}
+			std::vector<uint32_t> both;
+			for(uint32_t v : reached)
+				if(mark[v] == 3) both.push_back(v);
+			for(uint32_t v : reached) mark[v] = mark[v] == 3;
+			return extract(mark, both);
+		}
+
+		/// Nodes for which 'predicate(node)' is true, and those at most 'hops' connections away from them
+		template<typename P>
+		flow_graph_subgraph<Node> matching(P predicate, size_t hops = 0) const
+		{
+			std::vector<size_t> from;
+			for(size_t v = 0; v < nodes.size(); v++)
+				if(predicate(*nodes[v])) from.push_back(v);
+			return around(from, hops, true, true);
+		}
+
+		/// Given nodes, and the connections between them
+		flow_graph_subgraph<Node> subgraph(const std::vector<size_t>& of) const { return around(of, 0, false, false); }
+
+	private:
+		struct edge
+		{
+			uint32_t out, in, out_slot, in_slot;
+		};
+
+		flow_graph_subgraph<Node> around(const std::vector<size_t>& from, size_t hops, bool down, bool up) const
+		{
+			std::vector<uint8_t> mark(nodes.size(), 0);
+			std::vector<uint32_t> reached;
+			visit(mark, reached, from, hops, down, up, 1);
+			return extract(mark, reached);
+		}
+
+		// Breadth first, up to 'hops' connections away: 'bit' is set in the marks of the nodes
+		// reached, that are appended to 'reached' when first marked
+		void visit(std::vector<uint8_t>& mark, std::vector<uint32_t>& reached, const std::vector<size_t>& from, size_t hops,
+			bool down, bool up, uint8_t bit) const
+		{
+			std::vector<uint32_t> frontier, next;
+			const auto reach = [&](uint32_t v)
+			{
+				if(mark[v] & bit) return;
+				if(!mark[v]) reached.push_back(v);
+				mark[v] |= bit;
+				next.push_back(v);
+			};
+			for(size_t v : from)
+				if(v < nodes.size()) reach(uint32_t(v));
+			for(size_t hop = 0; hop < hops && !next.empty(); hop++)
+			{
+				frontier.swap(next);
+				next.clear();
+				for(uint32_t v : frontier)
+				{
+					if(down)
+						for(uint32_t i = out_offset[v]; i < out_offset[v + 1]; i++) reach(edges[out_edges[i]].in);
+					if(up)
+						for(uint32_t i = in_offset[v]; i < in_offset[v + 1]; i++) reach(edges[in_edges[i]].out);
+				}
+			}
+		}
+
+		// Subgraph of the nodes whose mark is not 0, that are those listed
+		flow_graph_subgraph<Node> extract(const std::vector<uint8_t>& mark, std::vector<uint32_t> list) const
+		{
+			flow_graph_subgraph<Node> g;
+			std::sort(list.begin(), list.end());
+			std::unordered_map<uint32_t, uint32_t> position;
+			for(uint32_t v : list)
+			{
+				position.emplace(v, uint32_t(g.selected.size()));
+				g.selected.push_back(nodes[v]);
+				g.indices.push_back(v);
+			}
+
+			// Collapsed connections of a stub, by slot of the node inside
+			struct port
+			{
+				uint32_t slot, outside, count;
+				flow_graph_measures measures;
+			};
+			std::vector<port> ports;
+			const auto add_stub = [&](uint32_t inside, bool upstream, size_t cut)
+			{
+				if(ports.empty()) return;
+				std::stable_sort(ports.begin(), ports.end(), [](const port& a, const port& b) { return a.slot < b.slot; });
+				size_t count = 0;
+				for(const port& p : ports)
+				{
+					if(count && ports[count - 1].slot == p.slot)
+					{
+						ports[count - 1].count++;
+						add_measures(ports[count - 1].measures, p.measures);
+					}
+					else ports[count++] = p;
+				}
+				typename flow_graph_subgraph<Node>::stub s{ std::to_string(cut) + " more", std::vector<std::string>(count), upstream };
+				const size_t stub = g.selected.size() + g.stubs.size();
+				for(size_t i = 0; i < s.slots.size(); i++)
+				{
+					const port& p = ports[i];
+					detail::string_appender out{ s.slots[i] };
+					detail::discard_stream none;
+					detail::write_text(out, none, nodes[p.outside]->name);
+					if(p.count > 1) s.slots[i] += " +" + std::to_string(p.count - 1);
+					const flow_graph_measures& m = p.measures;
+					if(upstream) g.links.push_back({ stub, i, position[inside], p.slot, m.time_ns, m.count, m.bytes });
+					else g.links.push_back({ position[inside], p.slot, stub, i, m.time_ns, m.count, m.bytes });
+				}
+				g.stubs.push_back(std::move(s));
+			};
+
+			for(uint32_t v : list)
+			{
+				ports.clear();
+				for(uint32_t i = out_offset[v]; i < out_offset[v + 1]; i++)
+				{
+					const edge& e = edges[out_edges[i]];
+					const flow_graph_measures m = measures_of(out_edges[i]);
+					if(mark[e.in]) g.links.push_back({ position[v], e.out_slot, position[e.in], e.in_slot, m.time_ns, m.count, m.bytes });
+					else ports.push_back({ e.out_slot, e.in, 1, m });
+				}
+				add_stub(v, false, ports.size());
+				ports.clear();
+				for(uint32_t i = in_offset[v]; i < in_offset[v + 1]; i++)
+				{
+					const edge& e = edges[in_edges[i]];
+					if(!mark[e.out]) ports.push_back({ e.in_slot, e.out, 1, measures_of(in_edges[i]) });
+				}
+				add_stub(v, true, ports.size());
+			}
+			return g;
+		}
+
+		flow_graph_measures measures_of(uint32_t e) const { return e < measures.size() ? measures[e] : flow_graph_measures(); }
+		static void add_measures(flow_graph_measures& a, const flow_graph_measures& b)
+		{
+			const auto add = [](double& x, double y) { if(y == y) x = x == x ? x + y : y; };
+			add(a.time_ns, b.time_ns);
+			add(a.count, b.count);
+			add(a.bytes, b.bytes);
+		}
+
+		std::vector<const Node*> nodes;
+		std::vector<edge> edges;
+		std::vector<flow_graph_measures> measures;	// Of each edge, if connections have some
+		std::vector<uint32_t> out_offset, in_offset;	// Edges of v are in [offset[v], offset[v + 1])
+		std::vector<uint32_t> out_edges, in_edges;
+	};
+
+namespace detail
+{
+	struct timeline_edge
+	{
+		uint32_t out, out_slot, in, in_slot;
+
+		bool operator==(const timeline_edge& e) const
+		{
+			return out == e.out && out_slot == e.out_slot && in == e.in && in_slot == e.in_slot;
+		}
+	};
+	struct timeline_edge_hash
+	{
+		size_t operator()(const timeline_edge& e) const
+		{
+			const uint64_t h = ((uint64_t(e.out) << 32 | e.in) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(e.out_slot) << 32 | e.in_slot);
+			return size_t(h ^ h >> 31);
+		}
+	};
+	struct hash_of_hash
+	{
+		size_t operator()(uint64_t h) const { return size_t(h ^ h >> 32); }
+	};
+
+	// Open addressing set, with keys also stored in insertion order; clearing keeps the memory.
+	template<typename K, typename H>
+	class flat_set
+	{
+	public:
+		static constexpr size_t npos = size_t(-1);
+
+		size_t size() const { return keys.size(); }
+		const K& operator[](size_t i) const { return keys[i]; }
+
+		size_t find(const K& k) const
+		{
+			if(slots.empty()) return npos;
+			for(size_t i = H()(k) & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
+			{
+				if(!slots[i]) return npos;
+				if(keys[slots[i] - 1] == k) return slots[i] - 1;
+			}
+		}
+		// Index of the key, and whether it was inserted
+		std::pair<size_t, bool> insert(const K& k)
+		{
+			if(2 * (keys.size() + 1) > slots.size()) rehash(std::max<size_t>(2 * slots.size(), 64));
+			for(size_t i = H()(k) & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
+			{
+				if(!slots[i])
+				{
+					keys.push_back(k);
+					slots[i] = uint32_t(keys.size());
+					return { keys.size() - 1, true };
+				}
+				if(keys[slots[i] - 1] == k) return { slots[i] - 1, false };
+			}
+		}
+		void clear()
+		{
+			keys.clear();
+			std::fill(slots.begin(), slots.end(), 0u);
+		}
+		void swap(flat_set& other)
+		{
+			keys.swap(other.keys);
+			slots.swap(other.slots);
+		}
+
+	private:
+		void rehash(size_t capacity)
+		{
+			slots.assign(capacity, 0u);
+			for(size_t k = 0; k < keys.size(); k++)
+				for(size_t i = H()(keys[k]) & (capacity - 1);; i = (i + 1) & (capacity - 1))
+					if(!slots[i])
+					{
+						slots[i] = uint32_t(k + 1);
+						break;
+					}
+		}
+
+		std::vector<K> keys;
+		std::vector<uint32_t> slots;	// Index in keys, plus one (0 when empty)
+	};
+}
+
+	/// Writes a page showing a graph that changes over time, with a slider to move between states
+	/** Each call to add_frame() takes the whole graph at some point in time (same ranges as
+		write_flow_graph), and only its differences with the previous frame are written: nodes
+		that appeared or whose slots changed, nodes that disappeared, connections made and removed.
+		The file thus grows with the number of changes, not with the number of frames. Finding the
+		differences takes one pass over the frame, with hash tables of the previous one (which is
+		all the writer keeps, besides the heights of nodes and the pairs of connected nodes).
+
+		Nodes are identified across frames by their name (the n-th node of a given name in a frame
+		matches the n-th one of the previous frame). All the nodes that ever appear are laid out
+		together by finish(), so each keeps its place in every frame.
+
+		The viewer applies the differences one after the other when the slider is moved (and in
+		reverse when it goes back). Options are those of write_flow_graph, except that the payload
+		is always json (flow_graph_payload::binary is ignored). As with flow_graph_writer, a page
+		left unfinished is finished by the destructor, ignoring errors of the stream.
+		\code
+		debugviz::flow_graph_timeline_writer<std::ofstream> timeline(file, "Scheduler");
+		timeline.begin();
+		for(int step = 0; step < steps; step++)
+		{
+			simulate(step);
+			timeline.add_frame("step " + std::to_string(step), nodes, connections);
+		}
+		timeline.finish();
+		\endcode
+	*/
+	template<typename S>
+	class flow_graph_timeline_writer
+	{
+	public:
+		template<typename T>
+		flow_graph_timeline_writer(S& stream, const T& title, flow_graph_options options = flow_graph_options(),
+			size_t buffer_size = flow_graph_writer<S>::default_buffer_size) :
+			title(&title), begin_output(&begin_with_title<T>), output(stream, json_payload(options), buffer_size) {}
+		flow_graph_timeline_writer(const flow_graph_timeline_writer&) = delete;
+		flow_graph_timeline_writer& operator=(const flow_graph_timeline_writer&) = delete;
+		~flow_graph_timeline_writer()
+		{
+			if(state == in_frames)
+				try { finish(); } catch(...) {}
+		}
+
+		/// Starts the page, must be called before adding frames
+		void begin()
+		{
+			begin_output(output, title);
+			output.json([](auto& b, auto&) { b.literal("{\"timeline\":["); });
+			state = in_frames;
+		}
+
+		/// Adds the next state of the graph, with a streamable label shown by the viewer
+		template<typename L, typename N, typename C>
+		void add_frame(const L& label, const N& nodes, const C& connections)
+		{
+			output.json([&](auto& b, auto& s)
+			{
+				if(frame) b.write(',');
+				b.literal("{\"label\":");
+				detail::write_json_string(b, s, label);
+				write_frame(b, s, nodes, connections);
+				b.write('}');
+			});
+			frame++;
+		}
+		template<typename N, typename C>
+		void add_frame(const N& nodes, const C& connections) { add_frame(frame, nodes, connections); }
+
+		/// Lays out all the nodes seen, ends the page and flushes everything into the stream
+		void finish()
+		{
+			flow_graph_layout layout;
+			for(float h : heights) layout.add_node(h);
+			for(uint64_t e : pairs) layout.add_edge(size_t(e >> 32), size_t(e & 0xFFFFFFFFu));
+			layout.compute();
+			output.json([&](auto& b, auto& s)
+			{
+				b.write(']');
+				detail::write_json_layout(b, s, layout);
+				b.write('}');
+			});
+			output.end();
+			state = finished;
+		}
+
+	private:
+		struct node_state
+		{
+			uint32_t id;
+			uint64_t signature;	// Name and slots
+		};
+		using node_set = detail::flat_set<uint64_t, detail::hash_of_hash>;
+		using edge_set = detail::flat_set<detail::timeline_edge, detail::timeline_edge_hash>;
+
+		static flow_graph_options json_payload(flow_graph_options options)
+		{
+			options.payload = flow_graph_payload::json;
+			return options;
+		}
+		template<typename T>
+		static void begin_with_title(detail::flow_graph_output<S>& output, const void* title)
+		{
+			output.begin(*static_cast<const T*>(title));
+		}
+
+		// Json arrays of a frame are only written when they have elements
+		template<typename B, size_t N>
+		static void item(B& b, bool& open, const char (&name)[N])
+		{
+			if(open) b.write(',');
+			else b.literal(name);
+			open = true;
+		}
+
+		template<typename B, typename St, typename N, typename C>
+		void write_frame(B& b, St& s, const N& nodes, const C& connections)
+		{
+			using node_type = decltype(*std::begin(nodes));
+			using connection_type = decltype(*std::begin(connections));
+			using node_names = std::integral_constant<bool, !detail::index_out<connection_type>::value
+				|| !detail::index_in<connection_type>::value>;
+			using slot_names = std::integral_constant<bool, !detail::index_out_slot<connection_type>::value
+				|| !detail::index_in_slot<connection_type>::value>;
+			static_assert(detail::streamable_name<S, node_type>::value,
+				"Nodes must have a 'name' field that supports 'stream << node.name'");
+
+			// Nodes (keyed by the hash of their name): new ones get the next id, those with other
+			// slots are written again
+			detail::flow_graph_index index;
+			node_keys.swap(previous_keys);
+			node_keys.clear();
+			states.swap(previous_states);
+			states.clear();
+			seen.assign(previous_keys.size(), false);
+			bool open = false;
+			for(const auto& n : nodes)
+			{
+				index.add_node(n, node_names(), slot_names());
+				detail::text_hash signature;
+				uint64_t key = signature(n.name).value;
+				for(const auto& slot : n.inputs) signature(slot);
+				signature.write('\1');
+				for(const auto& slot : n.outputs) signature(slot);
+
+				for(uint64_t occurrence = 1; !node_keys.insert(key).second; occurrence++)
+					key = (key ^ occurrence) * 1099511628211ull;	// Same name again
+				const size_t previous = previous_keys.find(key);
+				bool write = true;
+				if(previous == node_set::npos)
+				{
+					states.push_back({ uint32_t(heights.size()), signature.value });
+					heights.push_back(0);
+					replaced.push_back(size_t(-1));
+				}
+				else
+				{
+					seen[previous] = true;
+					states.push_back(previous_states[previous]);
+					if(states.back().signature != signature.value)
+					{
+						states.back().signature = signature.value;
+						replaced[states.back().id] = frame;
+					}
+					else write = false;
+				}
+				const uint32_t id = states.back().id;
+				if(!write) continue;
+
+				heights[id] = detail::flow_graph_metrics::node_height(detail::range_size(n.inputs), detail::range_size(n.outputs));
+				item(b, open, ",\"nodes\":[");
+				b.write('[');
+				detail::write_text(b, s, id);
+				b.literal(",{\"name\":");
+				detail::write_json_string(b, s, n.name);
+				b.literal(",\"inputs\":[");
+				detail::write_json_strings(b, s, n.inputs);
+				b.literal("],\"outputs\":[");
+				detail::write_json_strings(b, s, n.outputs);
+				b.literal("]}]");
+			}
+			if(open) b.write(']');
+
+			// Nodes that are gone take their connections with them in the viewer
+			open = false;
+			for(size_t i = 0; i < previous_states.size(); i++)
+			{
+				if(seen[i]) continue;
+				item(b, open, ",\"removed\":[");
+				detail::write_text(b, s, previous_states[i].id);
+				replaced[previous_states[i].id] = frame;
+			}
+			if(open) b.write(']');
+
+			// Connections, as ids of nodes and indices of slots
+			edges.swap(previous_edges);
+			edges.clear();
+			for(const auto& c : connections)
+			{
+				const size_t out = index.node(c.out), in = index.node(c.in);
+				if(out == index.npos || in == index.npos) continue;
+				const size_t out_slot = index.slot(out, 'o', c.out_slot), in_slot = index.slot(in, 'i', c.in_slot);
+				if(out_slot == index.npos || in_slot == index.npos) continue;
+				edges.insert({ states[out].id, uint32_t(out_slot), states[in].id, uint32_t(in_slot) });
+			}
+			open = false;
+			for(size_t i = 0; i < edges.size(); i++)
+			{
+				const detail::timeline_edge& e = edges[i];
+				if(previous_edges.find(e) != edge_set::npos && replaced[e.out] != frame && replaced[e.in] != frame) continue;
+				item(b, open, ",\"connect\":[");
+				write_edge(b, s, e);
+				pairs.insert(uint64_t(e.out) << 32 | e.in);
+			}
+			if(open) b.write(']');
+			open = false;
+			for(size_t i = 0; i < previous_edges.size(); i++)
+			{
+				const detail::timeline_edge& e = previous_edges[i];
+				if(edges.find(e) != edge_set::npos || replaced[e.out] == frame || replaced[e.in] == frame) continue;
+				item(b, open, ",\"disconnect\":[");
+				write_edge(b, s, e);
+			}
+			if(open) b.write(']');
+		}
+		template<typename B, typename St>
+		static void write_edge(B& b, St& s, const detail::timeline_edge& e)
+		{
+			b.write('[');
+			detail::write_text(b, s, e.out);
+			b.write(',');
+			detail::write_text(b, s, e.out_slot);
+			b.write(',');
+			detail::write_text(b, s, e.in);
+			b.write(',');
+			detail::write_text(b, s, e.in_slot);
+			b.write(']');
+		}
+
+		enum { idle, in_frames, finished } state = idle;
+		const void* title;
+		void (*begin_output)(detail::flow_graph_output<S>&, const void*);
+		detail::flow_graph_output<S> output;
+		size_t frame = 0;
+
+		node_set node_keys, previous_keys;
+		std::vector<node_state> states, previous_states;	// Of the nodes of a frame, by index
+		std::vector<bool> seen;	// Nodes of the previous frame that are in the current one
+		std::vector<size_t> replaced;	// Last frame where a node was removed or written again, by id
+		edge_set edges, previous_edges;
+		std::vector<float> heights;	// By id, for the layout
+		std::unordered_set<uint64_t> pairs;	// Connected ids
+	};
+
+namespace detail
+{
+	template<typename T, typename N, typename C>
+	struct flow_graph_data
+	{
+		const T& title;
+		const N& nodes;
+		const C& connections;
+		flow_graph_options options;
+	};
+
+	template<typename T, typename N, typename C>
+	std::ostream& operator<<(std::ostream& os, const flow_graph_data<T, N, C>& g)
+	{
+		return write_flow_graph<std::ostream, T, N, C>(os, g.title, g.nodes, g.connections, g.options);
+	}
+}
+
+	/// Convenience function for use with standard output streams
+	/** A wrapper on write_flow_graph for std::ostream allowing constructs like:
+		`std::cout << debugviz::flow_graph("Some title", nodes, connections);`.
+		\see write_flow_graph for a more complete explanation of the parameters. */
+	template<typename T, typename N, typename C>
+	detail::flow_graph_data<T, N, C> flow_graph(const T& title, const N& nodes, const C& connections,
+		const flow_graph_options& options = flow_graph_options())
+	{
+		return { title, nodes, connections, options };
+	}
+
+namespace detail
+{
+	constexpr size_t cache_line = 64;
+
+	// One object per thread that uses the owner (a recorder, counters...), created on first use
+	// and kept until the owner is destroyed. Threads find theirs through a thread_local cache
+	// of the last owner they used; the list is only walked when they switch between owners.
+	template<typename T>
+	class per_thread
+	{
+	public:
+		per_thread() : id(next_id().fetch_add(1, std::memory_order_relaxed)) {}
+		per_thread(const per_thread&) = delete;
+		per_thread& operator=(const per_thread&) = delete;
+		~per_thread()
+		{
+			for(item* i = items.load(std::memory_order_acquire); i;)
+			{
+				item* next = i->next;
+				delete i;
+				i = next;
+			}
+		}
+
+		/// Object of the calling thread, created with the given arguments the first time
+		template<typename... A>
+		T& local(A&&... args)
+		{
+			struct cache
+			{
+				uint64_t owner = 0;
+				T* value = nullptr;
+			};
+			static thread_local cache last;
+			if(last.owner != id)
+			{
+				last.value = &find_or_create(std::forward<A>(args)...);
+				last.owner = id;
+			}
+			return *last.value;
+		}
+
+		template<typename F>
+		void for_each(F&& f) const
+		{
+			for(item* i = items.load(std::memory_order_acquire); i; i = i->next) f(i->value);
+		}
+
+	private:
+		struct item
+		{
+			template<typename... A>
+			item(std::thread::id owner, A&&... args) : value(std::forward<A>(args)...), owner(owner) {}
+
+			T value;
+			const std::thread::id owner;
+			item* next = nullptr;
+		};
+
+		static std::atomic<uint64_t>& next_id()
+		{
+			static std::atomic<uint64_t> id{ 1 };
+			return id;
+		}
+
+		template<typename... A>
+		T& find_or_create(A&&... args)
+		{
+			const std::thread::id self = std::this_thread::get_id();
+			item* head = items.load(std::memory_order_acquire);
+			for(item* i = head; i; i = i->next)
+				if(i->owner == self) return i->value;
+
+			item* created = new item(self, std::forward<A>(args)...);
+			created->next = head;
+			while(!items.compare_exchange_weak(created->next, created, std::memory_order_release, std::memory_order_acquire)) {}
+			return created->value;
+		}
+
+		const uint64_t id;
+		std::atomic<item*> items{ nullptr };
+	};
+
+	/// Fixed-size record of one change of a flow_graph_recorder
+	struct recorder_event
+	{
+		enum kind_type : uint32_t { add_node, remove_node, add_input, add_output, connect, disconnect };
+
+		kind_type kind;
+		uint32_t out_slot, in_slot;	// Node name for add_node, slot name for add_input/add_output
+		uint32_t unused;
+		uint64_t out, in;	// Node keys, only 'out' for node events
+	};
+	static_assert(sizeof(recorder_event) == 32, "Events should stay half a cache line");
+
+	/// Single producer, single consumer ring of events: the producer never waits
+	/** The producer and the consumer positions live on their own cache line, and each side keeps
+		a copy of the other's position so it only reads the shared one when the ring looks full
+		(or empty). An event that does not fit is dropped and counted.
+	*/
+	class event_ring
+	{
+	public:
+		explicit event_ring(size_t capacity) : events(new recorder_event[capacity]), mask(capacity - 1) {}
+
+		void push(const recorder_event& e)
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if(h - cached_tail > mask)
+			{
+				cached_tail = tail.load(std::memory_order_acquire);
+				if(h - cached_tail > mask)
+				{
+					dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					return;
+				}
+			}
+			events[h & mask] = e;
+			head.store(h + 1, std::memory_order_release);
+		}
+
+		template<typename F>
+		void consume(F&& f)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			const size_t h = head.load(std::memory_order_acquire);
+			for(; t != h; t++) f(events[t & mask]);
+			tail.store(t, std::memory_order_release);
+		}
+
+		size_t dropped_events() const { return dropped.load(std::memory_order_relaxed); }
+
+	private:
+		const std::unique_ptr<recorder_event[]> events;
+		const size_t mask;
+		char pad0[cache_line];
+		std::atomic<size_t> head{ 0 };	// Producer side
+		size_t cached_tail = 0;
+		std::atomic<size_t> dropped{ 0 };
+		char pad1[cache_line - sizeof(size_t) - 2 * sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> tail{ 0 };	// Consumer side
+		char pad2[cache_line - sizeof(std::atomic<size_t>)];
+	};
+
+	/// Fixed-capacity table of interned strings, filled concurrently without locks
+	/** Open addressing on FNV-1a hashes: a new string is published by a compare-and-swap on an
+		empty slot, and the slot index is its id. Strings are never removed.
+	*/
+	class concurrent_string_table
+	{
+	public:
+		static constexpr uint32_t npos = uint32_t(-1);
+
+		explicit concurrent_string_table(size_t capacity) : size(capacity), mask(capacity - 1),
+			slots(new std::atomic<const entry*>[capacity])
+		{
+			for(size_t i = 0; i < size; i++) slots[i].store(nullptr, std::memory_order_relaxed);
+		}
+		~concurrent_string_table()
+		{
+			for(size_t i = 0; i < size; i++) delete slots[i].load(std::memory_order_relaxed);
+		}
+
+		uint32_t intern(const char* s, size_t n)
+		{
+			uint32_t hash = 2166136261u;
+			for(size_t i = 0; i < n; i++) hash = (hash ^ uint8_t(s[i])) * 16777619u;
+
+			std::unique_ptr<entry> created;
+			for(size_t probe = 0, i = hash & mask; probe < size; probe++, i = (i + 1) & mask)
+			{
+				const entry* e = slots[i].load(std::memory_order_acquire);
+				if(!e)
+				{
+					if(!created) created.reset(new entry{ hash, std::string(s, n) });
+					if(slots[i].compare_exchange_strong(e, created.get(), std::memory_order_acq_rel))
+					{
+						created.release();
+						return uint32_t(i);
+					}
+				}
+				if(e->hash == hash && e->text.size() == n && std::memcmp(e->text.data(), s, n) == 0)
+					return uint32_t(i);
+			}
+			return npos;
+		}
+
+		/// String of an id returned by intern(), to be called once the id has been seen (empty for npos)
+		const std::string& text(uint32_t id) const
+		{
+			static const std::string none;
+			return id < size ? slots[id].load(std::memory_order_acquire)->text : none;
+		}
+
+	private:
+		struct entry
+		{
+			uint32_t hash;
+			std::string text;
+		};
+
+		const size_t size, mask;
+		const std::unique_ptr<std::atomic<const entry*>[]> slots;
+	};
+
+	inline size_t round_to_power_of_two(size_t n)
+	{
+		size_t p = 1;
+		while(p < n) p *= 2;
+		return p;
+	}
+}
+
+	/// Graph materialised by flow_graph_recorder::snapshot(), that can be given to write_flow_graph
+	struct flow_graph_snapshot
+	{
+		struct node
+		{
+			std::string name;
+			std::vector<std::string> inputs, outputs;
+		};
+		struct connection
+		{
+			size_t out, out_slot, in, in_slot;
+		};
+
+		std::vector<node> nodes;
+		std::vector<connection> connections;
+	};
+
+	/// Records topology changes made by any number of threads, for later display
+	/** Producers call add_node, remove_node, connect and disconnect with their own node keys
+		(pointers, indices...) and names interned beforehand with intern(). Each call appends one
+		fixed-size event to a ring owned by the calling thread: no lock, no allocation, no shared
+		cache line. A thread's ring is allocated the first time it records, and kept until the
+		recorder is destroyed. When a ring is full, its events are dropped (see dropped()): call
+		collect() often enough, or give a larger capacity.
+
+		The consumer calls snapshot() (or collect() to just apply pending events), from one thread
+		at a time. Events of a thread are applied in order; those of different threads are ordered
+		only by the points where the consumer reads them, so a node removed by one thread and added
+		back by another at nearly the same time may end up in either state. A connection to a node
+		that was not added yet creates it, named after its key until its add_node is seen. Names
+		that did not fit in the string table (npos) are shown the same way for nodes, and as '?'
+		for slots.
+
+		The recorder must outlive the threads that record into it.
+		\code
+		debugviz::flow_graph_recorder recorder;
+		const auto decode = recorder.intern("decode"), frame = recorder.intern("frame");
+		// From worker threads
+		recorder.add_node(key, decode);
+		recorder.connect(reader_key, frame, key, frame);
+		// From any thread
+		const auto graph = recorder.snapshot();
+		debugviz::write_flow_graph(file, "Pipeline", graph.nodes, graph.connections);
+		\endcode
+	*/
+	class flow_graph_recorder
+	{
+	public:
+		using node_key = uint64_t;
+		using name_id = uint32_t;
+		/// Returned by intern() when the string table is full
+		static constexpr name_id npos = detail::concurrent_string_table::npos;
+
+		/// Capacities are rounded up to powers of two
+		explicit flow_graph_recorder(size_t events_per_thread = 1 << 14, size_t max_names = 1 << 16) :
+			capacity(detail::round_to_power_of_two(std::max<size_t>(events_per_thread, 2))),
+			names(detail::round_to_power_of_two(std::max<size_t>(max_names, 2))) {}
+		flow_graph_recorder(const flow_graph_recorder&) = delete;
+		flow_graph_recorder& operator=(const flow_graph_recorder&) = delete;
+
+		/// Id of a node or slot name, the same for equal strings. Safe to call from any thread,
+		/// but it may allocate: intern names once, outside of hot paths.
+		name_id intern(const char* s, size_t n) { return names.intern(s, n); }
+		name_id intern(const char* s) { return intern(s, std::strlen(s)); }
+		name_id intern(const std::string& s) { return intern(s.data(), s.size()); }
+
+		void add_node(node_key node, name_id name) { record({ detail::recorder_event::add_node, name, 0, 0, node, 0 }); }
+		/// Removes the node and its connections
+		void remove_node(node_key node) { record({ detail::recorder_event::remove_node, 0, 0, 0, node, 0 }); }
+		/// Declares a slot, for slots that have no connection (connect() adds the others)
+		void add_input(node_key node, name_id slot) { record({ detail::recorder_event::add_input, slot, 0, 0, node, 0 }); }
+		void add_output(node_key node, name_id slot) { record({ detail::recorder_event::add_output, slot, 0, 0, node, 0 }); }
+		void connect(node_key out, name_id out_slot, node_key in, name_id in_slot)
+		{
+			record({ detail::recorder_event::connect, out_slot, in_slot, 0, out, in });
+		}
+		void disconnect(node_key out, name_id out_slot, node_key in, name_id in_slot)
+		{
+			record({ detail::recorder_event::disconnect, out_slot, in_slot, 0, out, in });
+		}
+
+		/// Applies the events recorded so far to the graph kept by the consumer
+		void collect()
+		{
+			std::lock_guard<std::mutex> lock(consumer);
+			apply_pending();
+		}
+
+		/// Applies the events recorded so far, and returns the current graph
+		flow_graph_snapshot snapshot()
+		{
+			std::lock_guard<std::mutex> lock(consumer);
+			apply_pending();
+
+			// Nodes in creation order and sorted connections, for a stable output
+			std::vector<const std::pair<const node_key, node_state>*> order;
+			order.reserve(nodes.size());
+			for(const auto& n : nodes) order.push_back(&n);
+			std::sort(order.begin(), order.end(), [](const std::pair<const node_key, node_state>* a,
+				const std::pair<const node_key, node_state>* b) { return a->second.generation < b->second.generation; });
+
+			flow_graph_snapshot g;
+			std::unordered_map<node_key, size_t> index;
+			g.nodes.reserve(nodes.size());
+			for(const auto* n : order)
+			{
+				index.emplace(n->first, g.nodes.size());
+				flow_graph_snapshot::node v;
+				v.name = n->second.name == npos ? "#" + std::to_string(n->first) : names.text(n->second.name);
+				for(name_id s : n->second.inputs) v.inputs.push_back(s == npos ? "?" : names.text(s));
+				for(name_id s : n->second.outputs) v.outputs.push_back(s == npos ? "?" : names.text(s));
+				g.nodes.push_back(std::move(v));
+			}
+
+			for(auto e = edges.begin(); e != edges.end();)
+			{
+				const auto out = nodes.find(e->out), in = nodes.find(e->in);
+				if(out == nodes.end() || in == nodes.end()
+					|| out->second.generation != e->out_generation || in->second.generation != e->in_generation)
+				{
+					e = edges.erase(e);	// Left by a removed node
+					continue;
+				}
+				g.connections.push_back({ index[e->out], slot(out->second.outputs, e->out_slot),
+					index[e->in], slot(in->second.inputs, e->in_slot) });
+				++e;
+			}
+			std::sort(g.connections.begin(), g.connections.end(),
+				[](const flow_graph_snapshot::connection& a, const flow_graph_snapshot::connection& b)
+				{
+					return std::tie(a.out, a.out_slot, a.in, a.in_slot) < std::tie(b.out, b.out_slot, b.in, b.in_slot);
+				});
+			return g;
+		}
+
+		/// Number of events dropped because a thread's ring was full
+		size_t dropped() const
+		{
+			size_t count = 0;
+			rings.for_each([&](const detail::event_ring& r) { count += r.dropped_events(); });
+			return count;
+		}
+
+	private:
+		struct node_state
+		{
+			name_id name = npos;
+			uint64_t generation = 0;
+			std::vector<name_id> inputs, outputs;
+		};
+		struct edge
+		{
+			node_key out, in;
+			name_id out_slot, in_slot;
+			uint64_t out_generation, in_generation;
+
+			bool operator==(const edge& e) const
+			{
+				return out == e.out && in == e.in && out_slot == e.out_slot && in_slot == e.in_slot
+					&& out_generation == e.out_generation && in_generation == e.in_generation;
+			}
+		};
+		struct edge_hash
+		{
+			size_t operator()(const edge& e) const
+			{
+				uint64_t h = e.out * 0x9E3779B97F4A7C15ull ^ e.in;
+				h = h * 0x9E3779B97F4A7C15ull ^ (uint64_t(e.out_slot) << 32 | e.in_slot);
+				h = h * 0x9E3779B97F4A7C15ull ^ (e.out_generation << 32 ^ e.in_generation);
+				return size_t(h ^ h >> 29);
+			}
+		};
+
+		void record(const detail::recorder_event& e) { rings.local(capacity).push(e); }
+
+		void apply_pending()
+		{
+			rings.for_each([this](detail::event_ring& r) { r.consume([this](const detail::recorder_event& e) { apply(e); }); });
+		}
+
+		void apply(const detail::recorder_event& e)
+		{
+			using event = detail::recorder_event;
+			switch(e.kind)
+			{
+			case event::add_node: node(e.out).name = e.out_slot; break;
+			case event::remove_node: nodes.erase(e.out); break;
+			case event::add_input: add_slot(node(e.out).inputs, e.out_slot); break;
+			case event::add_output: add_slot(node(e.out).outputs, e.out_slot); break;
+			case event::connect:
+			{
+				node_state& out = node(e.out);
+				add_slot(out.outputs, e.out_slot);
+				const uint64_t out_generation = out.generation;
+				node_state& in = node(e.in);
+				add_slot(in.inputs, e.in_slot);
+				edges.insert({ e.out, e.in, e.out_slot, e.in_slot, out_generation, in.generation });
+				break;
+			}
+			case event::disconnect:
+			{
+				const auto out = nodes.find(e.out), in = nodes.find(e.in);
+				if(out != nodes.end() && in != nodes.end())
+					edges.erase({ e.out, e.in, e.out_slot, e.in_slot, out->second.generation, in->second.generation });
+				break;
+			}
+			}
+		}
+
+		// A node that was removed comes back with a new generation, so that its old edges are ignored
+		node_state& node(node_key key)
+		{
+			const auto found = nodes.find(key);
+			if(found != nodes.end()) return found->second;
+			node_state& n = nodes[key];
+			n.generation = ++generations;
+			return n;
+		}
+
+		static void add_slot(std::vector<name_id>& slots, name_id s)
+		{
+			if(std::find(slots.begin(), slots.end(), s) == slots.end()) slots.push_back(s);
+		}
+		static size_t slot(const std::vector<name_id>& slots, name_id s)
+		{
+			return size_t(std::find(slots.begin(), slots.end(), s) - slots.begin());
+		}
+
+		const size_t capacity;
+		detail::concurrent_string_table names;
+		detail::per_thread<detail::event_ring> rings;
+
+		// Consumer side
+		std::mutex consumer;
+		std::unordered_map<node_key, node_state> nodes;
+		std::unordered_set<edge, edge_hash> edges;
+		uint64_t generations = 0;
+	};
+
+namespace detail
+{
+	// Counters of one thread; only that thread writes them (relaxed load and store, no atomic
+	// read-modify-write), and they are padded so that no cache line is shared with another thread
+	class counter_block
+	{
+	public:
+		struct counter
+		{
+			std::atomic<uint64_t> time_ns{ 0 }, count{ 0 }, bytes{ 0 };
+		};
+		static constexpr size_t padding = (cache_line + sizeof(counter) - 1) / sizeof(counter);
+
+		explicit counter_block(size_t size) : size(size), values(new counter[size + 2 * padding]) {}
+
+		void add(size_t id, uint64_t time_ns, uint64_t bytes)
+		{
+			if(id >= size) return;
+			counter& c = values[padding + id];
+			c.time_ns.store(c.time_ns.load(std::memory_order_relaxed) + time_ns, std::memory_order_relaxed);
+			c.count.store(c.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			c.bytes.store(c.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+		}
+		const counter& operator[](size_t id) const { return values[padding + id]; }
+
+	private:
+		const size_t size;
+		const std::unique_ptr<counter[]> values;
+	};
+}
+
+	/// Per-thread performance counters of nodes (or of anything with a dense id), for the heat overlay
+	/** Each thread that records gets its own block of counters, allocated the first time (so the
+		fast path has no allocation, lock or atomic read-modify-write), and totals() sums the blocks
+		when the graph is written. Counters are cumulative: they keep growing until the object is
+		destroyed. Ids must be lower than the size given at construction, others are ignored.
+		\code
+		debugviz::flow_graph_counters counters(nodes.size());
+		// In worker threads
+		{
+			auto timer = counters.time(node_index, buffer.size());
+			process(buffer);
+		}
+		// When dumping
+		const auto totals = counters.totals();
+		for(size_t i = 0; i < nodes.size(); i++)
+		{
+			nodes[i].time_ns = totals[i].time_ns;
+			nodes[i].count = totals[i].count;
+		}
+		debugviz::write_flow_graph(file, "Pipeline", nodes, connections);
+		\endcode
+	*/
+	class flow_graph_counters
+	{
+	public:
+		/// Measures the time until its destruction, and adds it (with one count) to an id
+		class scoped_timer
+		{
+		public:
+			scoped_timer(flow_graph_counters& counters, size_t id, uint64_t bytes = 0) :
+				counters(&counters), id(id), bytes(bytes), start(std::chrono::steady_clock::now()) {}
+			scoped_timer(scoped_timer&& t) : counters(t.counters), id(t.id), bytes(t.bytes), start(t.start) { t.counters = nullptr; }
+			scoped_timer(const scoped_timer&) = delete;
+			scoped_timer& operator=(const scoped_timer&) = delete;
+			~scoped_timer()
+			{
+				if(!counters) return;
+				const auto elapsed = std::chrono::steady_clock::now() - start;
+				counters->add(id, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()), bytes);
+			}
+
+			/// Adds to the bytes that will be recorded
+			void add_bytes(uint64_t n) { bytes += n; }
+
+		private:
+			flow_graph_counters* counters;
+			size_t id;
+			uint64_t bytes;
+			std::chrono::steady_clock::time_point start;
+		};
+
+		explicit flow_graph_counters(size_t ids) : size(ids) {}
+
+		/// Adds one count, with its time and bytes, to an id
+		void add(size_t id, uint64_t time_ns, uint64_t bytes = 0) { blocks.local(size).add(id, time_ns, bytes); }
+		scoped_timer time(size_t id, uint64_t bytes = 0) { return scoped_timer(*this, id, bytes); }
+
+		/// Sums of all threads, for each id. Can be called while threads are recording (the
+		/// values of a same id may then be from slightly different times).
+		std::vector<flow_graph_measures> totals() const
+		{
+			std::vector<uint64_t> sums(3 * size, 0);
+			blocks.for_each([&](const detail::counter_block& b)
+			{
+				for(size_t i = 0; i < size; i++)
+				{
+					sums[3 * i] += b[i].time_ns.load(std::memory_order_relaxed);
+					sums[3 * i + 1] += b[i].count.load(std::memory_order_relaxed);
+					sums[3 * i + 2] += b[i].bytes.load(std::memory_order_relaxed);
+				}
+			});
+			std::vector<flow_graph_measures> result(size);
+			for(size_t i = 0; i < size; i++)
+			{
+				result[i].time_ns = double(sums[3 * i]);
+				result[i].count = double(sums[3 * i + 1]);
+				result[i].bytes = double(sums[3 * i + 2]);
+			}
+			return result;
+		}
+
+	private:
+		const size_t size;
+		detail::per_thread<detail::counter_block> blocks;
+	};
+
+	/// Writes flow graph files in the background, so that dumps do not stall the caller
+	/** write() captures the graph into a flow_graph_arena, which is all the calling thread pays
+		for, and queues it. The document is then produced and written into the file by a thread
+		owned by the writer, or by tasks given to an executor; the returned future tells how the
+		dump ended. Dumps run one at a time, in the order in which they were queued.
+
+		The queue is bounded. A dump into a file that already has one waiting replaces it (the
+		older one ends as coalesced, the newer one is queued last), and when max_pending dumps
+		are waiting, the oldest one is dropped. Arenas of finished dumps are reused by the next
+		ones, so the calling thread does not allocate once the dumps have reached their usual size.
+
+		The destructor waits for the queued dumps (with an executor, it must still run the tasks).
+		\code
+		debugviz::flow_graph_async_writer dumps;
+		// In the event loop
+		dumps.write("pipeline.html", "Pipeline", nodes, connections);
+		\endcode
+	*/
+	class flow_graph_async_writer
+	{
+	public:
+		/// Runs a task later, on some thread
+		using executor = std::function<void(std::function<void()>)>;
+
+		/// Writes on a thread of its own
+		explicit flow_graph_async_writer(size_t max_pending = 4) :
+			max_pending(std::max<size_t>(max_pending, 1)), worker([this] { work(); }) {}
+		/// Writes in tasks given to an executor, one task at a time
+		explicit flow_graph_async_writer(executor run, size_t max_pending = 4) :
+			max_pending(std::max<size_t>(max_pending, 1)), run(std::move(run)) {}
+		flow_graph_async_writer(const flow_graph_async_writer&) = delete;
+		flow_graph_async_writer& operator=(const flow_graph_async_writer&) = delete;
+		~flow_graph_async_writer()
+		{
+			wait();
+			if(!worker.joinable()) return;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_one();
+			worker.join();
+		}
+
+		/// Captures a graph (see write_flow_graph for the parameters) and queues its dump into a file
+		template<typename T, typename N, typename C>
+		std::future<flow_graph_dump_result> write(std::string path, const T& title, const N& nodes, const C& connections,
+			const flow_graph_options& options = flow_graph_options())
+		{
+			flow_graph_arena graph;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!spare.empty())
+				{
+					graph = std::move(spare.back());
+					spare.pop_back();
+				}
+			}
+			graph.capture(title, nodes, connections);
+			return write(std::move(path), std::move(graph), options);
+		}
+
+		/// Queues the dump of a graph already captured
+		std::future<flow_graph_dump_result> write(std::string path, flow_graph_arena graph,
+			const flow_graph_options& options = flow_graph_options())
+		{
+			job j{ std::move(path), std::move(graph), options, {} };
+			std::future<flow_graph_dump_result> result = j.done.get_future();
+			bool post = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				const auto same = std::find_if(pending.begin(), pending.end(), [&](const job& p) { return p.path == j.path; });
+				if(same != pending.end())
+				{
+					same->done.set_value(flow_graph_dump_result::coalesced);
+					pending.erase(same);
+				}
+				else if(pending.size() == max_pending)
+				{
+					pending.front().done.set_value(flow_graph_dump_result::dropped);
+					pending.pop_front();
+				}
+				pending.push_back(std::move(j));
+				if(run && !running) post = running = true;
+			}
+			if(post) run([this] { std::unique_lock<std::mutex> lock(mutex); drain(lock); });
+			else if(!run) wake.notify_one();
+			return result;
+		}
+
+		/// Waits until every queued dump has ended
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			idle.wait(lock, [this] { return pending.empty() && !running; });
+		}
+
+	private:
+		struct job
+		{
+			std::string path;
+			flow_graph_arena graph;
+			flow_graph_options options;
+			std::promise<flow_graph_dump_result> done;
+		};
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for(;;)
+			{
+				wake.wait(lock, [this] { return stopping || !pending.empty(); });
+				if(pending.empty()) return;
+				running = true;
+				drain(lock);
+			}
+		}
+
+		void drain(std::unique_lock<std::mutex>& lock)
+		{
+			while(!pending.empty())
+			{
+				job j = std::move(pending.front());
+				pending.pop_front();
+				lock.unlock();
+				dump(j);
+				lock.lock();
+				if(spare.empty()) spare.push_back(std::move(j.graph));
+			}
+			running = false;
+			idle.notify_all();
+		}
+
+		static void dump(job& j)
+		{
+			try
+			{
+				std::ofstream file(j.path, std::ios::binary);
+				if(file) j.graph.write(static_cast<std::ostream&>(file), j.options);
+				file.close();
+				j.done.set_value(file ? flow_graph_dump_result::written : flow_graph_dump_result::failed);
+			}
+			catch(...)
+			{
+				j.done.set_exception(std::current_exception());
+			}
+		}
+
+		const size_t max_pending;
+		const executor run;
+		std::mutex mutex;
+		std::condition_variable wake, idle;
+		std::deque<job> pending;
+		std::vector<flow_graph_arena> spare;
+		bool running = false, stopping = false;
+		std::thread worker;	// Last: started once everything else is constructed
+	};
+
+#if defined(DEBUGVIZ_IMPLEMENTATION)
+namespace detail
+{
+	bool write_flow_graph_erased(erased_stream& stream, graph_source& source, const flow_graph_options& options)
+	{
+		return write_batches(stream, source, options);
+	}
+}
+#endif
+}
+
+#else
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace debugviz
+{
+namespace detail
+{
+	struct empty {};
+	std::ostream& operator<<(std::ostream& os, empty) { return os; }
+}
+	class buffer_sink
+	{
+	public:
+		explicit buffer_sink(int = -1, size_t = 1 << 20) {}
+		buffer_sink(const buffer_sink&) = delete;
+		buffer_sink& operator=(const buffer_sink&) = delete;
+		void write(const char*, size_t) {}
+		void write(char) {}
+		template<size_t N>
+		void literal(const char (&)[N]) {}
+		void flush() {}
+		const char* data() const { return ""; }
+		size_t size() const { return 0; }
+		void clear() {}
+		bool good() const { return true; }
+	};
+
+	template<typename T, typename N, typename C>
+	detail::empty flow_graph(const T&, const N&, const C&, const flow_graph_options& = {}) { return {}; }
+
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph(S& s, const T&, const N&, const C&, const flow_graph_options& = {}) { return s; }
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph(S& s, const T&, const N&, const C&, const flow_graph_options&, flow_graph_write_status&) { return s; }
+	template<typename S, typename T, typename N, typename C>
+	S& write_flow_graph_data(S& s, const T&, const N&, const C&, const flow_graph_options& = {}) { return s; }
+	template<typename S, typename T>
+	S& write_flow_graph_viewer(S& s, const T&) { return s; }
+
+	class flow_graph_layout_cache
+	{
+	public:
+		bool load(const std::string&) { return false; }
+		bool save(const std::string&) const { return false; }
+		size_t size() const { return 0; }
+		void clear() {}
+	};
+
+	class flow_graph_layout
+	{
+	public:
+		explicit flow_graph_layout(size_t = 0) {}
+		size_t add_node(float) { return 0; }
+		void add_edge(size_t, size_t) {}
+		void set_height(size_t, float) {}
+		void set_key(size_t, uint64_t) {}
+		void compute() {}
+		void compute(flow_graph_layout_cache&) {}
+		size_t remove_overlaps(size_t = 100) { return 0; }
+		void compute_clusters(uint32_t = 32) {}
+		size_t cluster(size_t) const { return 0; }
+		size_t parent_cluster(size_t) const { return 0; }
+		size_t cluster_count() const { return 0; }
+		size_t size() const { return 0; }
+		float x(size_t) const { return 0; }
+		float y(size_t) const { return 0; }
+		uint32_t layer(size_t) const { return 0; }
+		float height(size_t) const { return 0; }
+		void set_position(size_t, float, float) {}
+
+		float horizontal_spacing = 0;
+		float vertical_spacing = 0;
+	};
+
+	template<typename S>
+	class flow_graph_writer
+	{
+	public:
+		template<typename T>
+		flow_graph_writer(S&, const T&, size_t = 0) {}
+		template<typename T>
+		flow_graph_writer(S&, const T&, const flow_graph_options&, size_t = 0) {}
+		void begin() {}
+		template<typename N, typename I, typename O, typename G = std::string>
+		void add_node(const N&, const I&, const O&, const flow_graph_measures& = {}, const G& = G()) {}
+		template<typename O, typename OS, typename I, typename IS>
+		void add_connection(const O&, const OS&, const I&, const IS&, const flow_graph_measures& = {}) {}
+		void finish() {}
+		void finish(const flow_graph_layout&) {}
+	};
+
+	template<typename S>
+	class flow_graph_timeline_writer
+	{
+	public:
+		template<typename T>
+		flow_graph_timeline_writer(S&, const T&, const flow_graph_options& = {}, size_t = 0) {}
+		void begin() {}
+		template<typename L, typename N, typename C>
+		void add_frame(const L&, const N&, const C&) {}
+		template<typename N, typename C>
+		void add_frame(const N&, const C&) {}
+		void finish() {}
+	};
+
+	template<typename Node>
+	class flow_graph_subgraph
+	{
+	public:
+		static constexpr size_t npos = size_t(-1);
+		struct connection_view
+		{
+			size_t out, out_slot, in, in_slot;
+			double time_ns, count, bytes;
+		};
+
+		const std::vector<Node>& nodes() const { return no_nodes; }
+		const std::vector<connection_view>& connections() const { return no_connections; }
+		size_t size() const { return 0; }
+		size_t original(size_t) const { return npos; }
+
+	private:
+		std::vector<Node> no_nodes;
+		std::vector<connection_view> no_connections;
+	};
+
+	template<typename Node>
+	class flow_graph_query
+	{
+	public:
+		template<typename N, typename C>
+		flow_graph_query(const N&, const C&) {}
+		size_t node_count() const { return 0; }
+		size_t connection_count() const { return 0; }
+		flow_graph_subgraph<Node> downstream(const std::vector<size_t>&, size_t) const { return {}; }
+		flow_graph_subgraph<Node> upstream(const std::vector<size_t>&, size_t) const { return {}; }
+		flow_graph_subgraph<Node> neighbourhood(const std::vector<size_t>&, size_t) const { return {}; }
+		flow_graph_subgraph<Node> paths(size_t, size_t) const { return {}; }
+		template<typename P>
+		flow_graph_subgraph<Node> matching(P, size_t = 0) const { return {}; }
+		flow_graph_subgraph<Node> subgraph(const std::vector<size_t>&) const { return {}; }
+	};
+
+	struct flow_graph_snapshot
+	{
+		struct node
+		{
+			std::string name;
+			std::vector<std::string> inputs, outputs;
+		};
+		struct connection
+		{
+			size_t out, out_slot, in, in_slot;
+		};
+
+		std::vector<node> nodes;
+		std::vector<connection> connections;
+	};
+
+	class flow_graph_recorder
+	{
+	public:
+		using node_key = uint64_t;
+		using name_id = uint32_t;
+		static constexpr name_id npos = name_id(-1);
+
+		explicit flow_graph_recorder(size_t = 0, size_t = 0) {}
+		name_id intern(const char*, size_t) { return 0; }
+		template<typename T>
+		name_id intern(const T&) { return 0; }
+		void add_node(node_key, name_id) {}
+		void remove_node(node_key) {}
+		void add_input(node_key, name_id) {}
+		void add_output(node_key, name_id) {}
+		void connect(node_key, name_id, node_key, name_id) {}
+		void disconnect(node_key, name_id, node_key, name_id) {}
+		void collect() {}
+		flow_graph_snapshot snapshot() { return {}; }
+		size_t dropped() const { return 0; }
+	};
+
+	class flow_graph_counters
+	{
+	public:
+		struct scoped_timer
+		{
+			~scoped_timer() {}
+			void add_bytes(uint64_t) {}
+		};
+
+		explicit flow_graph_counters(size_t ids) : size(ids) {}
+		void add(size_t, uint64_t, uint64_t = 0) {}
+		scoped_timer time(size_t, uint64_t = 0) { return {}; }
+		std::vector<flow_graph_measures> totals() const { return std::vector<flow_graph_measures>(size); }
+
+	private:
+		size_t size;
+	};
+
+	class flow_graph_arena
+	{
+	public:
+		flow_graph_arena() {}
+		template<typename T, typename N, typename C>
+		flow_graph_arena(const T&, const N&, const C&) {}
+		template<typename T, typename N, typename C>
+		void capture(const T&, const N&, const C&) {}
+		template<typename T>
+		void clear(const T&) {}
+		template<typename Node>
+		void add_node(const Node&) {}
+		template<typename Connection>
+		void add_connection(const Connection&) {}
+		template<typename S>
+		S& write(S& s, const flow_graph_options& = {}) const { return s; }
+		template<typename S>
+		S& write(S& s, const flow_graph_options&, flow_graph_write_status&) const { return s; }
+		size_t node_count() const { return 0; }
+		size_t connection_count() const { return 0; }
+	};
+
+	class flow_graph_async_writer
+	{
+	public:
+		using executor = std::function<void(std::function<void()>)>;
+
+		explicit flow_graph_async_writer(size_t = 0) {}
+		explicit flow_graph_async_writer(executor, size_t = 0) {}
+		template<typename T, typename N, typename C>
+		std::future<flow_graph_dump_result> write(std::string, const T&, const N&, const C&, const flow_graph_options& = {})
+		{
+			return dropped();
+		}
+		std::future<flow_graph_dump_result> write(std::string, flow_graph_arena, const flow_graph_options& = {}) { return dropped(); }
+		void wait() {}
+
+	private:
+		static std::future<flow_graph_dump_result> dropped()
+		{
+			std::promise<flow_graph_dump_result> p;
+			p.set_value(flow_graph_dump_result::dropped);
+			return p.get_future();
+		}
+	};
 }
 
 #endif
@@ -25,72 +25,92 @@
 // NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
 // ///////////////////////////////////////////////////////////////////////////////////////////// //
-function flow_layout(graph)
+function flow_layout(graph, node_height)
 {
 	'use strict';
 
-	var coords = graph.nodes.map(n => { return { name: n.name, x: NaN, y: NaN }; });
-	function successors(node_name)
-	{
-		return [...new Set(graph.connections.filter(c => c.out === node_name).map(c => c.in))];
-	}
-	function predecessors(node_name)
-	{
-		return [...new Set(graph.connections.filter(c => c.in === node_name).map(c => c.out))];
-	}
-	function index(node_name)
-	{
-		return coords.findIndex(n => n.name === node_name);
-	}
+	var n = graph.nodes.length;
+	var successors = graph.nodes.map(() => []);
+	var predecessors = graph.nodes.map(() => []);
+	var c = graph.connections;
+	for(var e = 0; e < c.length; e += 4)
+		if(c[e] !== c[e + 2])
+		{
+			successors[c[e]].push(c[e + 2]);
+			predecessors[c[e + 2]].push(c[e]);
+		}
 
-	// Ordering on X
-	function horiz_right(node_name)
+	// Break cycles: edges going back to a node on the current DFS path are ignored
+	var state = new Uint8Array(n), in_degree = new Uint32Array(n), ignored = new Set();
+	for(var root = 0; root < n; root++)
 	{
-		var i = index(node_name);
-		for(var n of successors(node_name))
+		if(state[root]) continue;
+		var stack = [[root, 0]];
+		state[root] = 1;
+		while(stack.length)
 		{
-			var j = index(n);
-			if(n !== node_name && (isNaN(coords[j].x) || true/* !ancestor */))
+			var top = stack[stack.length - 1], v = top[0];
+			if(top[1] === successors[v].length)
+			{
+				state[v] = 2;
+				stack.pop();
+				continue;
+			}
+			var w = successors[v][top[1]++];
+			if(state[w] === 1) ignored.add(v * n + w);
+			else
 			{
-				coords[j].x = Math.max(coords[i].x + 1, isNaN(coords[j].x) ? -Infinity : coords[j].x);
-				horiz_right(n);
+				in_degree[w]++;
+				if(state[w] === 0)
+				{
+					state[w] = 1;
+					stack.push([w, 0]);
+				}
 			}
 		}
 	}
 
-	function horiz_left(node_name)
-	{
-		var i = index(node_name);
-		for(var n of predecessors(node_name))
-		{
-			var j = index(n);
-			if(n !== node_name && (isNaN(coords[j].x) || true/* !successor */))
+	// Ordering on X: longest path from the sources, in topological order
+	var coords = graph.nodes.map(() => { return { x: 0, y: 0 }; });
+	var order = [];
+	for(var v = 0; v < n; v++)
+		if(!in_degree[v]) order.push(v);
+	for(var i = 0; i < order.length; i++)
+		for(var w of successors[order[i]])
+			if(!ignored.has(order[i] * n + w))
 			{
-				coords[j].x = Math.min(coords[i].x - 1, isNaN(coords[j].x) ? Infinity : coords[j].x);
-				horiz_left(n);
+				coords[w].x = Math.max(coords[w].x, coords[order[i]].x + 1);
+				if(!--in_degree[w]) order.push(w);
 			}
-		}
-	}
+	var layer_count = Math.max(0, ...coords.map(p => p.x + 1));
 
-	var roots = graph.nodes.filter(n => predecessors(n.name).length === 0).map(n => n.name);
-	var leaves = graph.nodes.filter(n => successors(n.name).length === 0).map(n => n.name);
-	for(var t = 0; t < roots.length; t++)
+	// Ordering on Y: nodes of each layer are sorted by the barycenter of their predecessors
+	var layers = [], position = new Float64Array(n);
+	for(var l = 0; l < layer_count; l++) layers.push([]);
+	for(var v of order) layers[coords[v].x].push(v);
+	for(var layer of layers)
 	{
-		coords[index(roots[t])].x = 0;
-		horiz_right(roots[t]);
-	}
-	for(t = 0; t < leaves.length; t++)
-		horiz_left(leaves[t]);
+		var key = new Map(layer.map(v =>
+		{
+			var p = predecessors[v].filter(w => coords[w].x < coords[v].x);
+			return [v, p.length ? p.reduce((s, w) => s + position[w], 0) / p.length : 0];
+		}));
+		layer.sort((a, b) => key.get(a) - key.get(b));
+		layer.forEach((v, i) => position[v] = (i + 0.5) / layer.length);
 
-	var all_x = coords.map(n => n.x);
-	var decal = (Math.max(...all_x) - Math.min(...all_x)) / 2;
-	for(var n of coords)
-		n.x -= decal;
+		var top = 0;
+		for(var v of layer)
+		{
+			coords[v].y = top;
+			top += node_height(graph.nodes[v]) + 80;
+		}
+		for(var v of layer)
+			coords[v].y -= (top - 80) / 2;
+	}
 
-	// Ordering on Y
+	for(var p of coords)
+		p.x -= (layer_count - 1) / 2;
 
 	// We're done
-	coords.index = index;
-	coords.find = function(n) { return coords[coords.index(n)]; };
 	return coords;
 }
\ No newline at end of file
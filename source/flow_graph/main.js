@@ -4,7 +4,7 @@ const minimize_html = require('html-minifier').minify;
 
 // Assemble and minimize scripts
 // ------------------------------------------------------------------------------------------------
-var scripts = ["layout.js", "collisions.js", "render.js"]
+var scripts = ["data.js", "layout.js", "collisions.js", "render.js", "canvas.js", "timeline.js", "viewer.js"]
 var assembled_script = "";
 for(var sc of scripts)
 	assembled_script += fs.readFileSync(sc) + "\n\n";
@@ -39,20 +39,30 @@ var min_html = minimize_html(html, {
 
 // Assemble cpp
 // ------------------------------------------------------------------------------------------------
-var cpp_html = min_html.replace("%CPP_TITLE%", '" << title << "')
-var parts = cpp_html.split("%CPP_STRUCTURE%");
-var cpp_html1 = "\t\tstream << " + [parts[0].slice(0, 79)]
-	.concat(parts[0].slice(79).match(/[\s\S]{1,85}/g))
-	.filter(x => x)
-	.map(l => '"' + l + '"')
-	.join("\n\t\t\t");
-var cpp_html2 = ';\n\t\tstructure();\n\t\tstream << ' + [parts[1].slice(0, 79)]
-	.concat(parts[1].slice(79).match(/[\s\S]{1,85}/g))
-	.filter(x => x)
-	.map(l => '"' + l + '"')
-	.join("\n\t\t\t");
-cpp_html = cpp_html1 + cpp_html2 + ";";
+function cpp_string(name, text)
+{
+	return "\tconstexpr char " + name + "[] =\n\t\t" + text
+		.match(/[\s\S]{1,85}/g)
+		.map(l => '"' + l.split("\\").join("\\\\").split('"').join('\\"') + '"')
+		.join("\n\t\t") + ";";
+}
+var parts = min_html.split(/%CPP_TITLE%|%CPP_STRUCTURE%/);
+var cpp_html = [
+	cpp_string("flow_graph_html_head", parts[0]),
+	cpp_string("flow_graph_html_body", parts[1]),
+	cpp_string("flow_graph_html_tail", parts[2])
+].join("\n");
+function cpp_declaration(name, text)
+{
+	return "\textern const char " + name + "[" + (Buffer.byteLength(text) + 1) + "];";
+}
+var cpp_html_declarations = [
+	cpp_declaration("flow_graph_html_head", parts[0]),
+	cpp_declaration("flow_graph_html_body", parts[1]),
+	cpp_declaration("flow_graph_html_tail", parts[2])
+].join("\n");
 var cpp = "" + fs.readFileSync("flow_graph.h");
-cpp = "// WARNING: auto-generated, do not modify !\n\n" + cpp.replace("%STREAM_PACKED_HTML%", cpp_html);
+cpp = cpp.replace("%FLOW_GRAPH_HTML_DECLARATIONS%", cpp_html_declarations);
+cpp = "// WARNING: auto-generated, do not modify !\n\n" + cpp.replace("%FLOW_GRAPH_HTML%", cpp_html);
 cpp = cpp.split("\r").join("");
-fs.writeFile("../../include/debugviz/flow_graph.h", cpp);
+fs.writeFileSync("../../include/debugviz/flow_graph.h", cpp);
@@ -25,10 +25,28 @@
 // NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
 // ///////////////////////////////////////////////////////////////////////////////////////////// //
-function setup_graph_rendering(graph)
+// The graph is either an object literal, the id of the inert script element holding an encoded
+// payload (which may come after the call in the page), or null for a viewer of data files. It is
+// drawn with svg, or on a canvas if the renderer is 'canvas' (see flow_graph_canvas).
+// Returns an object to stop the rendering (or a promise of it), which can also add and remove
+// nodes and edges (for timelines, always drawn with svg).
+function setup_graph_rendering(graph, renderer)
 {
 	'use strict';
 
+	if(graph === null) return flow_graph_viewer();
+	if(typeof graph === 'string')
+	{
+		var id = graph;
+		if(document.readyState === 'loading')
+			return document.addEventListener('DOMContentLoaded', () => setup_graph_rendering(id, renderer));
+		return flow_graph_load(document.getElementById(id)).then(g => setup_graph_rendering(g, renderer));
+	}
+	graph = flow_graph_data(graph);
+	if(graph.timeline) return flow_graph_timeline(graph);
+	if(renderer === 'canvas') return flow_graph_canvas(graph);
+
+	// Must match flow_graph_metrics in flow_graph.h
 	var node_width = 170;
 	var node_padding = 10;
 	var slot_height = 40;
@@ -37,22 +55,30 @@ function setup_graph_rendering(graph)
 	var separator_height = 10;
 	var separator_count = 8;
 	var edge_strength = 60;
+	// Clusters bigger than this on screen (in pixels) are expanded, unless clicked
+	var expand_size = 400;
 
 	var svg = document.getElementsByTagName('svg')[0];
 	function create_svg(parent, tag)
 	{
 		var e = document.createElementNS('http://www.w3.org/2000/svg', tag);
-		parent.appendChild(e);
+		if(parent) parent.appendChild(e);
 		return e;
 	}
 	var root = create_svg(svg, 'g');
+	// Outlines of expanded clusters, under the edges, under the nodes and collapsed clusters
+	var outline_layer = create_svg(root, 'g'), edge_layer = create_svg(root, 'g'), node_layer = create_svg(root, 'g');
 	function svg_point(x, y) { var p = svg.createSVGPoint(); p.x = x; p.y = y; return p; }
 	var screen_to_root = (x, y) => svg_point(x, y).matrixTransform(root.getCTM().inverse());
 
 	// Setup zoom
 	var view_x = 0, view_y = 0, view_scale = 1;
-	function update_view() { root.setAttribute('transform', 'translate(' + view_x + ', ' + view_y + ') scale(' + view_scale + ')'); }
-	var zoom_drag_pos = null, zoom_init_pos = null;
+	function update_view()
+	{
+		root.setAttribute('transform', 'translate(' + view_x + ', ' + view_y + ') scale(' + view_scale + ')');
+		schedule_refresh();
+	}
+	var zoom_drag_pos = null, zoom_init_pos = null, clicked = null;
 	var drag_mouse_pos = null, drag_node_pos = null;
 	function move_svg(e)
 	{
@@ -67,46 +93,284 @@ function setup_graph_rendering(graph)
 		window.onmouseup = null;
 		return false;
 	}
+	function stop_move(e)
+	{
+		// A cluster clicked without moving is expanded, or collapsed
+		if(clicked && Math.abs(e.clientX - zoom_drag_pos[0]) + Math.abs(e.clientY - zoom_drag_pos[1]) < 4)
+		{
+			clicked.expanded = !is_expanded(clicked);
+			schedule_refresh();
+		}
+		clicked = null;
+		return stop_drag();
+	}
 	svg.onmousedown = function(e)
 	{
-		if(e.target !== svg) return false;
+		var cluster = e.target.closest('.cluster');
+		if(e.target !== svg && !cluster) return false;
+		clicked = cluster && cluster.cluster;
 		zoom_drag_pos = [e.clientX, e.clientY];
 		zoom_init_pos = [view_x, view_y];
 		window.onmousemove = move_svg;
-		window.onmouseup = stop_drag;
+		window.onmouseup = stop_move;
 		return false;
-	}
+	};
 	svg.onwheel = function(e)
 	{
 		var old_scale = view_scale;
-		view_scale = Math.min(3, Math.max(0.1, view_scale * 2 ** (-e.deltaY * 0.05)));
+		view_scale = Math.min(3, Math.max(0.01, view_scale * 2 ** (-e.deltaY * 0.05)));
 		var s = view_scale / old_scale;
 		view_x = (view_x - e.clientX) * s + e.clientX;
 		view_y = (view_y - e.clientY) * s + e.clientY;
 		update_view();
-	}
+	};
 	view_x = (document.body.clientWidth - node_width) / 2;
 	view_y = document.body.clientHeight / 2;
-	update_view();
 
 	// Setup graph
-	flow_layout(graph).forEach(function(p)
-	{
-		var n = graph.nodes.find(m => m.name === p.name);
-		n.x = 1.6 * node_width * p.x;
-		n.y = 0;
-	});
-	for(var n of graph.nodes) setup_node(n);
-	for(var e of graph.connections) setup_edge(e);
+	var node_height = n => title_height + separator_height + slot_height * Math.max(n.inputs.length, n.outputs.length);
+	if(graph.layout)
+		graph.nodes.forEach(function(n, i)
+		{
+			n.x = graph.layout[2 * i];
+			n.y = graph.layout[2 * i + 1];
+		});
+	else
+		flow_layout(graph, node_height).forEach(function(p, i)
+		{
+			var n = graph.nodes[i];
+			n.x = 1.6 * node_width * p.x;
+			n.y = p.y;
+		});
+	// Nodes and clusters without a parent, and what is in the page (see refresh)
+	var roots = new Set(), shown = new Set(), outlines = new Set(), shown_edges = new Set(), merged = new Map();
+	var refresh_request = 0;
+	var clusters = setup_clusters();
+	graph.nodes.forEach(setup_node);
+	clusters.forEach(update_bounds);
+	var edges = [];
+	for(var e = 0, c = graph.connections; e < c.length; e += 4) add_edge(graph.nodes[c[e]], c[e + 1], graph.nodes[c[e + 2]], c[e + 3]);
+	var legend = setup_measures();
 	var sim = createSimulation();
+	update_view();
+	refresh();
+	sim.start(0);
+	return {
+		stop: function() { cancelAnimationFrame(refresh_request); sim.stop(); root.remove(); if(legend) legend.remove(); },
+		// Nodes are added with their position (x, y), and removed with their edges; restart()
+		// lets the collisions settle after changes
+		add_node: function(n) { n.index = graph.nodes.length; graph.nodes.push(n); setup_node(n); schedule_refresh(); },
+		remove_node: remove_node,
+		add_edge: function(out, out_slot, in_, in_slot) { schedule_refresh(); return add_edge(out, out_slot, in_, in_slot); },
+		remove_edge: remove_edge,
+		restart: function() { sim.initialize(); sim.start(0); }
+	};
+
+	// Clusters of nodes: the groups given with the nodes, or else the clusters (of two levels)
+	// found with the layout of big graphs. Clusters of a single element are replaced by it.
+	function setup_clusters()
+	{
+		var list = [], keys = new Map();
+		function cluster(key, label)
+		{
+			var c = keys.get(key);
+			if(!c)
+			{
+				c = { label: label, children: [], parent: null, count: 0, edges: [], expanded: undefined };
+				keys.set(key, c);
+				list.push(c);
+			}
+			return c;
+		}
+		if(graph.nodes.some(n => n.group))
+			graph.nodes.forEach(n => { n.parent = n.group ? cluster('g' + n.group, n.group) : null; });
+		else if(graph.clusters)
+		{
+			graph.nodes.forEach((n, i) => { n.parent = cluster('c' + graph.clusters[i]); });
+			graph.cluster_parents.forEach((p, i) => { keys.get('c' + i).parent = cluster('p' + p); });
+		}
+
+		// Clusters of the first level come first in the list
+		for(var n of graph.nodes)
+			if(n.parent) n.parent.children.push(n);
+		for(var c of list)
+			if(c.parent) c.parent.children.push(c);
+		for(var c of list)
+		{
+			if(c.children.length === 1)
+			{
+				var child = c.children[0];
+				child.parent = c.parent;
+				if(c.parent) c.parent.children[c.parent.children.indexOf(c)] = child;
+				continue;
+			}
+			c.count = c.children.reduce((s, child) => s + (child.children ? child.count : 1), 0);
+			var first = c;
+			while(first.children) first = first.children[0];
+			c.label = c.label ? c.label + ' (' + c.count + ')' : first.name + ' (+' + (c.count - 1) + ')';
+		}
+		list = list.filter(c => c.children.length > 1);
+		list.forEach(function(c, i)
+		{
+			c.id = 'c' + i;
+			if(!c.parent) roots.add(c);
+		});
+		return list;
+	}
+	function is_expanded(c)
+	{
+		return c.expanded !== undefined ? c.expanded : Math.max(c.x1 - c.x0, c.y1 - c.y0) * view_scale > expand_size;
+	}
+	// What a node is shown as: itself, or its outermost collapsed cluster
+	function shown_as(n)
+	{
+		var item = n;
+		for(var c = n.parent; c; c = c.parent)
+			if(!is_expanded(c)) item = c;
+		return item;
+	}
+	// Box of a node (with its slots) or cluster
+	function bounds(item)
+	{
+		if(item.children) return [item.x0, item.y0, item.x1, item.y1];
+		return [item.x - slot_radius, item.y, item.x + node_width + slot_radius, item.y + node_height(item)];
+	}
+	function update_bounds(c)
+	{
+		c.x0 = c.y0 = Infinity;
+		c.x1 = c.y1 = -Infinity;
+		for(var child of c.children)
+		{
+			var b = bounds(child);
+			c.x0 = Math.min(c.x0, b[0] - node_padding);
+			c.y0 = Math.min(c.y0, b[1] - node_padding);
+			c.x1 = Math.max(c.x1, b[2] + node_padding);
+			c.y1 = Math.max(c.y1, b[3] + node_padding);
+		}
+	}
+	// Clusters of moved nodes
+	function update_ancestors(nodes)
+	{
+		for(var n of nodes)
+			for(var c = n.parent; c; c = c.parent) update_bounds(c);
+	}
+
+	// Only what is in the view (with a margin) is in the page: nodes of expanded clusters (or
+	// without cluster), collapsed clusters, outlines of expanded clusters, and the edges of all
+	// of them. Edges going into collapsed clusters are merged into one per pair of ends.
+	function schedule_refresh()
+	{
+		if(!refresh_request) refresh_request = requestAnimationFrame(refresh);
+	}
+	function refresh()
+	{
+		refresh_request = 0;
+		var margin = 200 / view_scale;
+		var x0 = -view_x / view_scale - margin, y0 = -view_y / view_scale - margin;
+		var x1 = (document.body.clientWidth - view_x) / view_scale + margin, y1 = (document.body.clientHeight - view_y) / view_scale + margin;
+		var items = new Set(), open = new Set();
+		(function visit(list)
+		{
+			for(var item of list)
+			{
+				var b = bounds(item);
+				if(b[2] < x0 || b[0] > x1 || b[3] < y0 || b[1] > y1) continue;
+				if(item.children && is_expanded(item))
+				{
+					open.add(item);
+					visit(item.children);
+				}
+				else items.add(item);
+			}
+		})(roots);
+
+		for(var item of shown)
+			if(!items.has(item)) item.element.remove();
+		for(var item of items)
+		{
+			if(!shown.has(item)) node_layer.appendChild(item.element || (item.children ? setup_cluster_element(item) : setup_node_element(item)));
+			if(item.children) place_cluster(item);
+		}
+		for(var c of outlines)
+			if(!open.has(c)) c.outline.remove();
+		for(var c of open)
+		{
+			if(!c.outline)
+			{
+				c.outline = create_svg(null, 'rect');
+				c.outline.setAttribute('class', 'cluster outline');
+				c.outline.cluster = c;
+			}
+			if(!outlines.has(c)) outline_layer.appendChild(c.outline);
+			set_box(c.outline, c);
+		}
+
+		// Edges of what is shown, each one once
+		var seen = new Set(), individual = new Set(), ends = new Map();
+		for(var item of items)
+			for(var edge of item.edges)
+			{
+				if(seen.has(edge)) continue;
+				seen.add(edge);
+				var from = shown_as(edge.nodes[0]), to = shown_as(edge.nodes[1]);
+				if(!from.children && !to.children) individual.add(edge);
+				else if(from !== to)
+				{
+					var key = end_key(from, edge.out_slot) + '>' + end_key(to, edge.in_slot), m = ends.get(key);
+					if(!m) ends.set(key, m = { from: from, out_slot: edge.out_slot, to: to, in_slot: edge.in_slot, count: 0 });
+					m.count++;
+				}
+			}
+		for(var edge of shown_edges)
+			if(!individual.has(edge)) edge.element.remove();
+		for(var edge of individual)
+			if(!shown_edges.has(edge)) edge_layer.appendChild(edge.element || setup_edge_element(edge));
+		for(var [key, m] of merged)
+			if(!ends.has(key)) m.element.remove();
+		for(var [key, m] of ends)
+		{
+			var old = merged.get(key);
+			m.element = old ? old.element : create_svg(edge_layer, 'path');
+			m.element.setAttribute('class', 'edge merged');
+			m.element.style.strokeWidth = 3 + 2 * Math.log2(m.count);
+		}
 
-	function setup_node(node)
+		var moved = items.size !== shown.size || [...items].some(item => !shown.has(item));
+		shown = items;
+		outlines = open;
+		shown_edges = individual;
+		merged = ends;
+		if(moved) sim.set_nodes([...items].filter(item => !item.children));
+		update();
+	}
+	function end_key(item, slot) { return item.children ? item.id : item.index + '.' + slot; }
+	function set_box(e, c)
 	{
-		var g = create_svg(root, 'g');
+		e.setAttribute('x', c.x0);
+		e.setAttribute('y', c.y0);
+		e.setAttribute('width', c.x1 - c.x0);
+		e.setAttribute('height', c.y1 - c.y0);
+	}
+
+	function setup_node(node, index)
+	{
+		if(index !== undefined) node.index = index;
+		node.edges = [];
+		node.vx = node.vy = 0;
+		node.drag = false;
+		if(!node.parent)
+		{
+			node.parent = null;
+			roots.add(node);
+		}
+	}
+	function setup_node_element(node)
+	{
+		var g = create_svg(null, 'g');
 		g.setAttribute('class', 'node');
 		var r = create_svg(g, 'rect');
 		r.setAttribute('width', node_width);
-		r.setAttribute('height', title_height + separator_height + slot_height * Math.max(node.inputs.length, node.outputs.length));
+		r.setAttribute('height', node_height(node));
 		var t = create_svg(g, 'text');
 		t.setAttribute('text-anchor', 'middle');
 		t.setAttribute('dominant-baseline', 'middle');
@@ -114,13 +378,12 @@ function setup_graph_rendering(graph)
 		t.setAttribute('y', title_height / 2.0);
 		t.textContent = node.name;
 		var l = create_svg(g, 'line');
-		l.setAttribute('x1', slot_radius)
-		l.setAttribute('x2', node_width - slot_radius)
-		l.setAttribute('y1', title_height)
-		l.setAttribute('y2', title_height)
+		l.setAttribute('x1', slot_radius);
+		l.setAttribute('x2', node_width - slot_radius);
+		l.setAttribute('y1', title_height);
+		l.setAttribute('y2', title_height);
 		l.setAttribute('stroke-dasharray', (node_width - 2 * slot_radius) / (2 * separator_count - 1));
 		node.element = g;
-		node.drag = false;
 		function drag(e)
 		{
 			var mouse_pos = screen_to_root(e.clientX, e.clientY);
@@ -133,6 +396,8 @@ function setup_graph_rendering(graph)
 			node.drag = false;
 			sim.start(0);
 			drag_mouse_pos = null;
+			update_ancestors([node]);
+			schedule_refresh();
 			return stop_drag();
 		}
 		g.onmousedown = function(e)
@@ -141,11 +406,11 @@ function setup_graph_rendering(graph)
 			node.drag = true;
 			drag_mouse_pos = screen_to_root(e.clientX, e.clientY);
 			drag_node_pos = [node.x, node.y];
-			root.appendChild(g); // Raise node
+			node_layer.appendChild(g); // Raise node
 			window.onmousemove = drag;
 			window.onmouseup = stop_node_drag;
 			return false;
-		}
+		};
 
 		for(var s = 0; s < node.inputs.length; s++) setup_slot(g, node.inputs, s, true);
 		for(var s = 0; s < node.outputs.length; s++) setup_slot(g, node.outputs, s, false);
@@ -164,33 +429,146 @@ function setup_graph_rendering(graph)
 			t.setAttribute('text-anchor', is_input ? 'start' : 'end');
 			t.setAttribute('dominant-baseline', 'middle');
 			t.textContent = slots[index];
-			slots[index] = { name: t.textContent, element: g };
 		}
+		paint_node(node);
+		return g;
+	}
+	function setup_cluster_element(c)
+	{
+		var g = create_svg(null, 'g');
+		g.setAttribute('class', 'cluster');
+		g.cluster = c;
+		create_svg(g, 'rect').setAttribute('rx', 2 * node_padding);
+		var t = create_svg(g, 'text');
+		t.setAttribute('text-anchor', 'middle');
+		t.setAttribute('dominant-baseline', 'middle');
+		t.textContent = c.label;
+		create_svg(g, 'title').textContent = c.count + ' nodes, click to expand';
+		return c.element = g;
 	}
-	function setup_edge(edge)
+	function place_cluster(c)
 	{
-		var e = create_svg(root, 'path');
-		e.setAttribute('class', 'edge');
-		edge.element = e;
-		edge.source = graph.nodes.find(n => n.name === edge.out).outputs.find(s => s.name === edge.out_slot).element;
-		edge.target = graph.nodes.find(n => n.name === edge.in).inputs.find(s => s.name === edge.in_slot).element;
-		root.insertBefore(e, root.firstChild); // Lower the node
+		var r = c.element.firstChild, t = r.nextSibling, w = c.x1 - c.x0, h = c.y1 - c.y0;
+		set_box(r, c);
+		t.setAttribute('x', c.x0 + w / 2);
+		t.setAttribute('y', c.y0 + h / 2);
+		t.style.fontSize = Math.max(14, Math.min(w / 12, h / 3)) + 'px';
 	}
-	function update()
+	function setup_edge_element(edge)
 	{
-		function center_pos(d)
+		edge.element = create_svg(null, 'path');
+		edge.element.setAttribute('class', 'edge');
+		paint_edge(edge);
+		return edge.element;
+	}
+	function add_edge(out, out_slot, in_, in_slot)
+	{
+		var edge = { out_slot: out_slot, in_slot: in_slot, nodes: [out, in_], index: edges.length };
+		edges.push(edge);
+		out.edges.push(edge);
+		if(in_ !== out) in_.edges.push(edge);
+		cluster_edges(edge, (c, e) => c.edges.push(e));
+		return edge;
+	}
+	// Calls f(cluster, edge) for the clusters that the edge goes into or out of
+	function cluster_edges(edge, f)
+	{
+		var from = [], to = [];
+		for(var c = edge.nodes[0].parent; c; c = c.parent) from.push(c);
+		for(var c = edge.nodes[1].parent; c; c = c.parent) to.push(c);
+		for(var c of from) if(!to.includes(c)) f(c, edge);
+		for(var c of to) if(!from.includes(c)) f(c, edge);
+	}
+	function remove(list, item)
+	{
+		var i = list.indexOf(item);
+		if(i >= 0) list.splice(i, 1);
+	}
+	function remove_edge(edge)
+	{
+		if(edge.element) edge.element.remove();
+		shown_edges.delete(edge);
+		var last = edges.pop();
+		if(last !== edge)
 		{
-			var c = d.getElementsByTagName('circle')[0];
-			return svg_point(+c.getAttribute('cx'), +c.getAttribute('cy')).matrixTransform(root.getCTM().inverse().multiply(c.getCTM()));
+			edges[edge.index] = last;
+			last.index = edge.index;
 		}
-		for(var n of graph.nodes)
-			n.element.setAttribute('transform', 'translate(' + n.x + ',' + n.y + ')');
-		for(var e of graph.connections)
+		for(var n of edge.nodes) remove(n.edges, edge);
+		cluster_edges(edge, (c, e) => remove(c.edges, e));
+		schedule_refresh();
+	}
+	function remove_node(node)
+	{
+		while(node.edges.length) remove_edge(node.edges[node.edges.length - 1]);
+		if(node.element) node.element.remove();
+		shown.delete(node);
+		roots.delete(node);
+		if(node.parent) remove(node.parent.children, node);
+		var last = graph.nodes.pop();
+		if(last !== node)
 		{
-			var src = center_pos(e.source);
-			var tgt = center_pos(e.target);
-			e.element.setAttribute('d', `M ${src.x} ${src.y} C ${src.x + edge_strength} ${src.y}, ${tgt.x - edge_strength} ${tgt.y}, ${tgt.x} ${tgt.y}`);
+			graph.nodes[node.index] = last;
+			last.index = node.index;
 		}
+		schedule_refresh();
+	}
+	// Heat overlay (see flow_graph_heat): colours are kept with nodes and edges, and applied to
+	// their elements when in the page
+	function setup_measures()
+	{
+		return flow_graph_heat(graph, edges.length, function(m, node_values, edge_values, scale, heat, format)
+		{
+			graph.nodes.forEach(function(n, i)
+			{
+				var v = node_values[i];
+				n.fill = isNaN(v) ? '' : heat(scale(v), 0.6);
+				n.tip = isNaN(v) ? n.name : n.name + ': ' + format(m, v);
+				if(n.element) paint_node(n);
+			});
+			edges.forEach(function(e, i)
+			{
+				var v = edge_values[i];
+				e.stroke = isNaN(v) ? '' : heat(scale(v), 1);
+				e.width = isNaN(v) ? '' : 2 + 8 * scale(v);
+				if(e.element) paint_edge(e);
+			});
+		});
+	}
+	function paint_node(n)
+	{
+		if(n.tip === undefined) return;
+		n.element.firstChild.style.fill = n.fill;
+		if(!n.tooltip) n.tooltip = create_svg(n.element, 'title');
+		n.tooltip.textContent = n.tip;
+	}
+	function paint_edge(e)
+	{
+		if(e.stroke === undefined) return;
+		e.element.style.stroke = e.stroke;
+		e.element.style.strokeWidth = e.width;
+	}
+	// Ends of edges, computed from the positions (slots are at fixed places in the nodes)
+	function slot_position(n, slot, is_input)
+	{
+		return [n.x + (is_input ? 0 : node_width), n.y + title_height + separator_height + slot_height * (slot + 0.5)];
+	}
+	function end_position(item, slot, is_input)
+	{
+		return item.children ? [is_input ? item.x0 : item.x1, (item.y0 + item.y1) / 2] : slot_position(item, slot, is_input);
+	}
+	function set_path(e, src, tgt)
+	{
+		e.setAttribute('d', `M ${src[0]} ${src[1]} C ${src[0] + edge_strength} ${src[1]}, ${tgt[0] - edge_strength} ${tgt[1]}, ${tgt[0]} ${tgt[1]}`);
+	}
+	function update()
+	{
+		for(var n of shown)
+			if(!n.children) n.element.setAttribute('transform', 'translate(' + n.x + ',' + n.y + ')');
+		for(var e of shown_edges)
+			set_path(e.element, slot_position(e.nodes[0], e.out_slot, false), slot_position(e.nodes[1], e.in_slot, true));
+		for(var m of merged.values())
+			set_path(m.element, end_position(m.from, m.out_slot, false), end_position(m.to, m.in_slot, true));
 	}
 	function createSimulation()
 	{
@@ -202,32 +580,94 @@ function setup_graph_rendering(graph)
 		var deltaTime = 20;
 		var timer;
 
-		for(var n of graph.nodes) n.vx = n.vy = 0;
-
+		// Only the nodes in the page move, the others keep their position
+		var nodes = [];
 		var bbox = bbox_collisions(d => [
 			[-node_padding - slot_radius * 2, -node_padding - slot_radius],
-			[node_padding + node_width + slot_radius * 2, node_padding + slot_radius + title_height + separator_height + slot_height * Math.max(d.inputs.length, d.outputs.length)]
-			]);
-		bbox.initialize(graph.nodes);
+			[node_padding + node_width + slot_radius * 2, node_padding + slot_radius + node_height(d)]
+		]);
+		function initialize() { alpha = 1; bbox.initialize(nodes); }
+		function set_nodes(n) { nodes = n; bbox.initialize(nodes); }
+		initialize();
 
 		function stop() { clearInterval(timer); };
 		function step()
 		{
 			alpha += (alphaTarget - alpha) * alphaDecay;
 			bbox(alpha);
-			for(var n of graph.nodes)
+			for(var n of nodes)
 			{
 				if(n.drag) { n.vx = n.vy = 0; continue; }
 				n.x += n.vx *= velocityDecay;
 				n.y += n.vy *= velocityDecay;
 			}
 			update();
-			if(alpha < alphaMin) stop();
+			if(alpha < alphaMin)
+			{
+				stop();
+				update_ancestors(nodes);
+				schedule_refresh();
+			}
 		}
 		function start(a) { alphaTarget = a; stop(); timer = setInterval(step, deltaTime); };
 
-		update();
-		start(0);
-		return { start: start, stop: stop };
+		return { start: start, stop: stop, initialize: initialize, set_nodes: set_nodes };
+	}
+}
+
+// Heat overlay: nodes are coloured, and edges coloured and sized, by one of the measures (on a
+// log scale), picked in a legend. paint(measure, node_values, edge_values, scale, heat, format)
+// is called for each measure picked, with scale(v) in [0, 1], heat(t, alpha) its colour, and
+// format(measure, v) its text. Returns the legend, or null without measures.
+function flow_graph_heat(graph, edge_count, paint)
+{
+	'use strict';
+
+	var em = graph.edge_measures;
+	var present = flow_graph_measures.filter((m, k) => graph.nodes.some(n => typeof n[m] === 'number')
+		|| (em && em.some((v, i) => i % 3 === k && !isNaN(v))));
+	if(!present.length) return null;
+
+	var legend = document.createElement('div');
+	legend.style.cssText = 'position: fixed; bottom: 8px; left: 8px; font: 12px Verdana; display: flex; align-items: center; gap: 6px;';
+	var select = document.createElement('select');
+	for(var m of present)
+	{
+		var o = document.createElement('option');
+		o.value = o.textContent = m;
+		select.appendChild(o);
+	}
+	var low = document.createElement('span'), bar = document.createElement('span'), high = document.createElement('span');
+	bar.style.cssText = 'width: 120px; height: 10px; background: linear-gradient(to right, ' + heat(0, 1) + ', ' + heat(0.5, 1) + ', ' + heat(1, 1) + ');';
+	for(var e of [select, low, bar, high]) legend.appendChild(e);
+	document.body.appendChild(legend);
+	select.onchange = () => show(select.value);
+	show(present[0]);
+	return legend;
+
+	function heat(t, alpha) { return 'hsla(' + Math.round(240 * (1 - t)) + ', 85%, 55%, ' + alpha + ')'; }
+	function format(m, v)
+	{
+		var units = m === 'time_ns' ? [[1e9, ' s'], [1e6, ' ms'], [1e3, ' us'], [1, ' ns']]
+			: m === 'bytes' ? [[2 ** 30, ' GiB'], [2 ** 20, ' MiB'], [2 ** 10, ' KiB'], [1, ' B']]
+			: [[1e9, 'G'], [1e6, 'M'], [1e3, 'k'], [1, '']];
+		var u = units.find(u => Math.abs(v) >= u[0]) || units[units.length - 1];
+		return +(v / u[0]).toPrecision(3) + u[1];
+	}
+	function show(m)
+	{
+		var k = flow_graph_measures.indexOf(m);
+		var node_values = graph.nodes.map(n => typeof n[m] === 'number' ? n[m] : NaN);
+		var edge_values = new Float64Array(edge_count).map((v, i) => em ? em[3 * i + k] : NaN);
+		var min = Infinity, max = -Infinity;
+		for(var values of [node_values, edge_values])
+			for(var v of values)
+				if(!isNaN(v)) { min = Math.min(min, v); max = Math.max(max, v); }
+		var log = v => Math.log1p(Math.max(v, 0)), range = log(max) - log(min) || 1;
+		var scale = v => (log(v) - log(min)) / range;
+
+		paint(m, node_values, edge_values, scale, heat, format);
+		low.textContent = min <= max ? format(m, min) : '';
+		high.textContent = min <= max ? format(m, max) : '';
 	}
 }
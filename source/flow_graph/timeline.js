@@ -0,0 +1,164 @@
+// BSD 3-Clause Licence //////////////////////////////////////////////////////////////////////// //
+// Copyright (c) 2017 Thibault Lescoat, All rights reserved.                                     //
+//                                                                                               //
+// Redistribution and use in source and binary forms, with or without modification, are          //
+// permitted provided that the following conditions are met:                                     //
+//                                                                                               //
+// * Redistributions of source code must retain the above copyright notice, this list of         //
+//   conditions and the following disclaimer.                                                    //
+//                                                                                               //
+// * Redistributions in binary form must reproduce the above copyright notice, this list of      //
+//   conditions and the following disclaimer in the documentation and/or other materials         //
+//   provided with the distribution.                                                             //
+//                                                                                               //
+// * Neither the name of the copyright holder nor the names of its contributors may be used to   //
+//   endorse or promote products derived from this software without specific prior written       //
+//   permission.                                                                                 //
+//                                                                                               //
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS   //
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF               //
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE    //
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,     //
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE //
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED    //
+// AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     //
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
+// Normalizes the graph given as a JavaScript object literal
+// Graph changing over time (see flow_graph_timeline_writer in flow_graph.h): frames hold the
+// differences with the previous one, which are applied (or reverted) one after the other to move
+// between frames. Nodes have a fixed id, and their position in the layout of all of them.
+function flow_graph_timeline(graph)
+{
+	'use strict';
+
+	var frames = graph.timeline, layout = graph.layout || [];
+	var view = setup_graph_rendering({ nodes: [], connections: new Uint32Array(0), layout: [] });
+	var live = new Map(), connected = new Map(), undo = [], current = -1;
+
+	function add_node(id, def, x, y)
+	{
+		var n = { name: def.name, inputs: def.inputs.slice(), outputs: def.outputs.slice(), id: id, def: def };
+		n.x = x === undefined ? layout[2 * id] || 0 : x;
+		n.y = y === undefined ? layout[2 * id + 1] || 0 : y;
+		view.add_node(n);
+		live.set(id, n);
+		return n;
+	}
+	function connect(c)
+	{
+		var out = live.get(c[0]), in_ = live.get(c[2]);
+		if(connected.has(c.join())) return;
+		if(!out || !in_ || c[1] >= out.outputs.length || c[3] >= in_.inputs.length) return;
+		var edge = view.add_edge(out, c[1], in_, c[3]);
+		edge.key = c.join();
+		edge.connection = c;
+		connected.set(edge.key, edge);
+	}
+	function disconnect(key)
+	{
+		var edge = connected.get(key);
+		if(!edge) return null;
+		view.remove_edge(edge);
+		connected.delete(key);
+		return edge.connection;
+	}
+	// Removes a node with its edges, returns what is needed to put them back
+	function remove_node(id)
+	{
+		var n = live.get(id);
+		if(!n) return null;
+		var saved = { id: id, def: n.def, x: n.x, y: n.y, connections: n.edges.map(e => e.connection) };
+		for(var e of n.edges) connected.delete(e.key);
+		view.remove_node(n);
+		live.delete(id);
+		return saved;
+	}
+
+	// Applies a frame, returns how to revert it
+	function apply(frame)
+	{
+		var revert = { removed: [], added: [], connected: [], disconnected: [] };
+		for(var id of frame.removed || [])
+		{
+			var saved = remove_node(id);
+			if(saved) revert.removed.push(saved);
+		}
+		for(var [id, def] of frame.nodes || [])
+		{
+			var old = remove_node(id);
+			if(old) revert.removed.push(old);
+			add_node(id, def, old ? old.x : undefined, old ? old.y : undefined);
+			revert.added.push(id);
+		}
+		for(var c of frame.disconnect || [])
+		{
+			var removed = disconnect(c.join());
+			if(removed) revert.disconnected.push(removed);
+		}
+		for(var c of frame.connect || [])
+		{
+			connect(c);
+			revert.connected.push(c.join());
+		}
+		return revert;
+	}
+	function revert(r)
+	{
+		for(var key of r.connected) disconnect(key);
+		for(var c of r.disconnected) connect(c);
+		for(var id of r.added) remove_node(id);
+		// Nodes first, as their edges may link them together
+		for(var saved of r.removed) add_node(saved.id, saved.def, saved.x, saved.y);
+		for(var saved of r.removed)
+			for(var c of saved.connections) connect(c);
+	}
+
+	// Slider, with the label of the frame and a button to play the frames
+	var panel = document.createElement('div');
+	panel.style.cssText = 'position: fixed; bottom: 8px; right: 8px; font: 12px Verdana; display: flex; align-items: center; gap: 6px;';
+	var play = document.createElement('button'), slider = document.createElement('input'), label = document.createElement('span');
+	play.textContent = 'play';
+	slider.type = 'range';
+	slider.min = 0;
+	slider.max = Math.max(frames.length - 1, 0);
+	slider.value = 0;
+	slider.style.width = '300px';
+	for(var e of [play, slider, label]) panel.appendChild(e);
+	document.body.appendChild(panel);
+
+	var timer = null;
+	function pause()
+	{
+		clearInterval(timer);
+		timer = null;
+		play.textContent = 'play';
+	}
+	play.onclick = function()
+	{
+		if(timer) return pause();
+		if(current >= frames.length - 1) show(0);
+		play.textContent = 'pause';
+		timer = setInterval(function()
+		{
+			if(current >= frames.length - 1) return pause();
+			show(current + 1);
+		}, 500);
+	};
+	slider.oninput = () => show(+slider.value);
+
+	function show(i)
+	{
+		while(current < i) undo[++current] = apply(frames[current]);
+		while(current > i) revert(undo[current--]);
+		slider.value = current;
+		label.textContent = (current + 1) + ' / ' + frames.length + (frames[current] ? ': ' + frames[current].label : '');
+		view.restart();
+	}
+	show(frames.length ? 0 : -1);
+
+	return {
+		stop: function() { pause(); panel.remove(); view.stop(); },
+		show: show
+	};
+}
@@ -0,0 +1,130 @@
+// BSD 3-Clause Licence //////////////////////////////////////////////////////////////////////// //
+// Copyright (c) 2017 Thibault Lescoat, All rights reserved.                                     //
+//                                                                                               //
+// Redistribution and use in source and binary forms, with or without modification, are          //
+// permitted provided that the following conditions are met:                                     //
+//                                                                                               //
+// * Redistributions of source code must retain the above copyright notice, this list of         //
+//   conditions and the following disclaimer.                                                    //
+//                                                                                               //
+// * Redistributions in binary form must reproduce the above copyright notice, this list of      //
+//   conditions and the following disclaimer in the documentation and/or other materials         //
+//   provided with the distribution.                                                             //
+//                                                                                               //
+// * Neither the name of the copyright holder nor the names of its contributors may be used to   //
+//   endorse or promote products derived from this software without specific prior written       //
+//   permission.                                                                                 //
+//                                                                                               //
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS   //
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF               //
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE    //
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,     //
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE //
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED    //
+// AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     //
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF          //
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                                    //
+// ///////////////////////////////////////////////////////////////////////////////////////////// //
+
+// Receives the content of data scripts (see write_flow_graph_data): each script element loaded by
+// the viewer has its own callback, so that loads can overlap
+var flow_graph_script_loaded = new Map();
+function flow_graph_data_file(file)
+{
+	var loaded = flow_graph_script_loaded.get(document.currentScript);
+	if(loaded) loaded(file);
+}
+
+// Page without graph (see write_flow_graph_viewer): data files given in the query string
+// (?data=a.js&data=b.json) or picked are listed, and shown one at a time
+function flow_graph_viewer()
+{
+	'use strict';
+
+	var files = [], shown = null, request = 0;
+
+	var panel = document.createElement('div');
+	panel.style.cssText = 'position: fixed; top: 8px; left: 8px; font: 12px Verdana;';
+	document.body.appendChild(panel);
+	var list = document.createElement('select');
+	list.style.maxWidth = '400px';
+	list.onchange = () => show(list.selectedIndex);
+	panel.appendChild(list);
+	function picker(label, directory)
+	{
+		var l = document.createElement('label'), input = document.createElement('input');
+		l.textContent = ' ' + label + ' ';
+		input.type = 'file';
+		input.multiple = true;
+		if(directory) input.setAttribute('webkitdirectory', '');
+		input.style.display = 'none';
+		input.onchange = () => set_files(Array.from(input.files)
+			.filter(f => /\.(js|json)$/.test(f.name))
+			.sort((a, b) => a.name < b.name ? -1 : a.name > b.name ? 1 : 0)
+			.map(f => ({ name: f.webkitRelativePath || f.name, read: () => f.text().then(parse) })));
+		l.style.cursor = 'pointer';
+		l.appendChild(input);
+		panel.appendChild(l);
+	}
+	picker('[open files]', false);
+	picker('[open directory]', true);
+
+	// Scripts are 'flow_graph_data_file({...});', the argument is read as json (without running it)
+	function parse(text)
+	{
+		text = text.trim();
+		if(text[0] !== '{') text = text.slice(text.indexOf('(') + 1, text.lastIndexOf(')'));
+		return JSON.parse(text);
+	}
+	function load_script(name)
+	{
+		return new Promise(function(resolve, reject)
+		{
+			// Settled once the script ran (or failed to load), with what it gave
+			var s = document.createElement('script'), file = null;
+			flow_graph_script_loaded.set(s, f => { file = f; });
+			s.onload = s.onerror = function()
+			{
+				flow_graph_script_loaded.delete(s);
+				s.remove();
+				if(file) resolve(file);
+				else reject(new Error('Cannot load ' + name));
+			};
+			s.src = name;
+			document.head.appendChild(s);
+		});
+	}
+	function set_files(f)
+	{
+		files = f;
+		list.replaceChildren();
+		for(var file of files)
+		{
+			var option = document.createElement('option');
+			option.textContent = file.name;
+			list.appendChild(option);
+		}
+		if(files.length) show(0);
+	}
+	function show(i)
+	{
+		var r = ++request;
+		list.selectedIndex = i;
+		files[i].read()
+			.then(f => Promise.resolve(f.graph ? flow_graph_data(f.graph) : flow_graph_unpack(f.data, f.payload, f.compression))
+				.then(function(graph)
+				{
+					if(r !== request) return;
+					document.title = f.title;
+					if(shown) shown.stop();
+					shown = setup_graph_rendering(graph, f.renderer);
+				}))
+			.catch(e => console.error(e));
+	}
+
+	var query = new URLSearchParams(location.search).getAll('data');
+	set_files(query.map(name => ({
+		name: name,
+		read: () => /\.json$/.test(name) ? fetch(name).then(r => r.json()) : load_script(name)
+	})));
+}
@@ -0,0 +1,121 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using debugviz::flow_graph_dump_result;
+
+struct node
+{
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+	double time_ns;
+};
+struct connection
+{
+	size_t out, out_slot, in, in_slot;
+};
+struct named_connection
+{
+	std::string out, out_slot, in, in_slot;
+	int bytes;
+};
+
+template<typename N, typename C>
+static std::string written(const N& nodes, const C& connections, const debugviz::flow_graph_options& options = {})
+{
+	std::ostringstream out;
+	debugviz::write_flow_graph(out, "Test <async>", nodes, connections, options);
+	return out.str();
+}
+static std::string written(const debugviz::flow_graph_arena& arena, const debugviz::flow_graph_options& options = {})
+{
+	std::ostringstream out;
+	arena.write(out, options);
+	return out.str();
+}
+static std::string file(const char* path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int main()
+{
+	std::vector<node> nodes =
+	{
+		{ "source", {}, { "data", "\"quoted\"" }, 1500 },
+		{ "filter", { "data" }, { "data" }, 250.5 },
+		{ "sink", { "data", "spare" }, {}, 0 }
+	};
+	const std::vector<connection> links = { { 0, 0, 1, 0 }, { 1, 0, 2, 0 }, { 0, 1, 2, 1 }, { 0, 0, 7, 0 } };
+	const std::vector<named_connection> named =
+	{
+		{ "source", "data", "filter", "data", 64 },
+		{ "filter", "data", "sink", "data", 128 },
+		{ "source", "missing", "sink", "spare", 1 }
+	};
+
+	// A captured graph is written exactly as the ranges it was taken from
+	{
+		const debugviz::flow_graph_arena by_index("Test <async>", nodes, links), by_name("Test <async>", nodes, named);
+		CHECK(written(by_index) == written(nodes, links));
+		CHECK(written(by_name) == written(nodes, named));
+		const debugviz::flow_graph_options binary = { debugviz::flow_graph_payload::binary, debugviz::flow_graph_compression::deflate };
+		CHECK(written(by_index, binary) == written(nodes, links, binary));
+		CHECK(written(by_name, binary) == written(nodes, named, binary));
+
+		// The copy does not depend on the original ranges
+		debugviz::flow_graph_arena reused(by_name);
+		const std::string before = written(nodes, links);
+		nodes[0].name = "changed";
+		CHECK(written(by_index) == before);
+		reused.capture("Test <async>", nodes, links);
+		CHECK(written(reused) == written(nodes, links));
+		nodes[0].name = "source";
+	}
+
+	// Own thread
+	{
+		debugviz::flow_graph_async_writer writer;
+		auto a = writer.write("test_async.html", "Test <async>", nodes, links);
+		auto b = writer.write("test_async_named.html", "Test <async>", nodes, named);
+		CHECK(a.get() == flow_graph_dump_result::written && b.get() == flow_graph_dump_result::written);
+		CHECK(file("test_async.html") == written(nodes, links));
+		CHECK(file("test_async_named.html") == written(nodes, named));
+		CHECK(writer.write("missing_directory/test.html", "Test", nodes, links).get() == flow_graph_dump_result::failed);
+		debugviz::flow_graph_options unwritable;
+		unwritable.layout_cache = "missing_directory/test_layout_cache.bin";
+		CHECK(writer.write("test_async.html", "Test <async>", nodes, links, unwritable).get() == flow_graph_dump_result::written);
+	}
+
+	// Executor, whose tasks are run by hand: dumps queued meanwhile are coalesced or dropped
+	{
+		std::vector<std::function<void()>> tasks;
+		debugviz::flow_graph_async_writer writer([&](std::function<void()> task) { tasks.push_back(std::move(task)); }, 2);
+		auto first = writer.write("test_async_a.html", "A", nodes, links);
+		auto second = writer.write("test_async_b.html", "B", nodes, links);
+		auto latest_a = writer.write("test_async_a.html", "A (latest)", nodes, links);
+		CHECK(first.get() == flow_graph_dump_result::coalesced);
+		auto c = writer.write("test_async_c.html", "C", nodes, links);
+		CHECK(second.get() == flow_graph_dump_result::dropped);
+		REQUIRE(tasks.size() == 1);
+
+		tasks[0]();
+		CHECK(latest_a.get() == flow_graph_dump_result::written && c.get() == flow_graph_dump_result::written);
+		CHECK(file("test_async_a.html").find("<title>A (latest)</title>") != std::string::npos);
+
+		// A new task is posted once the previous one has ended
+		auto d = writer.write("test_async_a.html", "A (again)", nodes, links);
+		REQUIRE(tasks.size() == 2);
+		tasks[1]();
+		CHECK(d.get() == flow_graph_dump_result::written);
+	}
+
+	return check_result();
+}
@@ -0,0 +1,250 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "connectivity.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Serialization and layout of synthetic graphs, results are written as JSON:
+//   debugviz_bench [node count = 20000] [output file = stdout]
+
+// Allocation counting: every allocation carries its size in a header
+namespace
+{
+	struct allocation_stats
+	{
+		size_t count = 0, live = 0, peak = 0;
+		size_t live_bytes = 0, peak_bytes = 0;
+	};
+	allocation_stats allocations;
+	const size_t header_size = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+}
+
+void* operator new(size_t size)
+{
+	char* p = static_cast<char*>(std::malloc(size + header_size));
+	if(!p) throw std::bad_alloc();
+	*reinterpret_cast<size_t*>(p) = size;
+	allocations.count++;
+	allocations.peak = std::max(allocations.peak, ++allocations.live);
+	allocations.peak_bytes = std::max(allocations.peak_bytes, allocations.live_bytes += size);
+	return p + header_size;
+}
+void operator delete(void* p) noexcept
+{
+	if(!p) return;
+	char* block = static_cast<char*>(p) - header_size;
+	allocations.live--;
+	allocations.live_bytes -= *reinterpret_cast<size_t*>(block);
+	std::free(block);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+struct graph
+{
+	std::string kind;
+	std::vector<node> nodes;
+	std::vector<connection> connections;
+
+	void add_node(size_t inputs, size_t outputs)
+	{
+		node n{ "node_" + std::to_string(nodes.size()), {}, {} };
+		for(size_t i = 0; i < inputs; i++) n.inputs.push_back("in_" + std::to_string(i));
+		for(size_t i = 0; i < outputs; i++) n.outputs.push_back("out_" + std::to_string(i));
+		nodes.push_back(std::move(n));
+	}
+	size_t slots() const
+	{
+		size_t count = 0;
+		for(const node& n : nodes) count += n.inputs.size() + n.outputs.size();
+		return count;
+	}
+};
+
+// Generators
+static graph chain(size_t n)
+{
+	graph g{ "chain", {}, {} };
+	for(size_t i = 0; i < n; i++) g.add_node(1, 1);
+	for(size_t i = 0; i + 1 < n; i++) g.connections.push_back({ i, 0, i + 1, 0 });
+	return g;
+}
+
+// One source feeding every node of a middle layer, all gathered by one sink
+static graph fan(size_t n)
+{
+	graph g{ "fan", {}, {} };
+	const size_t middle = n - 2;
+	g.add_node(0, 1);
+	for(size_t i = 0; i < middle; i++) g.add_node(1, 1);
+	g.add_node(middle, 0);
+	for(size_t i = 0; i < middle; i++)
+	{
+		g.connections.push_back({ 0, 0, i + 1, 0 });
+		g.connections.push_back({ i + 1, 0, n - 1, i });
+	}
+	return g;
+}
+
+// Random edges going from one layer to a later one, 'back_edges' of them in the other direction
+static graph layered(size_t n, size_t layer_count, size_t edges_per_node, double back_edges, unsigned seed)
+{
+	graph g{ back_edges > 0 ? "cyclic" : "layered_dag", {}, {} };
+	std::mt19937 rng(seed);
+	for(size_t i = 0; i < n; i++) g.add_node(1 + rng() % 4, 1 + rng() % 4);
+
+	const size_t per_layer = n / layer_count;
+	std::bernoulli_distribution backward(back_edges);
+	for(size_t i = 0; i < n * edges_per_node; i++)
+	{
+		const size_t layer = rng() % (layer_count - 1), next = layer + 1 + rng() % (layer_count - layer - 1);
+		size_t out = layer * per_layer + rng() % per_layer, in = next * per_layer + rng() % per_layer;
+		if(backward(rng)) std::swap(out, in);
+		g.connections.push_back({ out, rng() % g.nodes[out].outputs.size(), in, rng() % g.nodes[in].inputs.size() });
+	}
+	return g;
+}
+
+// Few nodes with many slots each
+static graph wide_slots(size_t n, size_t slots, unsigned seed)
+{
+	graph g{ "wide_slots", {}, {} };
+	std::mt19937 rng(seed);
+	const size_t count = std::max<size_t>(n / slots, 2);
+	for(size_t i = 0; i < count; i++) g.add_node(slots, slots);
+	for(size_t i = 0; i + 1 < count; i++)
+		for(size_t s = 0; s < slots; s++)
+			g.connections.push_back({ i, s, i + 1 + rng() % (count - i - 1), rng() % slots });
+	return g;
+}
+
+struct result
+{
+	double seconds;
+	size_t bytes;
+	allocation_stats allocations;
+};
+
+// Best of a few runs, allocations are those of the last one (peaks are relative to the start)
+static result measure(const std::function<size_t()>& f, int runs = 3)
+{
+	result r{ 1e300, 0, {} };
+	for(int i = 0; i < runs; i++)
+	{
+		allocations.count = 0;
+		allocations.peak = allocations.live;
+		allocations.peak_bytes = allocations.live_bytes;
+		const allocation_stats before = allocations;
+
+		const auto start = std::chrono::steady_clock::now();
+		r.bytes = f();
+		r.seconds = std::min(r.seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		r.allocations = allocations;
+		r.allocations.peak -= before.live;
+		r.allocations.peak_bytes -= before.live_bytes;
+	}
+	return r;
+}
+
+template<typename C>
+static size_t write_ofstream(const graph& g, const C& connections, const debugviz::flow_graph_options& options)
+{
+	std::ofstream file("bench.html", std::ios::binary);
+	debugviz::write_flow_graph(file, g.kind, g.nodes, connections, options);
+	return size_t(file.tellp());
+}
+template<typename C>
+static size_t write_ostringstream(const graph& g, const C& connections, const debugviz::flow_graph_options& options)
+{
+	std::ostringstream out;
+	debugviz::write_flow_graph(out, g.kind, g.nodes, connections, options);
+	return size_t(out.tellp());
+}
+
+int main(int argc, char** argv)
+{
+	const size_t n = argc > 1 ? std::max<size_t>(std::strtoul(argv[1], nullptr, 10), 100) : 20000;
+	FILE* out = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+	if(!out) return 1;
+
+	const std::vector<graph> graphs =
+	{
+		chain(n),
+		fan(n),
+		layered(n, 20, 4, 0, 1),
+		layered(n, 20, 4, 0.1, 2),
+		wide_slots(n, 32, 3)
+	};
+
+	std::fprintf(out, "{\n\t\"benchmark\": \"debugviz\",\n\t\"scale\": %zu,\n\t\"results\": [", n);
+	const char* separator = "\n";
+	for(const graph& g : graphs)
+	{
+		const connectivity by_name(g.nodes, g.connections);
+
+		const result layout = measure([&]
+		{
+			debugviz::flow_graph_layout l;
+			for(const node& v : g.nodes) l.add_node(debugviz::detail::flow_graph_metrics::node_height(v.inputs.size(), v.outputs.size()));
+			for(const connection& c : g.connections) l.add_edge(c.out, c.in);
+			l.compute();
+			return size_t(0);
+		});
+
+		std::fprintf(out, "%s\t\t{\n\t\t\t\"graph\": \"%s\", \"nodes\": %zu, \"edges\": %zu, \"slots\": %zu,\n"
+			"\t\t\t\"layout_ms\": %.3f,\n\t\t\t\"writes\": [", separator, g.kind.c_str(), g.nodes.size(),
+			g.connections.size(), g.slots(), layout.seconds * 1000);
+
+		using namespace debugviz;
+		const flow_graph_options json, binary = { flow_graph_payload::binary },
+			json_deflate = { flow_graph_payload::json, flow_graph_compression::deflate },
+			binary_deflate = { flow_graph_payload::binary, flow_graph_compression::deflate };
+		struct run
+		{
+			const char* sink; const char* connections; const char* payload; const char* compression;
+			const flow_graph_options& options; std::function<size_t()> f;
+		};
+		const run runs[] =
+		{
+			{ "ofstream", "indices", "json", "none", json, [&] { return write_ofstream(g, g.connections, json); } },
+			{ "ofstream", "connectivity", "json", "none", json, [&] { return write_ofstream(g, by_name, json); } },
+			{ "ostringstream", "indices", "json", "none", json, [&] { return write_ostringstream(g, g.connections, json); } },
+			{ "ostringstream", "connectivity", "json", "none", json, [&] { return write_ostringstream(g, by_name, json); } },
+			{ "ofstream", "indices", "binary", "none", binary, [&] { return write_ofstream(g, g.connections, binary); } },
+			{ "ostringstream", "indices", "binary", "none", binary, [&] { return write_ostringstream(g, g.connections, binary); } },
+			{ "ofstream", "indices", "json", "deflate", json_deflate, [&] { return write_ofstream(g, g.connections, json_deflate); } },
+			{ "ofstream", "indices", "binary", "deflate", binary_deflate, [&] { return write_ofstream(g, g.connections, binary_deflate); } }
+		};
+		const graph empty{ g.kind, {}, {} };
+		const std::vector<connection> none;
+		const char* run_separator = "\n";
+		for(const run& r : runs)
+		{
+			const result w = measure(r.f);
+			// Sizes apart: the page alone, what the nodes add to it, then what the edges add
+			const size_t page = write_ostringstream(empty, none, r.options), with_nodes = write_ostringstream(g, none, r.options);
+			std::fprintf(out, "%s\t\t\t\t{ \"sink\": \"%s\", \"connections\": \"%s\", \"payload\": \"%s\", \"compression\": \"%s\", \"ms\": %.3f, \"bytes\": %zu,"
+				" \"mb_per_s\": %.1f, \"edges_per_s\": %.0f, \"page_bytes\": %zu, \"bytes_per_node\": %.1f, \"bytes_per_edge\": %.1f,"
+				" \"allocations\": %zu, \"peak_allocations\": %zu, \"peak_allocated_bytes\": %zu }",
+				run_separator, r.sink, r.connections, r.payload, r.compression, w.seconds * 1000, w.bytes,
+				double(w.bytes) / w.seconds / 1e6, double(g.connections.size()) / w.seconds, page,
+				(double(with_nodes) - double(page)) / double(g.nodes.size()),
+				(double(w.bytes) - double(with_nodes)) / double(std::max<size_t>(g.connections.size(), 1)),
+				w.allocations.count, w.allocations.peak, w.allocations.peak_bytes);
+			run_separator = ",\n";
+		}
+		std::fprintf(out, "\n\t\t\t]\n\t\t}");
+		separator = ",\n";
+	}
+	std::fprintf(out, "\n\t]\n}\n");
+	if(out != stdout) std::fclose(out);
+}
@@ -0,0 +1,47 @@
+#include "../../include/debugviz/flow_graph.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Throughput of the escaping of mostly clean names (one special character every ~4 KiB)
+template<typename F>
+static double gigabytes_per_second(const std::string& input, F escape)
+{
+	size_t written = 0;
+	debugviz::detail::text_buffer buffer(64 * 1024, [](void* w, const char*, size_t n) { *static_cast<size_t*>(w) += n; }, &written);
+	const int repeats = 20;
+	const auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < repeats; i++) escape(buffer, input.data(), input.size());
+	buffer.flush();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return double(input.size()) * repeats / seconds / 1e9;
+}
+
+struct scalar_json_escape
+{
+	static void write(debugviz::detail::text_buffer& b, const char* s, size_t n)
+	{
+		using special = debugviz::detail::json_escape::special;
+		for(size_t i = 0;;)
+		{
+			const size_t j = i + debugviz::detail::find_scalar<special>(s + i, n - i);
+			b.write(s + i, j - i);
+			if(j == n) return;
+			debugviz::detail::json_escape::escape(b, static_cast<unsigned char>(s[j]));
+			i = j + 1;
+		}
+	}
+};
+
+int main()
+{
+	std::mt19937 rng(3);
+	std::string input(64 << 20, ' ');
+	for(char& c : input) c = char('a' + rng() % 26);
+	for(size_t i = 0; i < input.size(); i += 4096) input[i] = "\"\\<\n"[rng() % 4];
+
+	std::printf("{ \"simd\": \"%s\", \"escape_gbps\": %.2f, \"scalar_gbps\": %.2f }\n",
+		DEBUGVIZ_AVX2 ? "avx2" : DEBUGVIZ_SSE2 ? "sse2" : "none",
+		gigabytes_per_second(input, debugviz::detail::json_escape::write<debugviz::detail::text_buffer>),
+		gigabytes_per_second(input, scalar_json_escape::write));
+}
@@ -0,0 +1,35 @@
+#include "../../include/debugviz/flow_graph.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Cost of one overlap removal iteration, for nodes spread with a constant density
+int main()
+{
+	using m = debugviz::detail::flow_graph_metrics;
+	for(size_t n : { 1000, 10000, 100000 })
+	{
+		std::mt19937 rng(1);
+		std::vector<float> heights(n), positions(2 * n);
+		const float side = std::sqrt(float(n)) * 2 * m::node_width;
+		for(size_t i = 0; i < n; i++)
+		{
+			heights[i] = m::node_height(rng() % 4, rng() % 4);
+			positions[2 * i] = std::uniform_real_distribution<float>(0, side)(rng);
+			positions[2 * i + 1] = std::uniform_real_distribution<float>(0, side)(rng);
+		}
+
+		debugviz::detail::overlap_grid grid;
+		const int iterations = 20;
+		size_t first_overlaps = 0, last_overlaps = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < iterations; i++)
+		{
+			last_overlaps = grid.step(positions, heights);
+			if(!i) first_overlaps = last_overlaps;
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::printf("%7zu nodes: %9.3f ms/iteration (overlaps: %zu -> %zu)\n",
+			n, seconds * 1000 / iterations, first_overlaps, last_overlaps);
+	}
+}
@@ -0,0 +1,102 @@
+#include "../../include/debugviz/flow_graph.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <random>
+#include <vector>
+
+// Serialization of a million-edge graph (without layout) into different sinks
+struct node
+{
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+};
+struct connection
+{
+	size_t out, out_slot, in, in_slot;
+};
+
+template<typename S>
+static void serialize(S& stream, const std::vector<node>& nodes, const std::vector<connection>& connections)
+{
+	debugviz::flow_graph_writer<S> writer(stream, "Benchmark");
+	writer.begin();
+	for(const node& n : nodes) writer.add_node(n.name, n.inputs, n.outputs);
+	for(const connection& c : connections) writer.add_connection(c.out, c.out_slot, c.in, c.in_slot);
+	writer.finish();
+}
+
+// Same data, one operator<< per token (as write_flow_graph used to do)
+static void serialize_per_token(std::ostream& stream, const std::vector<node>& nodes, const std::vector<connection>& connections)
+{
+	stream << debugviz::detail::flow_graph_html_head << "Benchmark" << debugviz::detail::flow_graph_html_body << "{\"nodes\":[";
+	for(const node& n : nodes)
+	{
+		stream << "{\"name\":\"" << n.name << "\",\"inputs\":[";
+		for(const auto& s : n.inputs) stream << "\"" << s << "\",";
+		stream << "],\"outputs\":[";
+		for(const auto& s : n.outputs) stream << "\"" << s << "\",";
+		stream << "]},";
+	}
+	stream << "],\"connections\":[";
+	for(const connection& c : connections)
+		stream << "[" << c.out << "," << c.out_slot << "," << c.in << "," << c.in_slot << "],";
+	stream << "]}" << debugviz::detail::flow_graph_html_tail;
+}
+
+// Best of a few runs
+template<typename F>
+static void measure(const char* name, size_t edges, F f, int runs = 5)
+{
+	double seconds = 1e300;
+	for(int i = 0; i < runs; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::printf("%-28s %8.1f ms  %6.2f M edges/s\n", name, seconds * 1000, double(edges) / seconds / 1e6);
+}
+
+int main()
+{
+	std::mt19937 rng(5);
+	std::vector<node> nodes(250000);
+	for(size_t i = 0; i < nodes.size(); i++)
+		nodes[i] = { "node_" + std::to_string(i), { "a", "b", "c", "d" }, { "x", "y", "z", "w" } };
+	std::vector<connection> connections(1000000);
+	for(connection& c : connections)
+		c = { rng() % nodes.size(), rng() % 4, rng() % nodes.size(), rng() % 4 };
+
+	const char* path = "bench_sink.html";
+	measure("std::ofstream, per token", connections.size(), [&]
+	{
+		std::ofstream file(path);
+		serialize_per_token(file, nodes, connections);
+	});
+	measure("std::ofstream", connections.size(), [&]
+	{
+		std::ofstream file(path);
+		serialize(file, nodes, connections);
+	});
+	measure("std::ostringstream", connections.size(), [&]
+	{
+		std::ostringstream out;
+		serialize(out, nodes, connections);
+	});
+	measure("buffer_sink (memory)", connections.size(), [&]
+	{
+		debugviz::buffer_sink sink;
+		serialize(sink, nodes, connections);
+	});
+	measure("buffer_sink (fd)", connections.size(), [&]
+	{
+		const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		debugviz::buffer_sink sink(fd);
+		serialize(sink, nodes, connections);
+		sink.flush();
+		close(fd);
+	});
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdio>
+
+// Checks of the tests: a failed check is printed and counted, and the test goes on
+static int failures = 0;
+#define CHECK(x) do { if(!(x)) { std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); failures++; } } while(0)
+
+// Exit code of a test, once all its checks ran
+static int check_result()
+{
+	if(failures) std::printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
+
+// Precondition of the checks that follow (sizes before indexing): when it fails, main returns
+#define REQUIRE(x) do { if(!(x)) { std::printf("%s:%d: requirement failed: %s\n", __FILE__, __LINE__, #x); failures++; return check_result(); } } while(0)
@@ -0,0 +1,109 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+struct collect
+{
+	std::vector<unsigned char> data;
+	void bytes(const unsigned char* s, size_t n) { data.insert(data.end(), s, s + n); }
+};
+
+// Compresses with the built-in encoder (in pieces of the given size), inflates with zlib
+static bool round_trip(const std::string& input, size_t piece = 1000, size_t* compressed_size = nullptr)
+{
+	collect out;
+	debugviz::detail::deflate_encoder<collect> encoder(out);
+	for(size_t i = 0; i < input.size(); i += piece)
+		encoder.bytes(reinterpret_cast<const unsigned char*>(input.data()) + i, std::min(piece, input.size() - i));
+	encoder.finish();
+	if(compressed_size) *compressed_size = out.data.size();
+
+	std::vector<unsigned char> inflated(input.size() + 1);
+	uLongf size = uLongf(inflated.size());
+	if(uncompress(inflated.data(), &size, out.data.data(), uLong(out.data.size())) != Z_OK) return false;
+	return std::string(inflated.begin(), inflated.begin() + size) == input;
+}
+
+static std::string base64_decode(const std::string& text)
+{
+	std::string out;
+	unsigned value = 0, bits = 0;
+	for(char c : text)
+	{
+		const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		const char* p = std::strchr(alphabet, c);
+		if(c == '=' || !p) break;
+		value = (value << 6) | unsigned(p - alphabet);
+		if((bits += 6) >= 8) out += char((value >> (bits -= 8)) & 255);
+	}
+	return out;
+}
+
+struct node
+{
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+};
+struct connection
+{
+	size_t out, out_slot, in, in_slot;
+};
+
+int main()
+{
+	// Built-in encoder, inflated by zlib
+	CHECK(round_trip(""));
+	CHECK(round_trip("a"));
+	CHECK(round_trip("abcabcabcabcabcabcabcabcabc", 1));
+	CHECK(round_trip(std::string(1 << 20, '\0'), 4096));
+	{
+		std::mt19937 rng(7);
+		std::string noise(300000, ' ');
+		for(char& c : noise) c = char(rng());
+		CHECK(round_trip(noise, 65536));
+	}
+	{
+		std::mt19937 rng(8);
+		std::ostringstream text;
+		for(int i = 0; i < 100000; i++)
+			text << "{\"name\":\"node_" << i << "\",\"inputs\":[\"in_" << rng() % 8 << "\"]," << rng() % 100000 << "},";
+		size_t compressed = 0;
+		CHECK(round_trip(text.str(), 777, &compressed));
+		CHECK(compressed * 3 < text.str().size());
+		std::printf("json-like text: %zu -> %zu bytes\n", text.str().size(), compressed);
+	}
+
+	// Compressed pages hold the same payload as uncompressed ones
+	{
+		std::vector<node> nodes;
+		for(int i = 0; i < 2000; i++)
+			nodes.push_back({ "node " + std::to_string(i) + " <&>", { "a", "b" }, { "x" } });
+		std::vector<connection> connections;
+		for(size_t i = 1; i < nodes.size(); i++) connections.push_back({ i / 2, 0, i, i % 2 });
+
+		std::ostringstream plain, compressed;
+		debugviz::write_flow_graph(plain, "Test", nodes, connections);
+		debugviz::write_flow_graph(compressed, "Test", nodes, connections,
+			{ debugviz::flow_graph_payload::json, debugviz::flow_graph_compression::deflate });
+
+		const std::string& p = plain.str();
+		const size_t begin = p.find("{\"nodes\":"), end = p.rfind(");</script>");
+		const std::string& c = compressed.str();
+		const std::string tag = "data-compression='deflate'>";
+		const size_t data = c.find(tag) + tag.size();
+		const std::string deflated = base64_decode(c.substr(data, c.find("</script>", data) - data));
+
+		std::vector<unsigned char> inflated(p.size());
+		uLongf size = uLongf(inflated.size());
+		CHECK(uncompress(inflated.data(), &size, reinterpret_cast<const Bytef*>(deflated.data()), uLong(deflated.size())) == Z_OK);
+		CHECK(std::string(inflated.begin(), inflated.begin() + size) == p.substr(begin, end - begin));
+		CHECK(c.size() < p.size());
+	}
+
+	return check_result();
+}
@@ -0,0 +1,201 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Nodes of a layer must not overlap vertically
+static bool layers_overlap(const debugviz::flow_graph_layout& layout, const std::vector<float>& heights)
+{
+	std::vector<size_t> order(layout.size());
+	for(size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return layout.layer(a) != layout.layer(b) ? layout.layer(a) < layout.layer(b) : layout.y(a) < layout.y(b);
+	});
+	for(size_t i = 1; i < order.size(); i++)
+		if(layout.layer(order[i]) == layout.layer(order[i - 1])
+			&& layout.y(order[i - 1]) + heights[order[i - 1]] > layout.y(order[i]) + 0.01f)
+			return true;
+	return false;
+}
+
+int main()
+{
+	// Random layered DAG, 100k nodes
+	{
+		const size_t n = 100000;
+		std::mt19937 rng(42);
+		std::vector<float> heights(n);
+		std::vector<std::pair<size_t, size_t>> edges;
+		debugviz::flow_graph_layout layout;
+		for(size_t i = 0; i < n; i++)
+			layout.add_node(heights[i] = debugviz::detail::flow_graph_metrics::node_height(rng() % 4, rng() % 4));
+		for(size_t i = 1; i < n; i++)
+			for(unsigned k = rng() % 4; k > 0; k--)
+			{
+				const size_t j = i - 1 - rng() % std::min<size_t>(i, 200);
+				layout.add_edge(j, i);
+				edges.emplace_back(j, i);
+			}
+
+		const auto start = std::chrono::steady_clock::now();
+		layout.compute();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::printf("layout of %zu nodes, %zu edges: %.3f s\n", n, edges.size(), seconds);
+		CHECK(seconds < 1.0);
+
+		for(const auto& e : edges)
+			CHECK(layout.layer(e.first) < layout.layer(e.second) && layout.x(e.first) < layout.x(e.second));
+		CHECK(!layers_overlap(layout, heights));
+	}
+
+	// Cycles do not stop the ranking (nor overflow the stack)
+	{
+		const size_t n = 100000;
+		debugviz::flow_graph_layout layout;
+		for(size_t i = 0; i < n; i++) layout.add_node(90);
+		for(size_t i = 0; i < n; i++) layout.add_edge(i, (i + 1) % n);
+		layout.add_edge(5, 5);
+		layout.compute();
+		for(size_t i = 1; i < n; i++)
+			CHECK(layout.layer(i) == layout.layer(i - 1) + 1);
+	}
+
+	// Diamond with a source that can be moved closer to its successor
+	{
+		debugviz::flow_graph_layout layout(5);
+		for(size_t i = 0; i < 5; i++) layout.set_height(i, 90);
+		layout.add_edge(0, 1);
+		layout.add_edge(0, 2);
+		layout.add_edge(1, 3);
+		layout.add_edge(2, 3);
+		layout.add_edge(4, 3);
+		layout.compute();
+		CHECK(layout.layer(0) == 0 && layout.layer(1) == 1 && layout.layer(2) == 1 && layout.layer(3) == 2);
+		CHECK(layout.layer(4) == 1);
+		CHECK(layout.x(0) == -layout.x(3));
+	}
+
+	// Overlapping nodes are pushed apart
+	{
+		const size_t n = 2000;
+		std::mt19937 rng(7);
+		std::vector<float> heights(n);
+		debugviz::flow_graph_layout layout(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			layout.set_height(i, heights[i] = debugviz::detail::flow_graph_metrics::node_height(rng() % 4, rng() % 4));
+			layout.set_position(i, float(rng() % 16000), float(rng() % 16000));
+		}
+		layout.set_position(1, layout.x(0), layout.y(0));
+		CHECK(layout.remove_overlaps(200) == 0);
+
+		using m = debugviz::detail::flow_graph_metrics;
+		const float margin_x = 2 * (m::node_padding + 2 * m::slot_radius), margin_y = 2 * (m::node_padding + m::slot_radius);
+		size_t overlaps = 0;
+		for(size_t i = 0; i < n; i++)
+			for(size_t j = i + 1; j < n; j++)
+				overlaps += std::abs(layout.x(i) - layout.x(j)) < m::node_width + margin_x - 0.5f
+					&& layout.y(i) < layout.y(j) + heights[j] + margin_y - 0.5f
+					&& layout.y(j) < layout.y(i) + heights[i] + margin_y - 0.5f;
+		CHECK(overlaps == 0);
+	}
+
+	// Cached layout: nodes that did not change keep their position, only the others are placed
+	{
+		const size_t n = 20000;
+		std::mt19937 rng(3);
+		std::vector<float> heights(n + 3);
+		std::vector<std::pair<size_t, size_t>> edges;
+		for(size_t i = 0; i < n + 3; i++) heights[i] = debugviz::detail::flow_graph_metrics::node_height(rng() % 4, rng() % 4);
+		for(size_t i = 1; i < n; i++)
+			for(unsigned k = rng() % 3; k > 0; k--) edges.emplace_back(i - 1 - rng() % std::min<size_t>(i, 50), i);
+		const auto build = [&](debugviz::flow_graph_layout& layout, size_t count)
+		{
+			for(size_t i = 0; i < count; i++) layout.set_key(layout.add_node(heights[i]), 1000 + i);
+			for(const auto& e : edges) layout.add_edge(e.first, e.second);
+		};
+		const auto seconds = [](const auto& f)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			f();
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		// Empty cache: same layout as without
+		debugviz::flow_graph_layout plain, first;
+		build(plain, n);
+		build(first, n);
+		debugviz::flow_graph_layout_cache cache;
+		const double full = seconds([&] { first.compute(cache); });
+		plain.compute();
+		size_t different = 0;
+		for(size_t i = 0; i < n; i++) different += first.x(i) != plain.x(i) || first.y(i) != plain.y(i);
+		CHECK(different == 0 && cache.size() == n);
+		// Saved in the working directory (the build directory with ctest), then removed
+		const char* path = "test_layout.cache";
+		CHECK(cache.save(path));
+		CHECK(!cache.load("missing.cache") && cache.size() == 0);
+
+		// Same graph
+		CHECK(cache.load(path) && cache.size() == n);
+		std::remove(path);
+		debugviz::flow_graph_layout same;
+		build(same, n);
+		const double reused = seconds([&] { same.compute(cache); });
+		different = 0;
+		for(size_t i = 0; i < n; i++) different += same.x(i) != first.x(i) || same.y(i) != first.y(i);
+		CHECK(different == 0);
+
+		// New nodes: one after an existing node, two on their own
+		edges.emplace_back(n - 5, n);
+		edges.emplace_back(n + 1, n + 2);
+		debugviz::flow_graph_layout grown;
+		build(grown, n + 3);
+		const double incremental = seconds([&] { grown.compute(cache); });
+		different = 0;
+		for(size_t i = 0; i < n; i++) different += grown.x(i) != first.x(i) || grown.y(i) != first.y(i);
+		CHECK(different < 20 && cache.size() == n + 3);
+		CHECK(grown.x(n) > grown.x(n - 5) && grown.x(n + 2) > grown.x(n + 1));
+		CHECK(grown.remove_overlaps(0) == 0);
+		std::printf("layout of %zu nodes: %.3f s, %.3f s from the cache, %.3f s with 3 new nodes (%zu moved)\n",
+			n, full, reused, incremental, different);
+	}
+
+	// Clusters: connected nodes, of bounded size, in two levels
+	{
+		const size_t n = 20000;
+		std::mt19937 rng(5);
+		debugviz::flow_graph_layout layout;
+		std::vector<std::pair<size_t, size_t>> edges;
+		for(size_t i = 0; i < n; i++) layout.add_node(90);
+		for(size_t i = 1; i < n; i++)
+			for(unsigned k = 1 + rng() % 2; k > 0; k--)
+			{
+				const size_t j = i - 1 - rng() % std::min<size_t>(i, 30);
+				layout.add_edge(j, i);
+				edges.emplace_back(j, i);
+			}
+		layout.compute();
+		CHECK(layout.cluster_count() == 0);
+		layout.compute_clusters(32);
+
+		const size_t count = layout.cluster_count();
+		std::vector<size_t> sizes(count, 0), parent_sizes(count, 0);
+		for(size_t i = 0; i < n; i++) sizes[layout.cluster(i)]++;
+		for(size_t c = 0; c < count; c++) parent_sizes[layout.parent_cluster(c)]++;
+		size_t inside = 0;
+		for(const auto& e : edges) inside += layout.cluster(e.first) == layout.cluster(e.second);
+		std::printf("%zu nodes in %zu clusters, %.0f%% of the edges inside them\n", n, count, 100.0 * double(inside) / double(edges.size()));
+		CHECK(count > n / 32 && count < n / 4);
+		CHECK(*std::max_element(sizes.begin(), sizes.end()) <= 32 && *std::min_element(sizes.begin(), sizes.end()) > 0);
+		CHECK(*std::max_element(parent_sizes.begin(), parent_sizes.end()) <= 32);
+		CHECK(inside > edges.size() / 3);
+
+		layout.compute();
+		CHECK(layout.cluster_count() == 0);
+	}
+
+	return check_result();
+}
@@ -1,52 +1,59 @@
 #include "../../include/debugviz/flow_graph.h"
+#include "connectivity.h"
+#include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 
-struct node
+// Nodes and connections with performance fields, shown as a heat overlay
+struct measured_node
 {
 	std::string name;
 	std::vector<std::string> inputs, outputs;
-
-	node(const std::string& n, const std::vector<std::string>& i, const std::vector<std::string>& o) :
-		name(n), inputs(i), outputs(o) {}
+	uint64_t time_ns, count;
 };
-struct connection
+struct measured_connection
 {
 	size_t out, out_slot, in, in_slot;
+	double bytes;
 };
-struct connectivity
+// Nodes in groups, shown collapsed by the viewer
+struct grouped_node
 {
-	struct connection_view
-	{
-		const std::string& out;
-		const std::string& out_slot;
-		const std::string& in;
-		const std::string& in_slot;
-	};
-	struct iterator
-	{
-		const connectivity& parent;
-		size_t index;
-		iterator(const connectivity& p, size_t i) : parent(p), index(i) {}
-		connection_view operator*() const { return parent[index]; }
-		bool operator!=(const iterator& it) const { return index != it.index; }
-		iterator& operator++() { index++; return *this; }
-	};
-
-	connectivity(const std::vector<node>& n, std::vector<connection> c) : connections(std::move(c)), nodes(n) {}
-	iterator begin() const { return iterator(*this, 0); }
-	iterator end() const { return iterator(*this, connections.size()); }
-	connection_view operator[](size_t i) const
-	{
-		const connection& c = connections[i];
-		return { nodes[c.out].name, nodes[c.out].outputs[c.out_slot], nodes[c.in].name, nodes[c.in].inputs[c.in_slot] };
-	}
-
-private:
-	std::vector<connection> connections;
-	const std::vector<node>& nodes;
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+	int group;
+};
+struct named_connection
+{
+	std::string out, out_slot, in, in_slot;
+};
+// Name recording the threads that format it, lingering while only one thread did
+struct traced_name
+{
+	std::string text;
+};
+std::mutex formatting_mutex;
+std::set<std::thread::id> formatting_threads;
+std::ostream& operator<<(std::ostream& os, const traced_name& n)
+{
+	std::unique_lock<std::mutex> lock(formatting_mutex);
+	formatting_threads.insert(std::this_thread::get_id());
+	const bool alone = formatting_threads.size() < 2;
+	lock.unlock();
+	if(alone) std::this_thread::sleep_for(std::chrono::microseconds(100));
+	return os << n.text;
+}
+struct traced_node
+{
+	traced_name name;
+	std::vector<std::string> inputs, outputs;
 };
 
 int main()
@@ -59,16 +66,14 @@ int main()
 		{ "add",   { "x", "y" },         { "value", "u", "v", "w" } },
 		{ "final", { "w" },              {} }
 	};
-	const connectivity connections =
+	const std::vector<connection> links =
 	{
-		nodes,
-		{
-			{ 0, 0, 1, 1 },
-			{ 1, 0, 3, 1 },
-			{ 2, 0, 3, 0 },
-			{ 3, 0, 4, 0 }
-		}
+		{ 0, 0, 1, 1 },
+		{ 1, 0, 3, 1 },
+		{ 2, 0, 3, 0 },
+		{ 3, 0, 4, 0 }
 	};
+	const connectivity connections = { nodes, links };
 
 	//*
 	std::ofstream("test2.html") << debugviz::flow_graph("Test", nodes, connections);
@@ -76,4 +81,263 @@ int main()
 	std::ofstream test_file("test.html");
 	debugviz::write_flow_graph(test_file, "Test", nodes, connections);
 	//*/
+
+	// Connections holding indices are written as is, without any name lookup
+	std::ofstream indices_file("test_indices.html");
+	debugviz::write_flow_graph(indices_file, "Test (indices)", nodes, links);
+
+	// Slot indices past the slots of their node are skipped, like unknown names
+	std::vector<connection> out_of_range = links;
+	out_of_range.push_back({ 0, 1, 1, 0 });
+	out_of_range.push_back({ 2, 0, 4, 1 });
+	std::ostringstream in_range, skipped;
+	debugviz::write_flow_graph(in_range, "Test", nodes, links);
+	debugviz::write_flow_graph(skipped, "Test", nodes, out_of_range);
+	if(skipped.str() != in_range.str())
+		return 1;
+
+	// Streaming, with interleaved nodes and connections given by index or by name
+	std::ofstream stream_file("test_stream.html");
+	debugviz::flow_graph_writer<std::ostream> writer(stream_file, "Test (stream)");
+	writer.begin();
+	for(size_t i = 0; i < nodes.size(); i++)
+	{
+		writer.add_node(nodes[i].name, nodes[i].inputs, nodes[i].outputs);
+		if(i == 1) writer.add_connection(0, 0, 1, 1);
+	}
+	writer.add_connection("modif", "value", "add", "y");
+	writer.add_connection("cst", "v", "add", "x");
+	writer.add_connection(3, 0, "final", "w");
+	writer.finish();
+
+	// Errors of the stream reach finish(), not the destructor of an unfinished writer
+	std::ofstream closed;
+	closed.exceptions(std::ios::badbit);
+	bool thrown = false;
+	try
+	{
+		debugviz::flow_graph_writer<std::ostream> unfinished(closed, "Test (closed)");
+		unfinished.begin();
+		unfinished.add_node(nodes[0].name, nodes[0].inputs, nodes[0].outputs);
+	}
+	catch(...) { thrown = true; }
+	debugviz::flow_graph_writer<std::ostream> failing(closed, "Test (closed)");
+	failing.begin();
+	try { failing.finish(); }
+	catch(const std::ios::failure&) { thrown = !thrown; }
+	if(!thrown)
+		return 1;
+
+	// Names and title are escaped
+	std::ostringstream escaped;
+	const std::vector<node> special = { { "</script>\"\\\n", { "<!--" }, {} } };
+	debugviz::write_flow_graph(escaped, "</title>&", special, std::vector<connection>());
+	const std::string page = escaped.str();
+	if(page.find("\"name\":\"\\u003c/script>\\\"\\\\\\n\"") == std::string::npos
+		|| page.find("\"inputs\":[\"\\u003c!--\"]") == std::string::npos
+		|| page.find("<title>&lt;/title&gt;&amp;</title>") == std::string::npos)
+		return 1;
+
+	// Binary payload, with connections by index and by name (resolved by the viewer)
+	const debugviz::flow_graph_options binary = { debugviz::flow_graph_payload::binary };
+	std::ofstream binary_file("test_binary.html");
+	debugviz::write_flow_graph(binary_file, "Test (binary)", nodes, links, binary);
+	std::ostringstream binary_stream;
+	{
+		debugviz::flow_graph_writer<std::ostream> writer(binary_stream, "Test (binary stream)", binary);
+		writer.begin();
+		for(const node& n : nodes) writer.add_node(n.name, n.inputs, n.outputs);
+		writer.add_connection(0, 0, "modif", "uu");
+		writer.add_connection("add", "value", 4, 0);
+	}
+	std::ofstream("test_binary_stream.html") << binary_stream.str();
+	if(binary_stream.str().find("<script type='application/octet-stream' id='flow-graph-data' data-payload='binary'>RFZHMQ") == std::string::npos)
+		return 1;
+
+	// Compressed payloads
+	std::ofstream deflate_file("test_deflate.html");
+	debugviz::write_flow_graph(deflate_file, "Test (deflate)", nodes, connections,
+		{ debugviz::flow_graph_payload::json, debugviz::flow_graph_compression::deflate });
+	std::ofstream binary_deflate_file("test_binary_deflate.html");
+	debugviz::write_flow_graph(binary_deflate_file, "Test (binary, deflate)", nodes, connections,
+		{ debugviz::flow_graph_payload::binary, debugviz::flow_graph_compression::deflate });
+
+	// Viewer written once, graphs written as data files
+	std::ofstream viewer_file("test_viewer.html");
+	debugviz::write_flow_graph_viewer(viewer_file, "Test (viewer)");
+	std::ostringstream data_script, data_json;
+	debugviz::write_flow_graph_data(data_script, "Test (data)", nodes, connections);
+	debugviz::write_flow_graph_data(data_json, "Test (data)", nodes, connections,
+		{ debugviz::flow_graph_payload::json, debugviz::flow_graph_compression::none, debugviz::flow_graph_document::json });
+	if(data_script.str().find("flow_graph_data_file({\"title\":\"Test (data)\",\"payload\":\"json\",\"graph\":{\"nodes\":") != 0
+		|| data_script.str().substr(data_script.str().size() - 5) != "}});\n"
+		|| data_json.str().find("{\"title\":\"Test (data)\",") != 0
+		|| data_json.str().find("<") != std::string::npos)
+		return 1;
+	std::ofstream("test_data.js") << data_script.str();
+	std::ofstream("test_data.json") << data_json.str();
+	std::ofstream data_binary_file("test_data_binary.js");
+	debugviz::write_flow_graph_data(data_binary_file, "Test (binary data)", nodes, connections,
+		{ debugviz::flow_graph_payload::binary, debugviz::flow_graph_compression::deflate });
+
+	// Performance measures, from counters of the nodes
+	debugviz::flow_graph_counters counters(3);
+	{
+		auto timer = counters.time(1, 100);
+		timer.add_bytes(28);
+	}
+	counters.add(2, 1500000, 64);
+	counters.add(2, 500000);
+	const auto totals = counters.totals();
+	if(totals.size() != 3 || totals[0].count != 0 || totals[1].count != 1 || totals[1].bytes != 128
+		|| totals[2].time_ns != 2000000 || totals[2].count != 2)
+		return 1;
+	std::vector<measured_node> measured;
+	for(size_t i = 0; i < totals.size(); i++)
+		measured.push_back({ "stage " + std::to_string(i), { "in" }, { "out" }, uint64_t(totals[i].time_ns), uint64_t(totals[i].count) });
+	const std::vector<measured_connection> measured_links = { { 0, 0, 1, 0, 1024 }, { 1, 0, 2, 0, 2.5e6 } };
+	std::ostringstream measures;
+	debugviz::write_flow_graph(measures, "Test (measures)", measured, measured_links);
+	if(measures.str().find("\"outputs\":[\"out\"],\"time_ns\":2000000,\"count\":2}") == std::string::npos
+		|| measures.str().find("[0,0,1,0,{\"bytes\":1024}]") == std::string::npos)
+		return 1;
+	std::ofstream("test_measures.html") << measures.str();
+	std::ofstream measures_binary_file("test_measures_binary.html");
+	debugviz::write_flow_graph(measures_binary_file, "Test (measures, binary)", measured, measured_links, binary);
+
+	// Groups: written with the nodes that have one, the layout has no clusters then
+	const std::vector<grouped_node> grouped = { { "a", {}, { "out" }, 1 }, { "b", { "in" }, {}, 1 }, { "c", { "in" }, {}, 2 } };
+	const std::vector<connection> grouped_links = { { 0, 0, 1, 0 }, { 0, 0, 2, 0 } };
+	std::ostringstream groups;
+	debugviz::write_flow_graph(groups, "Test (groups)", grouped, grouped_links);
+	if(groups.str().find("{\"name\":\"c\",\"inputs\":[\"in\"],\"outputs\":[],\"group\":\"2\"}") == std::string::npos
+		|| groups.str().find("\"clusters\"") != std::string::npos)
+		return 1;
+	std::ofstream("test_groups.html") << groups.str();
+	std::ofstream groups_binary_file("test_groups_binary.html");
+	debugviz::write_flow_graph(groups_binary_file, "Test (groups, binary)", grouped, grouped_links, binary);
+
+	// Timeline: frames only hold what changed
+	std::ostringstream timeline_page;
+	{
+		debugviz::flow_graph_timeline_writer<std::ostream> timeline(timeline_page, "Test (timeline)");
+		timeline.begin();
+		timeline.add_frame("initial", nodes, links);
+		std::vector<connection> rewired = links;
+		rewired[0] = { 0, 0, 1, 2 };
+		timeline.add_frame("rewired", nodes, rewired);
+		std::vector<node> fewer = nodes;
+		fewer.erase(fewer.begin() + 2);	// "cst", connections are given by name
+		fewer[2].inputs.push_back("z");
+		timeline.add_frame("removed", fewer, connectivity(nodes, { { 0, 0, 1, 2 }, { 1, 0, 3, 1 }, { 3, 0, 4, 0 } }));
+		timeline.add_frame(fewer, connectivity(nodes, { { 0, 0, 1, 2 }, { 1, 0, 3, 1 }, { 3, 0, 4, 0 } }));
+	}
+	const std::string frames = timeline_page.str();
+	if(frames.find("{\"label\":\"rewired\",\"connect\":[[0,0,1,2]],\"disconnect\":[[0,0,1,1]]}") == std::string::npos
+		|| frames.find("{\"label\":\"removed\",\"nodes\":[[3,{\"name\":\"add\",\"inputs\":[\"x\",\"y\",\"z\"],\"outputs\":[\"value\",\"u\",\"v\",\"w\"]}]],\"removed\":[2],\"connect\":[") == std::string::npos
+		|| frames.find("{\"label\":\"3\"}],\"layout\":[") == std::string::npos)
+		return 1;
+	std::ofstream("test_timeline.html") << frames;
+
+	// Several threads, same output as one; forward ranges (connectivity) are written by one thread
+	std::vector<node> big_nodes;
+	std::vector<connection> big_links;
+	std::vector<named_connection> big_named;
+	for(size_t i = 0; i < 20000; i++)
+	{
+		big_nodes.push_back({ "node " + std::to_string(i), { "a", "b" }, { "out" } });
+		if(i % 7 == 0) big_nodes.back().inputs.push_back("\"escaped\"");
+		if(i > 0) big_links.push_back({ i / 2, 0, i, i % 2 });
+		if(i > 0) big_named.push_back({ "node " + std::to_string(i / 3), "out", "node " + std::to_string(i), i % 5 ? "a" : "missing" });
+	}
+	const connectivity big_connectivity(big_nodes, big_links);
+	big_links.push_back({ 5, 0, 20000, 0 });	// Skipped
+	debugviz::flow_graph_options sequential, parallel;
+	parallel.threads = 4;
+	const auto written = [&](const auto& links, const debugviz::flow_graph_options& options)
+	{
+		std::ostringstream out;
+		debugviz::write_flow_graph(out, "Test (threads)", big_nodes, links, options);
+		return out.str();
+	};
+	if(written(big_links, parallel) != written(big_links, sequential)
+		|| written(big_named, parallel) != written(big_named, sequential)
+		|| written(big_connectivity, parallel) != written(big_links, sequential))
+		return 1;
+
+	// Without the layout, the viewer lays the graph out, and the nodes are formatted by several threads
+	std::vector<traced_node> traced_nodes;
+	for(const node& n : big_nodes) traced_nodes.push_back({ { n.name }, n.inputs, n.outputs });
+	debugviz::flow_graph_options unplaced = parallel;
+	unplaced.layout = false;
+	std::ostringstream traced;
+	debugviz::write_flow_graph(traced, "Test (threads)", traced_nodes, big_links, unplaced);
+	unplaced.threads = 1;
+	if(traced.str() != written(big_links, unplaced) || traced.str().find("\"layout\":[") != std::string::npos
+		|| formatting_threads.size() < 2)
+		return 1;
+
+	// Big graphs without groups are split into clusters, shown collapsed when zoomed out
+	const std::string clustered = written(big_links, sequential);
+	if(clustered.find("],\"clusters\":[0,") == std::string::npos || clustered.find("],\"cluster_parents\":[0,") == std::string::npos)
+		return 1;
+	std::ofstream("test_clusters.html") << clustered;
+	std::ofstream clusters_binary_file("test_clusters_binary.html");
+	debugviz::write_flow_graph(clusters_binary_file, "Test (clusters, binary)", big_nodes, big_links, binary);
+
+	// Canvas renderer, given to the viewer with the graph
+	debugviz::flow_graph_options canvas = sequential;
+	canvas.renderer = debugviz::flow_graph_renderer::canvas;
+	std::ostringstream canvas_data;
+	debugviz::write_flow_graph_data(canvas_data, "Test (canvas)", nodes, connections, canvas);
+	const std::string canvas_page = written(big_links, canvas);
+	if(canvas_page.find("]},'canvas');</script>") == std::string::npos
+		|| canvas_data.str().find("\"payload\":\"json\",\"renderer\":\"canvas\",\"graph\":{") == std::string::npos)
+		return 1;
+	std::ofstream("test_canvas.html") << canvas_page;
+	std::ofstream canvas_binary_file("test_canvas_binary.html");
+	canvas.payload = debugviz::flow_graph_payload::binary;
+	debugviz::write_flow_graph(canvas_binary_file, "Test (canvas, binary)", big_nodes, big_links, canvas);
+
+	// Layout kept in a file between dumps: the same graph gets the same positions
+	debugviz::flow_graph_options cached = sequential;
+	cached.layout_cache = "test_layout_cache.bin";
+	std::remove("test_layout_cache.bin");
+	const std::string uncached = written(big_links, sequential);
+	if(written(big_links, cached) != uncached || written(big_links, cached) != uncached)
+		return 1;
+	cached.threads = 4;
+	big_nodes.push_back({ "new node", { "a" }, {} });
+	big_links.push_back({ 20000, 0, 20001, 0 });
+	const std::string grown = written(big_links, cached);
+	cached.threads = 1;
+	if(written(big_links, cached) != grown || grown.find(uncached.substr(uncached.find("\"layout\":["), 64)) == std::string::npos)
+		return 1;
+	std::remove("test_layout_cache.bin");
+
+	// A cache that cannot be written is reported by the status, the stream is left alone
+	debugviz::flow_graph_options unwritable;
+	unwritable.layout_cache = "missing directory/test_layout_cache.bin";
+	std::ostringstream failed, not_cached;
+	debugviz::flow_graph_write_status status, sink_status, saved_status;
+	debugviz::write_flow_graph(failed, "Test", nodes, connections, unwritable, status);
+	debugviz::write_flow_graph(not_cached, "Test", nodes, connections);
+	debugviz::buffer_sink failed_sink;
+	debugviz::write_flow_graph(failed_sink, "Test", nodes, connections, unwritable, sink_status);
+	if(status.layout_cache_saved || sink_status.layout_cache_saved || !failed.good() || !failed_sink.good()
+		|| failed.str() != not_cached.str())
+		return 1;
+	std::ostringstream saved;
+	debugviz::write_flow_graph(saved, "Test", nodes, connections, cached, saved_status);
+	std::remove("test_layout_cache.bin");
+	if(!saved_status.layout_cache_saved)
+		return 1;
+
+	// Contiguous sink, same output as the standard streams
+	std::ostringstream expected;
+	debugviz::buffer_sink sink;
+	debugviz::write_flow_graph(expected, "Test", nodes, connections);
+	debugviz::write_flow_graph(sink, "Test", nodes, connections);
+	if(std::string(sink.data(), sink.size()) != expected.str())
+		return 1;
 }
@@ -0,0 +1,143 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct node
+{
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+	double time_ns;
+};
+struct connection
+{
+	size_t out, out_slot, in, in_slot;
+	double bytes;
+};
+struct named_connection
+{
+	std::string out, out_slot, in, in_slot;
+};
+
+using query = debugviz::flow_graph_query<node>;
+using subgraph = debugviz::flow_graph_subgraph<node>;
+
+static std::vector<std::string> names(const subgraph& g)
+{
+	std::vector<std::string> result;
+	for(const auto& n : g.nodes())
+	{
+		std::ostringstream os;
+		os << n.name;
+		result.push_back(os.str());
+	}
+	return result;
+}
+static std::string written(const subgraph& g)
+{
+	std::ostringstream out;
+	debugviz::write_flow_graph(out, "Test (query)", g.nodes(), g.connections());
+	return out.str();
+}
+
+int main()
+{
+	// source -> filter -> merge -> sink, with a side input into merge and two outputs of source
+	const std::vector<node> nodes =
+	{
+		{ "source", {}, { "data", "meta" }, 10 },
+		{ "filter", { "data" }, { "data" }, 20 },
+		{ "merge", { "a", "b" }, { "data" }, 30 },
+		{ "sink", { "data" }, {}, 40 },
+		{ "side", {}, { "data" }, 50 }
+	};
+	const std::vector<connection> links =
+	{
+		{ 0, 0, 1, 0, 100 }, { 1, 0, 2, 0, 200 }, { 2, 0, 3, 0, 300 }, { 4, 0, 2, 1, 400 }, { 0, 1, 2, 1, 500 }, { 0, 0, 9, 0, 1 }
+	};
+	const query by_index(nodes, links);
+	CHECK(by_index.node_count() == 5 && by_index.connection_count() == 5);
+
+	// One hop downstream of filter: merge, whose other inputs and output become stubs
+	{
+		const subgraph g = by_index.downstream({ 1 }, 1);
+		CHECK(g.size() == 2 && g.original(0) == 1 && g.original(1) == 2 && g.original(2) == subgraph::npos);
+		CHECK((names(g) == std::vector<std::string>{ "filter", "merge", "1 more", "1 more", "2 more" }));
+		const auto& c = g.connections();
+		REQUIRE(c.size() == 4);
+		// filter -> merge
+		CHECK(c[0].out == 0 && c[0].out_slot == 0 && c[0].in == 1 && c[0].in_slot == 0 && c[0].bytes == 200);
+		// filter <- source
+		CHECK(c[1].out == 2 && c[1].out_slot == 0 && c[1].in == 0 && c[1].in_slot == 0 && c[1].bytes == 100);
+		// merge -> sink, a downstream stub
+		CHECK(c[2].out == 1 && c[2].in == 3 && c[2].in_slot == 0);
+		// merge <- side, source: collapsed into one slot, measures summed
+		CHECK(c[3].out == 4 && c[3].out_slot == 0 && c[3].in == 1 && c[3].in_slot == 1 && c[3].bytes == 900);
+		size_t slots = 0;
+		for(const auto& n : g.nodes())
+			for(const auto& s : n.outputs) { (void)s; slots++; }
+		CHECK(slots == 4);
+
+		const std::string page = written(g);
+		CHECK(page.find("{\"name\":\"2 more\",\"inputs\":[],\"outputs\":[\"side +1\"]}") != std::string::npos);
+		CHECK(page.find("{\"name\":\"merge\",\"inputs\":[\"a\",\"b\"],\"outputs\":[\"data\"],\"time_ns\":30}") != std::string::npos);
+	}
+
+	// Upstream, both ways, paths, predicate
+	CHECK((names(by_index.upstream({ 2 }, 5)) == std::vector<std::string>{ "source", "filter", "merge", "side", "1 more" }));
+	CHECK(by_index.neighbourhood({ 3 }, 1).size() == 2);
+	CHECK(by_index.neighbourhood({ 3 }, 2).size() == 5);
+	CHECK((names(by_index.paths(0, 3)) == std::vector<std::string>{ "source", "filter", "merge", "sink", "1 more" }));
+	CHECK(by_index.paths(3, 0).size() == 0 && by_index.paths(1, 1).size() == 1);
+	CHECK((names(by_index.matching([](const node& n) { return n.time_ns >= 40; })) == std::vector<std::string>{ "sink", "side", "1 more", "1 more" }));
+	CHECK(by_index.subgraph({ 0, 1, 2, 3, 4 }).connections().size() == 5);
+	CHECK(by_index.subgraph({ 7 }).nodes().size() == 0);
+
+	// Connections given by name give the same subgraphs
+	{
+		std::vector<named_connection> named;
+		for(const connection& c : links)
+			if(c.in < nodes.size())
+				named.push_back({ nodes[c.out].name, nodes[c.out].outputs[c.out_slot], nodes[c.in].name, nodes[c.in].inputs[c.in_slot] });
+		const query by_name(nodes, named);
+		CHECK(names(by_name.downstream({ 1 }, 1)) == names(by_index.downstream({ 1 }, 1)));
+		CHECK(by_name.paths(0, 3).connections().size() == 5);
+	}
+
+	// Big graph: focused views of it, many per second
+	{
+		const size_t n = 200000;
+		std::mt19937 rng(11);
+		std::vector<node> big;
+		std::vector<connection> big_links;
+		for(size_t i = 0; i < n; i++)
+		{
+			big.push_back({ "node " + std::to_string(i), { "a", "b" }, { "out" }, double(i) });
+			for(unsigned k = 1 + rng() % 4; i > 0 && k > 0; k--)
+				big_links.push_back({ i - 1 - rng() % std::min<size_t>(i, 1000), 0, i, rng() % 2, 1 });
+		}
+		const auto start = std::chrono::steady_clock::now();
+		const query q(big, big_links);
+		const auto built = std::chrono::steady_clock::now();
+		size_t written_nodes = 0;
+		const int views = 50;
+		for(int i = 0; i < views; i++)
+		{
+			const subgraph g = q.neighbourhood({ size_t(rng() % n) }, 2);
+			CHECK(g.size() > 1 && g.size() < 1000);
+			debugviz::buffer_sink sink;
+			debugviz::write_flow_graph(sink, "View", g.nodes(), g.connections());
+			written_nodes += g.size();
+		}
+		const auto end = std::chrono::steady_clock::now();
+		std::printf("query: index of %zu nodes, %zu connections in %.3f s, %d views written in %.3f s (%zu nodes)\n",
+			n, big_links.size(), std::chrono::duration<double>(built - start).count(),
+			views, std::chrono::duration<double>(end - built).count(), written_nodes);
+	}
+
+	return check_result();
+}
@@ -0,0 +1,155 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using debugviz::flow_graph_recorder;
+using debugviz::flow_graph_snapshot;
+
+static bool has_connection(const flow_graph_snapshot& g, const std::string& out, const std::string& out_slot,
+	const std::string& in, const std::string& in_slot)
+{
+	for(const auto& c : g.connections)
+		if(g.nodes[c.out].name == out && g.nodes[c.out].outputs[c.out_slot] == out_slot
+			&& g.nodes[c.in].name == in && g.nodes[c.in].inputs[c.in_slot] == in_slot)
+			return true;
+	return false;
+}
+
+int main()
+{
+	// One thread: every kind of event
+	{
+		flow_graph_recorder recorder;
+		const auto source = recorder.intern("source"), filter = recorder.intern("filter"), sink = recorder.intern("sink");
+		const auto data = recorder.intern("data"), spare = recorder.intern(std::string("spare"));
+		CHECK(recorder.intern("data") == data && source != filter);
+
+		recorder.add_node(1, source);
+		recorder.add_node(2, filter);
+		recorder.add_node(3, sink);
+		recorder.add_input(3, spare);
+		recorder.connect(1, data, 2, data);
+		recorder.connect(2, data, 3, data);
+		recorder.connect(1, data, 3, data);
+		recorder.disconnect(1, data, 3, data);
+
+		flow_graph_snapshot g = recorder.snapshot();
+		REQUIRE(g.nodes.size() == 3 && g.connections.size() == 2);
+		CHECK(g.nodes[0].name == "source" && g.nodes[1].name == "filter" && g.nodes[2].name == "sink");
+		CHECK(g.nodes[2].inputs.size() == 2 && g.nodes[2].inputs[0] == "spare");
+		CHECK(has_connection(g, "source", "data", "filter", "data") && has_connection(g, "filter", "data", "sink", "data"));
+
+		// Removing a node drops its connections, even once it is added back
+		recorder.remove_node(2);
+		recorder.add_node(2, filter);
+		recorder.connect(7, data, 3, data);
+		g = recorder.snapshot();
+		REQUIRE(g.nodes.size() == 4 && g.connections.size() == 1);
+		CHECK(has_connection(g, "#7", "data", "sink", "data"));
+		// In creation order: the new filter comes after the sink
+		CHECK(g.nodes[2].name == "filter" && g.nodes[2].inputs.empty() && g.nodes[3].name == "#7");
+
+		std::ostringstream out;
+		debugviz::write_flow_graph(out, "Recorded", g.nodes, g.connections);
+		CHECK(out.str().find("\"sink\"") != std::string::npos);
+		CHECK(recorder.dropped() == 0);
+	}
+
+	// Full rings drop events instead of waiting
+	{
+		flow_graph_recorder recorder(16);
+		const auto name = recorder.intern("n");
+		for(int i = 0; i < 100; i++) recorder.add_node(uint64_t(i), name);
+		CHECK(recorder.dropped() == 84);
+		CHECK(recorder.snapshot().nodes.size() == 16);
+		recorder.add_node(1000, name);
+		CHECK(recorder.snapshot().nodes.size() == 17);
+	}
+
+	// Worker threads record while the consumer collects
+	{
+		const int threads = 8, chain = 2000;
+		flow_graph_recorder recorder;
+		std::atomic<bool> done{ false };
+		std::atomic<int> finished{ 0 };
+		std::atomic<long long> nanoseconds{ 0 };
+
+		std::thread consumer([&]
+		{
+			while(!done.load()) recorder.collect();
+		});
+		std::vector<std::thread> workers;
+		for(int t = 0; t < threads; t++)
+			workers.emplace_back([&, t]
+			{
+				const auto name = recorder.intern("worker " + std::to_string(t)), slot = recorder.intern("next");
+				const uint64_t base = uint64_t(t) << 32;
+				const auto start = std::chrono::steady_clock::now();
+				for(int i = 0; i < chain; i++)
+				{
+					recorder.add_node(base + i, name);
+					if(i) recorder.connect(base + i - 1, slot, base + i, slot);
+					// Every tenth node is replaced: its connections go with it
+					if(i % 10 == 9)
+					{
+						recorder.remove_node(base + i);
+						recorder.add_node(base + i, name);
+					}
+				}
+				nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				finished++;
+			});
+		for(std::thread& w : workers) w.join();
+		done = true;
+		consumer.join();
+
+		const flow_graph_snapshot g = recorder.snapshot();
+		CHECK(recorder.dropped() == 0);
+		REQUIRE(g.nodes.size() == size_t(threads * chain));
+		// Connections to replaced nodes (i % 10 == 9) are gone, those from them were made afterwards
+		CHECK(g.connections.size() == size_t(threads * (chain - 1 - chain / 10)));
+		for(const auto& c : g.connections) CHECK(g.nodes[c.out].name == g.nodes[c.in].name);
+
+		const double events = double(threads) * chain * 2.2;
+		std::printf("recorder: %.1f ns per event (%d threads)\n", double(nanoseconds.load()) / events, threads);
+	}
+
+	// Threads interning the same strings get the same ids
+	{
+		flow_graph_recorder recorder(16, 4096);
+		std::vector<std::vector<flow_graph_recorder::name_id>> ids(4);
+		std::vector<std::thread> workers;
+		for(size_t t = 0; t < ids.size(); t++)
+			workers.emplace_back([&, t]
+			{
+				for(int i = 0; i < 2000; i++) ids[t].push_back(recorder.intern("name " + std::to_string(i)));
+			});
+		for(std::thread& w : workers) w.join();
+		for(size_t t = 1; t < ids.size(); t++) CHECK(ids[t] == ids[0]);
+		CHECK(recorder.intern("one more") != flow_graph_recorder::npos);
+
+		flow_graph_recorder small(16, 4);
+		for(int i = 0; i < 4; i++) CHECK(small.intern(std::to_string(i)) != flow_graph_recorder::npos);
+		CHECK(small.intern("full") == flow_graph_recorder::npos);
+
+		// Names that did not fit still give a graph
+		small.add_node(1, small.intern("0"));
+		small.add_node(2, flow_graph_recorder::npos);
+		small.add_input(2, flow_graph_recorder::npos);
+		small.connect(1, flow_graph_recorder::npos, 2, small.intern("1"));
+		const flow_graph_snapshot g = small.snapshot();
+		REQUIRE(g.nodes.size() == 2);
+		CHECK(g.nodes[1].name == "#2");
+		CHECK(g.nodes[0].outputs.size() == 1 && g.nodes[0].outputs[0] == "?");
+		CHECK(g.nodes[1].inputs.size() == 2 && g.nodes[1].inputs[0] == "?");
+		CHECK(has_connection(g, "0", "?", "#2", "1"));
+	}
+
+	return check_result();
+}
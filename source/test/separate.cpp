@@ -0,0 +1,3 @@
+// Writer and viewer of the tests built with DEBUGVIZ_SEPARATE, compiled once
+#define DEBUGVIZ_IMPLEMENTATION
+#include "../../include/debugviz/flow_graph.h"
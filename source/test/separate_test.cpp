@@ -0,0 +1,126 @@
+#include "../../include/debugviz/flow_graph.h"
+#include "check.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(DEBUGVIZ_SEPARATE)
+	#error "Built with DEBUGVIZ_SEPARATE, and linked with the code compiled with DEBUGVIZ_IMPLEMENTATION"
+#endif
+
+struct node
+{
+	std::string name;
+	std::vector<std::string> inputs, outputs;
+	double time_ns;
+};
+struct connection
+{
+	size_t out, out_slot, in, in_slot;
+};
+struct named_connection
+{
+	std::string out, out_slot, in, in_slot;
+	int bytes;
+};
+struct name_connection
+{
+	std::string out, out_slot, in, in_slot;
+};
+
+// Same graph, given to the writer by hand (its templates are not compiled apart)
+static std::string streamed(const std::vector<node>& nodes, const std::vector<named_connection>& connections,
+	const debugviz::flow_graph_options& options)
+{
+	std::ostringstream out;
+	debugviz::flow_graph_writer<std::ostream> writer(out, "Test <separate>", options);
+	debugviz::flow_graph_layout layout;
+	std::map<std::string, size_t> index;
+	writer.begin();
+	for(const node& n : nodes)
+	{
+		debugviz::flow_graph_measures m;
+		m.time_ns = n.time_ns;
+		writer.add_node(n.name, n.inputs, n.outputs, m);
+		index[n.name] = layout.add_node(debugviz::detail::flow_graph_metrics::node_height(n.inputs.size(), n.outputs.size()));
+	}
+	for(const named_connection& c : connections)
+	{
+		const auto out = index.find(c.out), in = index.find(c.in);
+		if(out == index.end() || in == index.end()) continue;
+		const auto& outputs = nodes[out->second].outputs;
+		const auto& inputs = nodes[in->second].inputs;
+		const auto out_slot = std::find(outputs.begin(), outputs.end(), c.out_slot), in_slot = std::find(inputs.begin(), inputs.end(), c.in_slot);
+		if(out_slot == outputs.end() || in_slot == inputs.end()) continue;
+
+		debugviz::flow_graph_measures m;
+		m.bytes = c.bytes;
+		writer.add_connection(out->second, size_t(out_slot - outputs.begin()), in->second, size_t(in_slot - inputs.begin()), m);
+		layout.add_edge(out->second, in->second);
+	}
+	layout.compute();
+	layout.compute_clusters();	// Big graph without groups, as in write_flow_graph
+	writer.finish(layout);
+	return out.str();
+}
+template<typename C>
+static std::string written(const std::vector<node>& nodes, const C& connections, const debugviz::flow_graph_options& options)
+{
+	std::ostringstream out;
+	debugviz::write_flow_graph(out, "Test <separate>", nodes, connections, options);
+	return out.str();
+}
+
+int main()
+{
+	// Several batches of nodes, connections across them
+	std::vector<node> nodes;
+	std::vector<connection> links;
+	std::vector<named_connection> named;
+	for(size_t i = 0; i < 10000; i++)
+	{
+		nodes.push_back({ "node " + std::to_string(i), { "a", "b" }, { "out" }, double(i % 13) });
+		if(i % 7 == 0) nodes.back().inputs.push_back("\"escaped\"");
+		if(i > 0) links.push_back({ i / 3, 0, i, i % 2 });
+		if(i > 0) named.push_back({ "node " + std::to_string(i / 3), "out", "node " + std::to_string(i), i % 2 ? "b" : "a", int(i) });
+	}
+	named.push_back({ "node 5", "out", "node 6", "missing", 0 });	// Skipped
+	named.push_back({ "missing", "out", "node 6", "a", 0 });	// Skipped
+
+	const debugviz::flow_graph_options json, binary = { debugviz::flow_graph_payload::binary, debugviz::flow_graph_compression::deflate };
+	for(const debugviz::flow_graph_options& options : { json, binary })
+	{
+		const std::string expected = streamed(nodes, named, options);
+		CHECK(written(nodes, named, options) == expected);
+		std::ostringstream out;
+		debugviz::flow_graph_arena(std::string("Test <separate>"), nodes, named).write(out, options);
+		CHECK(out.str() == expected);
+	}
+
+	// Indices are checked against all the nodes, not those of a batch
+	links.push_back({ 0, 0, 10000, 0 });	// Skipped
+	std::vector<name_connection> by_name;
+	for(const connection& c : links)
+		if(c.in < nodes.size())
+			by_name.push_back({ nodes[c.out].name, nodes[c.out].outputs[c.out_slot], nodes[c.in].name, nodes[c.in].inputs[c.in_slot] });
+	CHECK(written(nodes, links, json) == written(nodes, by_name, json));
+
+	// Empty graph: a single empty batch
+	CHECK(written({}, links, json).find("<title>Test &lt;separate&gt;</title>") != std::string::npos);
+
+	// A layout cache that cannot be written is reported apart from the caller's stream
+	debugviz::flow_graph_options unwritable;
+	unwritable.layout_cache = "missing directory/test_layout_cache.bin";
+	std::ostringstream failed;
+	debugviz::flow_graph_write_status status;
+	debugviz::write_flow_graph(failed, "Test", nodes, links, unwritable, status);
+	CHECK(!status.layout_cache_saved && failed.good() && failed.str().size() > 0);
+	debugviz::flow_graph_arena arena(std::string("Test"), nodes, links);
+	arena.write(failed, unwritable, status);
+	CHECK(!status.layout_cache_saved && failed.good());
+
+	return check_result();
+}